@@ -20,20 +20,18 @@ class Standing : public StateBehavior<JumpStateComponent> {
 
   JumpState Update(JumpStateComponent* state_component, const Entity* entity,
                    const Seconds dt) const override {
-    state_component->time_since_map_collision(
-        state_component->time_since_map_collision() + dt);
-    // movement
     Body* body = entity->GetComponent<Body>();
     assert(body);
-    Body new_body = *body;
-    new_body.vel = body->vel - vec2f{0, 20} * dt;
-
-    *body = new_body;
-
+    if (body->contacts & CONTACT_GROUND) {
+      state_component->time_since_map_collision(0);
+    } else {
+      state_component->time_since_map_collision(
+          state_component->time_since_map_collision() + dt);
+    }
     // This is the time that Bog can fall (e.g. no collision with map) before he
     // can no longer jump. 0.2 feels about right and also has a bonus of being a
     // bad hack to make Bog be able to jump when he's going down slopes.
-    if (state_component->time_since_map_collision() > 0.2) {
+    if (state_component->time_since_map_collision() > BOG_COYOTE_TIME) {
       return JumpState::FALLING;
     }
     return state();
@@ -57,22 +55,6 @@ class Standing : public StateBehavior<JumpStateComponent> {
     return state();
   }
 
-  JumpState HandleCollision(JumpStateComponent* state_component,
-                            const Entity* entity,
-                            const CollisionEvent* collision) const override {
-    if (collision->second == MAP_BODY_ID) {
-      state_component->time_since_map_collision(0);
-      Body* body = entity->GetComponent<Body>();
-      assert(body);
-      Body new_body = *body;
-      new_body.bbox.lowerLeft += collision->fix;
-      if (collision->fix.x != 0) new_body.vel.x = 0;
-      if (collision->fix.y != 0) new_body.vel.y = 0;
-      *body = new_body;
-    }
-    return state();
-  }
-
   JumpState state() const override { return JumpState::STANDING; }
 };
 
@@ -83,37 +65,18 @@ class Falling : public StateBehavior<JumpStateComponent> {
   void Exit(JumpStateComponent*, const Entity*) const override {
   }
   JumpState Update(JumpStateComponent*, const Entity* entity,
-                   const Seconds dt) const override {
-    // movement
+                   const Seconds) const override {
     Body* body = entity->GetComponent<Body>();
     assert(body);
-    Body new_body = *body;
-    new_body.vel = body->vel - vec2f{0, 20} * dt;
-
-    *body = new_body;
-
+    if (body->contacts & CONTACT_GROUND) {
+      return JumpState::STANDING;
+    }
     return state();
   }
   JumpState HandleInput(JumpStateComponent*, const Entity*,
                         const ButtonEvent*) const override {
     return state();
   }
-  JumpState HandleCollision(JumpStateComponent*, const Entity* entity,
-                            const CollisionEvent* collision) const override {
-    if (collision->second == MAP_BODY_ID) {
-      Body* body = entity->GetComponent<Body>();
-      assert(body);
-      Body new_body = *body;
-      new_body.bbox.lowerLeft += collision->fix;
-      if (collision->fix.x != 0) new_body.vel.x = 0;
-      if (collision->fix.y != 0) new_body.vel.y = 0;
-      *body = new_body;
-      if (collision->fix.y > 0) {
-        return JumpState::STANDING;
-      }
-    }
-    return state();
-  }
   JumpState state() const override { return JumpState::FALLING; }
 };
 
@@ -122,23 +85,25 @@ class Jumping : public StateBehavior<JumpStateComponent> {
   void Enter(JumpStateComponent*, const Entity* entity) const override {
     Body* body = entity->GetComponent<Body>();
     assert(body);
-    body->vel.y = 6;
+    // Rise at a steady speed while the button is held.
+    body->vel.y = BOG_JUMP_SPEED;
+    body->gravity_scale = 0;
   }
   void Exit(JumpStateComponent*, const Entity* entity) const override {
     Body* body = entity->GetComponent<Body>();
     assert(body);
-    body->vel.y = 5;
+    body->vel.y = BOG_JUMP_RELEASE_SPEED;
+    body->gravity_scale = 1;
   }
   JumpState Update(JumpStateComponent* state_component, const Entity* entity,
                    const Seconds dt) const override {
-    if (state_component->time() > 0.3) {
-      return JumpState::FALLING;
-    }
     // movement
     Body* body = entity->GetComponent<Body>();
     assert(body);
-    Body new_body = *body;
-    *body = new_body;
+    if (state_component->time() > BOG_MAX_JUMP_TIME ||
+        (body->contacts & CONTACT_CEILING)) {
+      return JumpState::FALLING;
+    }
 
     return state();
   }
@@ -150,22 +115,6 @@ class Jumping : public StateBehavior<JumpStateComponent> {
     }
     return state();
   }
-  JumpState HandleCollision(JumpStateComponent*, const Entity* entity,
-                            const CollisionEvent* collision) const override {
-    if (collision->second == MAP_BODY_ID) {
-      Body* body = entity->GetComponent<Body>();
-      assert(body);
-      Body new_body = *body;
-      new_body.bbox.lowerLeft += collision->fix;
-      if (collision->fix.x != 0) new_body.vel.x = 0;
-      if (collision->fix.y != 0) new_body.vel.y = 0;
-      *body = new_body;
-      if (collision->fix.y < 0) {
-        return JumpState::FALLING;
-      }
-    }
-    return state();
-  }
   JumpState state() const override { return JumpState::JUMPING; }
 };
 }  // namespace
@@ -187,23 +136,16 @@ class Left : public StateBehavior<LRStateComponent> {
     Sprite* sprite = entity->GetComponent<Sprite>();
     assert(sprite);
     sprite->orientation = Orientation::FLIPPED_H;
+    Body* body = entity->GetComponent<Body>();
+    assert(body);
+    body->accel.x = -BOG_RUN_ACCEL;
+    body->max_speed.x = BOG_MAX_RUN_SPEED;
   }
 
-  void Exit(LRStateComponent*, const Entity*) const override {
-  }
-
-  LRState Update(LRStateComponent*, const Entity* entity,
-                 const Seconds dt) const override {
-    // movement
+  void Exit(LRStateComponent*, const Entity* entity) const override {
     Body* body = entity->GetComponent<Body>();
     assert(body);
-    Body new_body = *body;
-    new_body.vel.x -= 16.0 * dt;
-    new_body.vel.x = max(new_body.vel.x, -4.0);
-
-    *body = new_body;
-
-    return state();
+    body->accel.x = 0;
   }
 
   LRState HandleInput(LRStateComponent*, const Entity*,
@@ -227,23 +169,16 @@ class Right : public StateBehavior<LRStateComponent> {
     Sprite* sprite = entity->GetComponent<Sprite>();
     assert(sprite);
     sprite->orientation = Orientation::NORMAL;
+    Body* body = entity->GetComponent<Body>();
+    assert(body);
+    body->accel.x = BOG_RUN_ACCEL;
+    body->max_speed.x = BOG_MAX_RUN_SPEED;
   }
 
-  void Exit(LRStateComponent*, const Entity*) const override {
-  }
-
-  LRState Update(LRStateComponent*, const Entity* entity,
-                 const Seconds dt) const override {
-    // movement
+  void Exit(LRStateComponent*, const Entity* entity) const override {
     Body* body = entity->GetComponent<Body>();
     assert(body);
-    Body new_body = *body;
-    new_body.vel.x += 16.0 * dt;
-    new_body.vel.x = min(new_body.vel.x, 4.0);
-
-    *body = new_body;
-
-    return state();
+    body->accel.x = 0;
   }
 
   LRState HandleInput(LRStateComponent*, const Entity*,
@@ -294,3 +229,15 @@ std::unique_ptr<StateMachineSystem<LRStateComponent>> MakeLRStateSystem() {
 
   return system;
 }
+
+JumpProfile MakeBogJumpProfile() {
+  JumpProfile profile;
+  profile.width = BOG_WIDTH;
+  profile.height = BOG_HEIGHT;
+  profile.gravity = BOG_GRAVITY;
+  profile.jump_speed = BOG_JUMP_SPEED;
+  profile.max_jump_time = BOG_MAX_JUMP_TIME;
+  profile.jump_release_speed = BOG_JUMP_RELEASE_SPEED;
+  profile.run_speed = BOG_MAX_RUN_SPEED;
+  return profile;
+}
@@ -5,9 +5,25 @@
 
 #include "Entity.h"
 #include "Input.h"
+#include "Navigation.h"
 #include "Physics.h"
 #include "State.h"
 
+// Bog's size and movement, in tiles and seconds.
+const double BOG_WIDTH = 0.9;
+const double BOG_HEIGHT = 0.75;
+const double BOG_GRAVITY = 20;
+// Upward speed held while the jump button is down, for up to
+// BOG_MAX_JUMP_TIME.
+const double BOG_JUMP_SPEED = 6;
+const Seconds BOG_MAX_JUMP_TIME = 0.3;
+// Upward speed left when a jump ends.
+const double BOG_JUMP_RELEASE_SPEED = 5;
+const double BOG_RUN_ACCEL = 16;
+const double BOG_MAX_RUN_SPEED = 4;
+// How long Bog can be off the map (e.g. going down slopes) and still jump.
+const Seconds BOG_COYOTE_TIME = 0.2;
+
 enum class JumpState {
   UNKNOWN,
   STANDING,
@@ -65,5 +81,7 @@ class LRStateComponent : public StateComponent<LRState> {
 
 std::unique_ptr<StateMachineSystem<JumpStateComponent>> MakeJumpStateSystem();
 std::unique_ptr<StateMachineSystem<LRStateComponent>> MakeLRStateSystem();
+// What Bog can jump over, for navigation.
+JumpProfile MakeBogJumpProfile();
 
 #endif  // BOG_H
@@ -3,12 +3,13 @@
 
 #include <iostream>
 
-Camera::Camera(const vec2f& center, const vec2f& size)
+Camera::Camera(const vec2d& center, const vec2d& size)
     : center_(center), half_size_(size/2) {}
 
-vec2f Camera::Transform(const vec2f& point) const {
-  vec2f translated = point - center_;
-  vec2f transformed = {translated.x / half_size_.x, translated.y / half_size_.y};
+vec2f Camera::Transform(const vec2d& point) const {
+  vec2d translated = point - center_;
+  vec2f transformed = {(float)(translated.x / half_size_.x),
+                       (float)(translated.y / half_size_.y)};
   /* std::cout << "p " << point.x << ", " << point.y << std::endl
             << "t " << transform->position.x << ", "
             << transform->position.y << std::endl; */
@@ -16,7 +17,8 @@ vec2f Camera::Transform(const vec2f& point) const {
 }
 
 Rect Camera::Transform(const Rect& rect) const {
-  Rect transformed = {Transform(rect.lowerLeft), rect.w / half_size_.x,
-                      rect.h / half_size_.y};
+  vec2d translated = rect.lowerLeft - center_;
+  Rect transformed = {{translated.x / half_size_.x, translated.y / half_size_.y},
+                      rect.w / half_size_.x, rect.h / half_size_.y};
   return transformed;
 }
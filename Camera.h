@@ -15,25 +15,29 @@
 class Camera {
  public:
   // Game (tile) coordinates
-  Camera(const vec2f& center, const vec2f& size);
-  vec2f Transform(const vec2f& point) const;
+  Camera(const vec2d& center, const vec2d& size);
+  vec2f Transform(const vec2d& point) const;
   Rect Transform(const Rect& rect) const;
-  vec2f center() const { return center_; }
-  void center(const vec2f& center) { center_ = center; }
-  vec2f half_size() const { return half_size_; }
-  void half_size(const vec2f& half_size) { half_size_ = half_size; }
+  vec2d center() const { return center_; }
+  void center(const vec2d& center) { center_ = center; }
+  vec2d half_size() const { return half_size_; }
+  void half_size(const vec2d& half_size) { half_size_ = half_size; }
+  // What the camera sees, in game coordinates.
+  Rect view() const {
+    return {center_ - half_size_, 2 * half_size_.x, 2 * half_size_.y};
+  }
  private:
   // Game (tile) coordinates
-  vec2f center_;
+  vec2d center_;
   // Half size is more useful here because GL draws from -1 to 1 rather than a
   // unit size of 1 (-0.5 to 0.5).
-  vec2f half_size_;
+  vec2d half_size_;
 };
 
 class Transform : public Component {
  public:
   ComponentType type() const override { return ComponentType::TRANSFORM; }
-  vec2f position;
+  vec2d position;
 };
 
 #endif  // CAMERA_H
@@ -0,0 +1,184 @@
+#include "ChunkStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+// Camera movement per frame, in tiles, below which it counts as standing
+// still and nothing is prefetched.
+const double MIN_SPEED = 1e-3;
+// Evicted chunks kept around for their buffers.
+const size_t MAX_SPARE = 64;
+}  // namespace
+
+ChunkStreamer::ChunkStreamer(int radius, int prefetch)
+    : radius_(radius), prefetch_(prefetch) {
+  thread_ = std::thread(&ChunkStreamer::Run, this);
+}
+
+ChunkStreamer::~ChunkStreamer() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void ChunkStreamer::AddLayer(TileMap* tile_map) {
+  int side = 2 * radius_ + 1 + prefetch_;
+  tile_map->ReserveSlots(side, side);
+  layers_.push_back(tile_map);
+  in_flight_.emplace_back();
+}
+
+void ChunkStreamer::Update(const Camera& camera) {
+  vec2d center = camera.center();
+  vec2d velocity = has_center_ ? center - last_center_ : vec2d{0, 0};
+  last_center_ = center;
+  has_center_ = true;
+
+  vector<Load> loaded;
+  deque<Load> dropped;
+  {
+    lock_guard<mutex> lock(mutex_);
+    loaded.swap(loaded_);
+    // Queued loads are rebuilt from scratch below, so the queue follows the
+    // camera instead of piling up behind it.
+    dropped.swap(requests_);
+  }
+  for (Load& load : dropped) {
+    in_flight_[load.layer].erase(Key(load.chunk.x, load.chunk.y));
+    spare_.push_back(move(load.chunk));
+  }
+  for (Load& load : loaded) {
+    const TileMap::Chunk& chunk = load.chunk;
+    in_flight_[load.layer].erase(Key(chunk.x, chunk.y));
+    TileMap* tile_map = layers_[load.layer];
+    Window window = WindowAt(center, velocity, *tile_map);
+    // The window fits in the slots, so this only ever evicts chunks that
+    // are outside it.
+    if (chunk.x >= window.x0 && chunk.x <= window.x1 &&
+        chunk.y >= window.y0 && chunk.y <= window.y1) {
+      tile_map->InstallChunk(&load.chunk);
+    }
+    spare_.push_back(move(load.chunk));
+  }
+  if (spare_.size() > MAX_SPARE) {
+    spare_.resize(MAX_SPARE);
+  }
+
+  vector<pair<int, Load>> wanted;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    const TileMap& tile_map = *layers_[i];
+    unordered_set<uint64_t>& in_flight = in_flight_[i];
+    Window window = WindowAt(center, velocity, tile_map);
+    int center_x = (int)floor(center.x / TileMap::CHUNK_SIZE);
+    int center_y = (int)floor(center.y / TileMap::CHUNK_SIZE);
+    for (int y = window.y0; y <= window.y1; ++y) {
+      for (int x = window.x0; x <= window.x1; ++x) {
+        if (tile_map.IsResident(x, y) || !in_flight.insert(Key(x, y)).second) {
+          continue;
+        }
+        Load load = {i, tile_map.source(), tile_map.tile_bytes(), {}};
+        if (!spare_.empty()) {
+          load.chunk = move(spare_.back());
+          spare_.pop_back();
+        }
+        load.chunk.x = x;
+        load.chunk.y = y;
+        int distance = max(abs(x - center_x), abs(y - center_y));
+        wanted.emplace_back(distance, move(load));
+      }
+    }
+  }
+  if (wanted.empty()) {
+    return;
+  }
+  stable_sort(wanted.begin(), wanted.end(),
+              [](const pair<int, Load>& a, const pair<int, Load>& b) {
+                return a.first < b.first;
+              });
+  {
+    lock_guard<mutex> lock(mutex_);
+    for (auto& load : wanted) {
+      requests_.push_back(move(load.second));
+    }
+  }
+  cv_.notify_one();
+}
+
+void ChunkStreamer::LoadNow(const vec2d& center) {
+  last_center_ = center;
+  has_center_ = true;
+  vector<uint16_t> tiles;
+  TileMap::Chunk chunk;
+  for (TileMap* tile_map : layers_) {
+    Window window = WindowAt(center, {0, 0}, *tile_map);
+    for (int y = window.y0; y <= window.y1; ++y) {
+      for (int x = window.x0; x <= window.x1; ++x) {
+        if (!tile_map->IsResident(x, y)) {
+          chunk.x = x;
+          chunk.y = y;
+          TileMap::FetchChunk(*tile_map->source(), tile_map->tile_bytes(),
+                              &tiles, &chunk);
+          tile_map->InstallChunk(&chunk);
+        }
+      }
+    }
+  }
+}
+
+ChunkStreamer::Window ChunkStreamer::WindowAt(const vec2d& center,
+                                              const vec2d& velocity,
+                                              const TileMap& tile_map) const {
+  int x = (int)floor(center.x / TileMap::CHUNK_SIZE);
+  int y = (int)floor(center.y / TileMap::CHUNK_SIZE);
+  Window window = {x - radius_, y - radius_, x + radius_, y + radius_};
+  if (velocity.x < -MIN_SPEED) {
+    window.x0 -= prefetch_;
+  } else if (velocity.x > MIN_SPEED) {
+    window.x1 += prefetch_;
+  }
+  if (velocity.y < -MIN_SPEED) {
+    window.y0 -= prefetch_;
+  } else if (velocity.y > MIN_SPEED) {
+    window.y1 += prefetch_;
+  }
+  window.x0 = max(window.x0, 0);
+  window.y0 = max(window.y0, 0);
+  window.x1 = min(window.x1, tile_map.chunks_w() - 1);
+  window.y1 = min(window.y1, tile_map.chunks_h() - 1);
+  return window;
+}
+
+int ChunkStreamer::pending() const {
+  size_t pending = 0;
+  for (const auto& in_flight : in_flight_) {
+    pending += in_flight.size();
+  }
+  return (int)pending;
+}
+
+uint64_t ChunkStreamer::Key(int x, int y) {
+  return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+void ChunkStreamer::Run() {
+  vector<uint16_t> tiles;
+  unique_lock<mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+    if (stop_) {
+      return;
+    }
+    Load load = move(requests_.front());
+    requests_.pop_front();
+    lock.unlock();
+    TileMap::FetchChunk(*load.source, load.tile_bytes, &tiles, &load.chunk);
+    lock.lock();
+    loaded_.push_back(move(load));
+  }
+}
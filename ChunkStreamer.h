@@ -0,0 +1,85 @@
+// Streams TileMap chunks in and out around the Camera, so levels can be far
+// bigger than what is kept in memory.
+#ifndef CHUNKSTREAMER_H
+#define CHUNKSTREAMER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "Camera.h"
+#include "Geometry.h"
+#include "TileMap.h"
+
+// Keeps the chunks within radius() of the camera resident in every added
+// layer, plus prefetch() more chunks ahead of the way the camera is moving.
+// Chunks are read from each layer's ChunkSource on a background thread and
+// installed in Update(), so the main thread never waits on a load.
+class ChunkStreamer {
+ public:
+  // @radius and @prefetch are in chunks.
+  ChunkStreamer(int radius, int prefetch);
+  ~ChunkStreamer();
+
+  // Shrinks @tile_map to the streaming window and starts streaming it. Call
+  // before the first Update(); whatever was resident is evicted.
+  void AddLayer(TileMap* tile_map);
+
+  // Installs chunks that finished loading and queues loads for the window
+  // around @camera. Call once a frame from the main thread, while nothing
+  // else is reading the layers.
+  void Update(const Camera& camera);
+  // Loads the window around @center right away on the calling thread, e.g.
+  // when a level starts and there is nothing to show yet.
+  void LoadNow(const vec2d& center);
+
+  int radius() const { return radius_; }
+  int prefetch() const { return prefetch_; }
+  // Chunk loads queued or in progress.
+  int pending() const;
+
+ private:
+  struct Window {
+    int x0, y0, x1, y1;
+  };
+
+  struct Load {
+    size_t layer;
+    std::shared_ptr<const ChunkSource> source;
+    int tile_bytes;
+    TileMap::Chunk chunk;
+  };
+
+  // Chunks to keep resident around @center, moving by @velocity tiles a
+  // frame, clipped to @tile_map.
+  Window WindowAt(const vec2d& center, const vec2d& velocity,
+                  const TileMap& tile_map) const;
+  static uint64_t Key(int x, int y);
+  void Run();
+
+  int radius_;
+  int prefetch_;
+  std::vector<TileMap*> layers_;
+  bool has_center_ = false;
+  vec2d last_center_ = {0, 0};
+  // Per layer, keys of chunks queued, loading or loaded but not yet
+  // installed.
+  std::vector<std::unordered_set<uint64_t>> in_flight_;
+  // Evicted chunks, whose buffers get reused for the next loads.
+  std::vector<TileMap::Chunk> spare_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  // Closest first.
+  std::deque<Load> requests_;
+  std::vector<Load> loaded_;
+};
+
+#endif  // CHUNKSTREAMER_H
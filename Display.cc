@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "Display.h"
+#include "GLState.h"
 
 using namespace std;
 
@@ -25,12 +26,12 @@ Display::Display(unsigned int width, unsigned int height, unsigned int bpp) {
                             SDL_WINDOWPOS_UNDEFINED, screen_width,
                             screen_height, SDL_WINDOW_OPENGL);
 
-  SDL_GL_CreateContext(window);  // probably should delete this
-
   if (!window) {
     cout << "Error opening surface: " << SDL_GetError() << endl;
   }
 
+  context = SDL_GL_CreateContext(window);
+
   glewExperimental = GL_TRUE;
   GLenum glewErr = glewInit();
 
@@ -51,7 +52,7 @@ Display::Display(unsigned int width, unsigned int height, unsigned int bpp) {
 
   glViewport(0, 0, screen_width, screen_height);
 
-  glEnable(GL_DEPTH_TEST);
+  GLState::DepthTest(true);
   glDepthFunc(GL_LESS);
 }
 
@@ -59,4 +60,15 @@ void Display::Clear() { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); }
 
 void Display::Swap() { SDL_GL_SwapWindow(window); }
 
-Display::~Display() { SDL_Quit(); }
+void Display::MakeCurrent() {
+  if (SDL_GL_MakeCurrent(window, context)) {
+    cout << "Error making GL context current: " << SDL_GetError() << endl;
+  }
+}
+
+void Display::ReleaseCurrent() { SDL_GL_MakeCurrent(window, nullptr); }
+
+Display::~Display() {
+  SDL_GL_DeleteContext(context);
+  SDL_Quit();
+}
@@ -7,9 +7,15 @@ class Display {
   ~Display();
   void Clear();
   void Swap();
+  // Makes the GL context current on the calling thread. It starts out
+  // current on the thread that made the Display.
+  void MakeCurrent();
+  // Lets go of the GL context on the calling thread, so another can take it.
+  void ReleaseCurrent();
 
  private:
   SDL_Window *window;
+  SDL_GLContext context;
   unsigned int screen_width;
   unsigned int screen_height;
   unsigned int screen_bpp;
@@ -4,7 +4,7 @@
 #include "Entity.h"
 #include "Geometry.h"
 
-enum class EventType { COLLISION, INPUT };
+enum class EventType { COLLISION, INPUT, TRIGGER };
 
 class Event {
  public:
@@ -0,0 +1,170 @@
+#include "FlowField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace {
+const int32_t UNREACHABLE = numeric_limits<int32_t>::max();
+// Frontier cells per ParallelFor chunk. Early and late levels are smaller
+// than this and run inline without waking the pool.
+const size_t kFrontierGrain = 1024;
+// Rows per chunk when resetting the field.
+const size_t kRowGrain = 64;
+// Rebuild rather than let offset_ get near overflowing.
+const int32_t MAX_OFFSET = 1 << 30;
+}  // namespace
+
+FlowField::FlowField(const TileMap* tile_map, WorkerPool* worker_pool)
+    : tile_map_(tile_map),
+      worker_pool_(worker_pool),
+      w_(tile_map->GetWidth()),
+      h_(tile_map->GetHeight()),
+      passable_(w_ * h_),
+      distances_(new std::atomic<int32_t>[w_ * h_]),
+      next_(worker_pool ? worker_pool->size() : 1) {
+  for (int y = 0; y < h_; ++y) {
+    for (int x = 0; x < w_; ++x) {
+      passable_[y * w_ + x] = tile_map_->At(x, y) != TILE_BLOCK;
+      distances_[y * w_ + x].store(UNREACHABLE, memory_order_relaxed);
+    }
+  }
+}
+
+void FlowField::SetGoal(TilePos goal) {
+  int steps = Distance(goal);
+  bool incremental = has_goal_ && steps >= 0 &&
+                     steps <= max_incremental_move_ &&
+                     offset_ + steps < MAX_OFFSET;
+  goal_ = goal;
+  has_goal_ = Passable(goal.x, goal.y);
+  if (!incremental) {
+    Rebuild();
+    return;
+  }
+  offset_ += steps;
+  last_update_size_ = 0;
+  frontier_.clear();
+  if (Claim(goal.y * w_ + goal.x, 0)) {
+    frontier_.push_back(goal.y * w_ + goal.x);
+  }
+  Propagate(&frontier_, 0);
+}
+
+int FlowField::Distance(TilePos tile) const {
+  if (!Passable(tile.x, tile.y)) {
+    return -1;
+  }
+  int32_t distance =
+      distances_[tile.y * w_ + tile.x].load(memory_order_relaxed);
+  return distance == UNREACHABLE ? -1 : distance + offset_;
+}
+
+vec2d FlowField::Direction(const vec2d& pos) const {
+  TilePos tile = {(int)floor(pos.x), (int)floor(pos.y)};
+  int best = Distance(tile);
+  if (best <= 0) {
+    return {0, 0};
+  }
+  vec2d step = {0, 0};
+  for (int dy = -1; dy <= 1; ++dy) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      if (dx == 0 && dy == 0) {
+        continue;
+      }
+      // Don't cut corners.
+      if (dx != 0 && dy != 0 &&
+          (!Passable(tile.x + dx, tile.y) || !Passable(tile.x, tile.y + dy))) {
+        continue;
+      }
+      int distance = Distance({tile.x + dx, tile.y + dy});
+      if (distance >= 0 && distance < best) {
+        best = distance;
+        step = {(double)dx, (double)dy};
+      }
+    }
+  }
+  double length = sqrt(step.x * step.x + step.y * step.y);
+  return length > 0 ? step / length : step;
+}
+
+bool FlowField::Passable(int x, int y) const {
+  return x >= 0 && y >= 0 && x < w_ && y < h_ && passable_[y * w_ + x];
+}
+
+void FlowField::Rebuild() {
+  auto reset = [this](size_t begin, size_t end, int) {
+    for (size_t i = begin * w_; i < end * w_; ++i) {
+      distances_[i].store(UNREACHABLE, memory_order_relaxed);
+    }
+  };
+  if (worker_pool_) {
+    worker_pool_->ParallelFor(h_, kRowGrain, reset);
+  } else {
+    reset(0, h_, 0);
+  }
+  offset_ = 0;
+  last_update_size_ = 0;
+  frontier_.clear();
+  if (has_goal_) {
+    Claim(goal_.y * w_ + goal_.x, 0);
+    frontier_.push_back(goal_.y * w_ + goal_.x);
+  }
+  Propagate(&frontier_, 0);
+}
+
+bool FlowField::Claim(int cell, int level) {
+  int32_t want = level - offset_;
+  int32_t current = distances_[cell].load(memory_order_relaxed);
+  while (want < current) {
+    if (distances_[cell].compare_exchange_weak(current, want,
+                                               memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Level synchronous: every cell in the frontier is expanded in parallel, and
+// a cell only joins the next frontier for whichever thread lowers it first.
+// Distances don't depend on which thread that is, so the field is the same
+// for any number of threads.
+void FlowField::Propagate(vector<int>* frontier, int level) {
+  auto expand = [this, frontier, &level](size_t begin, size_t end,
+                                         int thread) {
+    vector<int>& next = next_[thread];
+    for (size_t i = begin; i < end; ++i) {
+      int cell = (*frontier)[i];
+      int x = cell % w_;
+      int y = cell / w_;
+      const int neighbors[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1},
+                                   {x, y + 1}};
+      for (const auto& neighbor : neighbors) {
+        if (!Passable(neighbor[0], neighbor[1])) {
+          continue;
+        }
+        int next_cell = neighbor[1] * w_ + neighbor[0];
+        if (Claim(next_cell, level + 1)) {
+          next.push_back(next_cell);
+        }
+      }
+    }
+  };
+
+  while (!frontier->empty()) {
+    last_update_size_ += frontier->size();
+    if (worker_pool_) {
+      worker_pool_->ParallelFor(frontier->size(), kFrontierGrain, expand);
+    } else {
+      expand(0, frontier->size(), 0);
+    }
+    ++level;
+    frontier->clear();
+    for (auto& next : next_) {
+      frontier->insert(frontier->end(), next.begin(), next.end());
+      next.clear();
+    }
+  }
+}
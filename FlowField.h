@@ -0,0 +1,71 @@
+// Flow fields for crowds: the distance from every tile to one goal, so any
+// number of agents chasing it can look up which way to go without searching.
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Geometry.h"
+#include "TileMap.h"
+#include "WorkerPool.h"
+
+// Breadth first distances over the non-block tiles of a TileMap, 4-connected.
+// One field per goal; agents chasing different targets use different fields.
+class FlowField {
+ public:
+  // @worker_pool may be null, in which case everything runs on the calling
+  // thread.
+  FlowField(const TileMap* tile_map, WorkerPool* worker_pool);
+
+  // Points the field at @goal. A goal within max_incremental_move() steps of
+  // the last one only updates the tiles that got closer; anything else
+  // rebuilds the field.
+  void SetGoal(TilePos goal);
+  TilePos goal() const { return goal_; }
+
+  // Steps from @tile to the goal, or -1 if it can't get there.
+  int Distance(TilePos tile) const;
+  // Unit vector from the tile at @pos towards the next tile on the way to the
+  // goal. Zero at the goal and where the goal can't be reached.
+  vec2d Direction(const vec2d& pos) const;
+
+  int max_incremental_move() const { return max_incremental_move_; }
+  void max_incremental_move(int steps) { max_incremental_move_ = steps; }
+  // Tiles whose distance changed in the last SetGoal().
+  int last_update_size() const { return last_update_size_; }
+
+ private:
+  bool Passable(int x, int y) const;
+  void Rebuild();
+  // Lowers @cell to @level steps if that's closer than it was.
+  bool Claim(int cell, int level);
+  // Breadth first search out from @frontier, whose cells are @level steps
+  // from the goal, stopping wherever nothing gets closer.
+  void Propagate(std::vector<int>* frontier, int level);
+
+  const TileMap* tile_map_;
+  WorkerPool* worker_pool_;
+  int w_, h_;
+  std::vector<uint8_t> passable_;
+
+  TilePos goal_ = {-1, -1};
+  bool has_goal_ = false;
+  int max_incremental_move_ = 16;
+  int last_update_size_ = 0;
+
+  // The distance of cell i is distances_[i] + offset_. Moving the goal d
+  // steps raises every distance by at most d, so adding d to offset_ gives an
+  // upper bound everywhere at once, and only the cells that come in under it
+  // need to be touched.
+  std::unique_ptr<std::atomic<int32_t>[]> distances_;
+  int32_t offset_ = 0;
+
+  std::vector<int> frontier_;
+  // Per thread next frontiers.
+  std::vector<std::vector<int>> next_;
+};
+
+#endif  // FLOWFIELD_H
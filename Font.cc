@@ -2,7 +2,8 @@
 
 #include <cassert>
 
-std::unique_ptr<Font> Font::MakeFont(const PixelData& pd) {
+std::unique_ptr<Font> Font::MakeFont(const PixelData& pd,
+                                     const Rect& region) {
   // needs alpha
   assert(pd.format == GL_RGBA || pd.format == GL_BGRA);
 
@@ -25,6 +26,11 @@ std::unique_ptr<Font> Font::MakeFont(const PixelData& pd) {
       c.lower_left.y = ((float)row)/((float)rows);
       c.upper_right.x = ((float)(col+1))/((float)cols); // Bottom is row 0 (texture coordinates)
       c.upper_right.y = ((float)(row+1))/((float)rows);
+      c.lower_left = {(float)(region.lowerLeft.x + c.lower_left.x * region.w),
+                      (float)(region.lowerLeft.y + c.lower_left.y * region.h)};
+      c.upper_right = {
+          (float)(region.lowerLeft.x + c.upper_right.x * region.w),
+          (float)(region.lowerLeft.y + c.upper_right.y * region.h)};
       // TODO: Update this with the correct width for a space.
       c.width = 3.0/16.0;
 
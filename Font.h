@@ -29,7 +29,10 @@ struct Character {
 
 class Font {
  public:
-  static std::unique_ptr<Font> MakeFont(const PixelData& pixel_data);
+  // @region is where the font's texture is in the texture it is drawn from,
+  // see TextureManager::region().
+  static std::unique_ptr<Font> MakeFont(const PixelData& pixel_data,
+                                        const Rect& region = {{0, 0}, 1, 1});
   Character GetCharacter(char c) const;
  private:
   Font() : characters_(256) {}
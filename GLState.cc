@@ -0,0 +1,155 @@
+#include "GLState.h"
+
+#include <cassert>
+
+namespace {
+const int MAX_UNITS = 8;
+// Never a GL name or enum we use, so nothing matches it.
+const GLuint UNKNOWN = ~0u;
+
+struct Cache {
+  GLuint program = UNKNOWN;
+  GLuint active_unit = UNKNOWN;
+  GLuint textures[MAX_UNITS];
+  GLuint vertex_array = UNKNOWN;
+  GLuint array_buffer = UNKNOWN;
+  GLuint element_buffer = UNKNOWN;
+  GLuint blend = UNKNOWN;
+  GLuint blend_source = UNKNOWN, blend_dest = UNKNOWN;
+  GLuint depth_test = UNKNOWN;
+
+  Cache() {
+    for (GLuint& texture : textures) {
+      texture = UNKNOWN;
+    }
+  }
+};
+
+Cache cache;
+GLCallStats stats;
+
+// Sets @cached to @value and returns true if that changes it.
+bool Change(GLuint* cached, GLuint value) {
+  if (*cached == value) {
+    ++stats.skipped;
+    return false;
+  }
+  *cached = value;
+  ++stats.made;
+  return true;
+}
+
+void SetCapability(GLenum capability, GLuint* cached, bool enable) {
+  if (Change(cached, enable)) {
+    if (enable) {
+      glEnable(capability);
+    } else {
+      glDisable(capability);
+    }
+  }
+}
+}  // namespace
+
+void GLState::UseProgram(GLuint program) {
+  if (Change(&cache.program, program)) {
+    glUseProgram(program);
+  }
+}
+
+void GLState::BindTexture(int unit, GLuint texture) {
+  assert(unit >= 0 && unit < MAX_UNITS);
+  if (cache.textures[unit] == texture) {
+    ++stats.skipped;
+    return;
+  }
+  if (Change(&cache.active_unit, unit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+  }
+  Change(&cache.textures[unit], texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLState::BindTextureForUpdate(int unit, GLuint texture) {
+  assert(unit >= 0 && unit < MAX_UNITS);
+  if (cache.textures[unit] != texture) {
+    // Binding makes the unit active anyway.
+    BindTexture(unit, texture);
+    return;
+  }
+  if (Change(&cache.active_unit, unit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+  }
+}
+
+void GLState::BindVertexArray(GLuint vertex_array) {
+  if (Change(&cache.vertex_array, vertex_array)) {
+    glBindVertexArray(vertex_array);
+    cache.element_buffer = UNKNOWN;
+  }
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer) {
+  GLuint* cached = nullptr;
+  if (target == GL_ARRAY_BUFFER) {
+    cached = &cache.array_buffer;
+  } else if (target == GL_ELEMENT_ARRAY_BUFFER) {
+    cached = &cache.element_buffer;
+  }
+  if (!cached || Change(cached, buffer)) {
+    glBindBuffer(target, buffer);
+  }
+}
+
+void GLState::Blend(bool enable) {
+  SetCapability(GL_BLEND, &cache.blend, enable);
+}
+
+void GLState::BlendFunc(GLenum source, GLenum dest) {
+  if (cache.blend_source == source && cache.blend_dest == dest) {
+    ++stats.skipped;
+    return;
+  }
+  cache.blend_source = source;
+  cache.blend_dest = dest;
+  ++stats.made;
+  glBlendFunc(source, dest);
+}
+
+void GLState::DepthTest(bool enable) {
+  SetCapability(GL_DEPTH_TEST, &cache.depth_test, enable);
+}
+
+void GLState::DeleteTexture(GLuint texture) {
+  for (GLuint& bound : cache.textures) {
+    if (bound == texture) {
+      bound = 0;
+    }
+  }
+  glDeleteTextures(1, &texture);
+}
+
+void GLState::DeleteBuffer(GLuint buffer) {
+  if (cache.array_buffer == buffer) {
+    cache.array_buffer = 0;
+  }
+  if (cache.element_buffer == buffer) {
+    cache.element_buffer = 0;
+  }
+  glDeleteBuffers(1, &buffer);
+}
+
+void GLState::DeleteVertexArray(GLuint vertex_array) {
+  if (cache.vertex_array == vertex_array) {
+    cache.vertex_array = 0;
+    cache.element_buffer = UNKNOWN;
+  }
+  glDeleteVertexArrays(1, &vertex_array);
+}
+
+void GLState::Reset() { cache = Cache(); }
+
+GLCallStats GLState::TakeStats() {
+  GLCallStats taken = stats;
+  stats = GLCallStats();
+  return taken;
+}
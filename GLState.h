@@ -0,0 +1,55 @@
+// Skips GL calls that wouldn't change anything.
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <cstddef>
+
+#include <GL/glew.h>
+
+struct GLCallStats {
+  // State changing calls passed on to GL.
+  size_t made = 0;
+  // Calls dropped because they would have set what was already set.
+  size_t skipped = 0;
+};
+
+// Remembers the bound program, textures, vertex array and buffers, and the
+// blend and depth test state, and only calls GL when they change. Anything
+// that changes these must do it through here, or the cache goes stale; call
+// Reset() after code that doesn't.
+//
+// Draws should set the state they need rather than restore what they found,
+// so runs of similar draws make no state changes between them.
+class GLState {
+ public:
+  static void UseProgram(GLuint program);
+  // Binds @texture to GL_TEXTURE_2D on texture unit @unit.
+  static void BindTexture(int unit, GLuint texture);
+  // Like BindTexture(), but also leaves @unit active when @texture was
+  // already bound there. Use it before glTexParameteri, glTexSubImage2D and
+  // the like, which act on the active unit.
+  static void BindTextureForUpdate(int unit, GLuint texture);
+  static void BindVertexArray(GLuint vertex_array);
+  // The GL_ELEMENT_ARRAY_BUFFER binding belongs to the bound vertex array,
+  // so it is forgotten whenever the vertex array changes.
+  static void BindBuffer(GLenum target, GLuint buffer);
+  static void Blend(bool enable);
+  static void BlendFunc(GLenum source, GLenum dest);
+  static void DepthTest(bool enable);
+
+  // Deleting an object unbinds it, and its name may be reused, so deletes
+  // go through here too.
+  static void DeleteTexture(GLuint texture);
+  static void DeleteBuffer(GLuint buffer);
+  static void DeleteVertexArray(GLuint vertex_array);
+
+  // Forgets all state, so the next call of each kind is made.
+  static void Reset();
+  // Counts since the last TakeStats(), e.g. a frame's.
+  static GLCallStats TakeStats();
+
+ private:
+  GLState() = delete;
+};
+
+#endif  // GLSTATE_H
@@ -7,6 +7,7 @@
 #include <GL/glew.h>
 
 #include "Camera.h"
+#include "GLState.h"
 #include "Physics.h"
 
 namespace {
@@ -24,39 +25,59 @@ const float initialRectVertexData[32] = {
     1.0f,      1.0f,      0.0f, 0.0f, 0.0f,      1.0f,      0.0f, 0.0f,
     1.0f,      0.0f,      0.0f, 0.0f, 0.0f,      1.0f,      0.0f, 0.0f,
 };
+
+// How far a sprite may reach past its body, in tiles. Sprites are a tile
+// square, drawn from near the lower left of the body.
+const double SPRITE_MARGIN = 1;
+// How much further than the view the broadphase is queried, in tiles, for
+// bodies moved since the last physics Update binned them.
+const double BROADPHASE_SLACK = 0.25;
+
+bool Overlaps(const Rect& a, const Rect& b) {
+  return a.lowerLeft.x < b.lowerLeft.x + b.w &&
+         b.lowerLeft.x < a.lowerLeft.x + a.w &&
+         a.lowerLeft.y < b.lowerLeft.y + b.h &&
+         b.lowerLeft.y < a.lowerLeft.y + a.h;
+}
+}
+
+Rect SubSpriteSource(int index, Orientation orientation) {
+  float width = 1.0 / 16.0;
+  float height = 1.0 / 16.0;
+  int rows = 16;
+  int cols = 16;
+  int row = index / cols;
+  int col = index % rows;
+  float x = col / (float) cols;
+  // - height because y is defined from top of sprite but height is "upward"
+  float y = 1.0 - row / (float) rows - height;
+  if (orientation == Orientation::FLIPPED_H) {
+    x += width;
+    width = -width;
+  }
+  return {{x, y}, width, height};
 }
 
-GeometryManager::GeometryManager() {
+GeometryManager::GeometryManager(StreamBuffer* stream_buffer)
+    : stream_buffer_(stream_buffer) {
+  assert(stream_buffer_);
+  // Draws write a few dozen floats at most, so they always fit.
+  assert(stream_buffer_->region_size() >= sizeof(rectVertexData));
   std::copy(initialVertexData, initialVertexData + 24, vertexData);
   std::copy(initialIndexData, initialIndexData + 6, indexData);
   std::copy(initialRectVertexData, initialRectVertexData + 32, rectVertexData);
   for (size_t i = 0; i < 24; ++i) texVertexData[i] = 1.0;
 
-  glGenBuffers(1, &positionBufferObject);
-  glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glGenVertexArrays(1, &vertexArrayObject);
+  GLState::BindVertexArray(vertexArrayObject);
+  // Every draw uses both attributes, only from different places.
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
 
   glGenBuffers(1, &indexBufferObject);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
+  GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indexData), indexData,
                GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-  glGenBuffers(1, &rectPositionBufferObject);
-  glBindBuffer(GL_ARRAY_BUFFER, rectPositionBufferObject);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(rectVertexData), rectVertexData,
-               GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-
-  glGenBuffers(1, &texPositionBufferObject);
-  glBindBuffer(GL_ARRAY_BUFFER, texPositionBufferObject);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(texVertexData), texVertexData,
-               GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  glGenVertexArrays(1, &vertexArrayObject);
 }
 
 GeometryManager::~GeometryManager() {}
@@ -67,51 +88,20 @@ void GeometryManager::DrawTileMap(const Camera& camera) {
   vertexData[18] = 2 * camera.half_size().x;
   vertexData[21] = 2 * camera.half_size().y;
 
-  glBindVertexArray(vertexArrayObject);
+  GLintptr offset = stream_buffer_->Write(vertexData, sizeof(vertexData));
+  GLState::BindVertexArray(vertexArrayObject);
 
-  glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+  GLState::BindBuffer(GL_ARRAY_BUFFER, stream_buffer_->buffer());
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)offset);
   glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0,
-                        (void*)(16 * sizeof(float)));
+                        (void*)(offset + 16 * sizeof(float)));
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
+  GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
 
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  GLState::Blend(true);
+  GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glDrawElements(GL_TRIANGLES, sizeof(indexData) / sizeof(unsigned int),
                  GL_UNSIGNED_INT, (void*)0);
-  glDisable(GL_BLEND);
-
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
-}
-
-void GeometryManager::DrawSubSprite(int si, Orientation orientation,
-                                    const vec2f& dest_pos,
-                                    const Camera& camera) {
-  float width = 1.0 / 16.0;
-  float height = 1.0 / 16.0;
-  int rows = 16;
-  int cols = 16;
-  int row = si / cols;
-  int col = si % rows;
-  float x = col / (float) cols;
-  // - height because y is defined from top of sprite but height is "upward"
-  float y = 1.0 - row / (float) rows - height;
-  if (orientation == Orientation::FLIPPED_H) {
-    x += width;
-    width = -width;
-  }
-  vec2f transformed = camera.Transform(dest_pos);
-  DrawSubTexture(x, y, width, height, transformed.x, transformed.y,
-                 1.0 / camera.half_size().x, 1.0 / camera.half_size().y);
 }
 
 void GeometryManager::DrawSubTexture(float sx, float sy, float sw, float sh,
@@ -144,30 +134,20 @@ void GeometryManager::DrawSubTexture(float sx, float sy, float sw, float sh,
   texVertexData[22] = sx;
   texVertexData[23] = sy;
 
-  glBindVertexArray(vertexArrayObject);
-  glBindBuffer(GL_ARRAY_BUFFER, texPositionBufferObject);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(texVertexData), texVertexData,
-               GL_STATIC_DRAW);
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+  GLintptr offset =
+      stream_buffer_->Write(texVertexData, sizeof(texVertexData));
+  GLState::BindVertexArray(vertexArrayObject);
+  GLState::BindBuffer(GL_ARRAY_BUFFER, stream_buffer_->buffer());
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)offset);
   glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0,
-                        (void*)(16 * sizeof(float)));
+                        (void*)(offset + 16 * sizeof(float)));
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
+  GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
 
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  GLState::Blend(true);
+  GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glDrawElements(GL_TRIANGLES, sizeof(indexData) / sizeof(unsigned int),
                  GL_UNSIGNED_INT, (void*)0);
-  glDisable(GL_BLEND);
-
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
 }
 
 void GeometryManager::DrawRect(float x, float y, float w, float h) {
@@ -180,24 +160,17 @@ void GeometryManager::DrawRect(float x, float y, float w, float h) {
   rectVertexData[12] = x + w;
   rectVertexData[13] = y + h;
 
-  glBindVertexArray(vertexArrayObject);
+  GLintptr offset =
+      stream_buffer_->Write(rectVertexData, sizeof(rectVertexData));
+  GLState::BindVertexArray(vertexArrayObject);
 
-  glBindBuffer(GL_ARRAY_BUFFER, rectPositionBufferObject);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(rectVertexData), rectVertexData,
-               GL_STATIC_DRAW);
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+  GLState::BindBuffer(GL_ARRAY_BUFFER, stream_buffer_->buffer());
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)offset);
   glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0,
-                        (void*)(16 * sizeof(float)));
+                        (void*)(offset + 16 * sizeof(float)));
 
+  GLState::Blend(false);
   glDrawArrays(GL_LINE_LOOP, 0, 4);
-
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
 }
 
 void GeometryManager::DrawRects(const std::function<bool(Rect*)>& next_rect) {
@@ -207,58 +180,85 @@ void GeometryManager::DrawRects(const std::function<bool(Rect*)>& next_rect) {
   }
 }
 
-BoundingBoxGraphicsSystem::BoundingBoxGraphicsSystem(
-    GeometryManager* geometry_manager, ColorProgram* color_program)
-    : geometry_manager_(geometry_manager), color_program_(color_program) {
-  assert(geometry_manager_);
-  assert(color_program_);
+void GraphicsSystem::ForEachVisible(
+    const Camera& camera, const std::vector<Entity>& entities, double margin,
+    const std::function<void(const Entity&)>& fn) {
+  Rect view = camera.view();
+  view.lowerLeft -= {margin, margin};
+  view.w += 2 * margin;
+  view.h += 2 * margin;
+  if (physics_ && physics_->num_bodies() == entities.size()) {
+    QueryFilter filter;
+    filter.tiles = false;
+    Rect query = view;
+    query.lowerLeft -= {BROADPHASE_SLACK, BROADPHASE_SLACK};
+    query.w += 2 * BROADPHASE_SLACK;
+    query.h += 2 * BROADPHASE_SLACK;
+    visible_.clear();
+    physics_->Overlap(query, filter, &visible_);
+    // The broadphase never has these, so they are all tested. Both lists are
+    // in ascending order, so entities keep their order.
+    const std::vector<EntityId>& unbinned = physics_->unbinned();
+    const size_t binned = visible_.size();
+    visible_.insert(visible_.end(), unbinned.begin(), unbinned.end());
+    std::inplace_merge(visible_.begin(), visible_.begin() + binned,
+                       visible_.end());
+    for (EntityId id : visible_) {
+      const Body* body = entities[id].GetComponent<Body>();
+      if (Overlaps(view, body->bbox)) {
+        fn(entities[id]);
+      }
+    }
+    return;
+  }
+  for (const auto& entity : entities) {
+    const Body* body = entity.GetComponent<Body>();
+    if (body && Overlaps(view, body->bbox)) {
+      fn(entity);
+    }
+  }
 }
 
 std::vector<std::unique_ptr<Event>> BoundingBoxGraphicsSystem::Update(
     Seconds, const Camera& camera, const std::vector<Entity>& entities) {
-  color_program_->Use();
-  auto iter = entities.begin();
-  geometry_manager_->DrawRects([&iter, &entities, &camera](Rect* rect) {
-    if (iter != entities.end()) {
-      // TODO: What will the Transform component be used for?
-      *rect = camera.Transform(iter->GetComponent<Body>()->bbox);
-      ++iter;
-      return true;
-    }
-    return false;
+  boxes_.clear();
+  ForEachVisible(camera, entities, 0, [this](const Entity& entity) {
+    // TODO: What will the Transform component be used for?
+    boxes_.push_back(entity.GetComponent<Body>()->bbox);
   });
   return {};
 }
 
-SubSpriteGraphicsSystem::SubSpriteGraphicsSystem(
-    GeometryManager* geometry_manager, TextureProgram* texture_program,
-    TextureManager* texture_manager)
-    : geometry_manager_(geometry_manager),
-      texture_program_(texture_program),
-      texture_manager_(texture_manager) {
-  assert(geometry_manager_);
-  assert(texture_program_);
-  assert(texture_manager_);
+void BoundingBoxGraphicsSystem::TakeBoxes(std::vector<Rect>* boxes) {
+  boxes->clear();
+  std::swap(*boxes, boxes_);
 }
 
 std::vector<std::unique_ptr<Event>> SubSpriteGraphicsSystem::Update(
     Seconds, const Camera& camera, const std::vector<Entity>& entities) {
-  texture_manager_->BindTexture(-1, 1);
-  texture_program_->Use();
-
-  for (const auto& entity : entities) {
+  sprites_.clear();
+  const Rect view = camera.view();
+  ForEachVisible(camera, entities, SPRITE_MARGIN,
+                 [this, &view](const Entity& entity) {
     Sprite* sprite;
     Body* body;
     if (entity.GetComponents(&sprite, &body)) {
-      // TODO: Figure out how to ellide all draws of the same texture source
-      // together.
-      texture_manager_->BindTexture(sprite->texture, 0);
-      // HACK: Run cycle.
+      // HACK: Run cycle. Only runs on screen, which nobody can tell.
       sprite->index++;
-      geometry_manager_->DrawSubSprite(
-          ((sprite->index / 5) % 6) + 32, sprite->orientation,
-          body->bbox.lowerLeft + sprite->offset, camera);
+      const Rect dest = {body->bbox.lowerLeft + sprite->offset, 1, 1};
+      if (Overlaps(view, dest)) {
+        sprites_.push_back(
+            {sprite->texture, dest,
+             SubSpriteSource(((sprite->index / 5) % 6) + 32,
+                             sprite->orientation)});
+      }
     }
-  }
+  });
   return {};
 }
+
+void SubSpriteGraphicsSystem::TakeSprites(
+    std::vector<SpriteInstance>* sprites) {
+  sprites->clear();
+  std::swap(*sprites, sprites_);
+}
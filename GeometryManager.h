@@ -9,16 +9,21 @@
 #include "Camera.h"
 #include "Geometry.h"
 #include "ShaderManager.h"
+#include "SpriteBatch.h"
+#include "StreamBuffer.h"
 #include "System.h"
 #include "TextureManager.h"
 
+// The part of a 16x16 sprite sheet holding sprite @index, counting along rows
+// from the top left, in texture coordinates.
+Rect SubSpriteSource(int index, Orientation orientation);
+
 class GeometryManager {
  public:
-  GeometryManager();
+  // Streams vertices through @stream_buffer, which must outlive this object.
+  explicit GeometryManager(StreamBuffer* stream_buffer);
   ~GeometryManager();
   void DrawTileMap(const Camera& camera);
-  void DrawSubSprite(int si, Orientation orientation, const vec2f& dest_pos,
-                     const Camera& camera);
   void DrawSubTexture(float sx, float sy, float sw, float sh,
                       float dx, float dy, float dw, float dh);
   void DrawRect(float x, float y, float w, float h);
@@ -30,13 +35,14 @@ class GeometryManager {
   float rectVertexData[32];
   float texVertexData[24];
 
-  GLuint positionBufferObject;
   GLuint vertexArrayObject;
   GLuint indexBufferObject;
-  GLuint rectPositionBufferObject;
-  GLuint texPositionBufferObject;
+  // Not owned.
+  StreamBuffer* stream_buffer_;
 };
 
+class Physics;
+
 class GraphicsSystem : public System {
  public:
   std::vector<std::unique_ptr<Event>> Update(
@@ -48,36 +54,59 @@ class GraphicsSystem : public System {
   virtual std::vector<std::unique_ptr<Event>> Update(
       Seconds dt, const Camera& camera,
       const std::vector<Entity>& entities) = 0;
+
+  // Finds entities in view through the broadphase of @physics, which must
+  // have been updated with the same entity list, so entities away from the
+  // camera cost nothing. Without it, every entity's body is tested against
+  // the view. @physics must outlive this object (or be reset to nullptr).
+  // Bodies that Physics leaves out of its broadphase, i.e. disabled ones and
+  // ones on no collision layer, are still tested one by one.
+  void physics(const Physics* physics) { physics_ = physics; }
+
+ protected:
+  // Calls fn(entity) for each of @entities whose body, grown by @margin
+  // tiles, overlaps @camera's view, in the order of @entities.
+  void ForEachVisible(const Camera& camera,
+                      const std::vector<Entity>& entities, double margin,
+                      const std::function<void(const Entity&)>& fn);
+
+ private:
+  // Not owned.
+  const Physics* physics_ = nullptr;
+  std::vector<EntityId> visible_;
 };
 
+// The graphics systems only collect what to draw from the entities, without
+// touching GL, so they can run on the simulation thread; see RenderSnapshot.
+
+// Collects the bounding boxes of entities, for debug drawing.
 class BoundingBoxGraphicsSystem : public GraphicsSystem {
  public:
-  BoundingBoxGraphicsSystem(GeometryManager* geometry_manager,
-                            ColorProgram* color_program);
   std::vector<std::unique_ptr<Event>> Update(
       Seconds dt, const Camera& camera,
       const std::vector<Entity>& entities) override;
 
+  // Moves the boxes collected by the last Update(), in tiles, into @boxes,
+  // replacing what it held.
+  void TakeBoxes(std::vector<Rect>* boxes);
+
  private:
-  // Not owned.
-  GeometryManager* geometry_manager_;
-  ColorProgram* color_program_;
+  std::vector<Rect> boxes_;
 };
 
+// Collects the sprites of entities and steps their animations.
 class SubSpriteGraphicsSystem : public GraphicsSystem {
  public:
-  SubSpriteGraphicsSystem(GeometryManager* geometry_manager,
-                          TextureProgram* texture_program,
-                          TextureManager* texture_manager);
   std::vector<std::unique_ptr<Event>> Update(
       Seconds dt, const Camera& camera,
       const std::vector<Entity>& entities) override;
 
+  // Moves the sprites collected by the last Update() into @sprites, for a
+  // SpriteBatch, replacing what it held.
+  void TakeSprites(std::vector<SpriteInstance>* sprites);
+
  private:
-  // Not owned.
-  GeometryManager* geometry_manager_;
-  TextureProgram* texture_program_;
-  TextureManager* texture_manager_;
+  std::vector<SpriteInstance> sprites_;
 };
 
 #endif
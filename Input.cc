@@ -11,6 +11,8 @@ namespace {
         return Button::PAUSE;
       case SDLK_z:
         return Button::JUMP;
+      case SDLK_x:
+        return Button::ACTION;
       case SDLK_k:
         return Button::UP;
       case SDLK_j:
@@ -0,0 +1,273 @@
+#include "LevelFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+const int CHUNK_TILES = TileMap::CHUNK_SIZE * TileMap::CHUNK_SIZE;
+
+int ChunksAcross(int tiles) {
+  return (tiles + TileMap::CHUNK_SIZE - 1) / TileMap::CHUNK_SIZE;
+}
+}  // namespace
+
+shared_ptr<const LevelFile> LevelFile::Open(const string& filename) {
+  shared_ptr<LevelFile> file(new LevelFile());
+#ifdef _WIN32
+  ifstream in(filename, ios::binary);
+  if (!in) {
+    return nullptr;
+  }
+  file->buffer_.assign(istreambuf_iterator<char>(in),
+                       istreambuf_iterator<char>());
+  file->data_ = file->buffer_.data();
+  file->size_ = file->buffer_.size();
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid without the descriptor.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  file->data_ = static_cast<const uint8_t*>(data);
+  file->size_ = st.st_size;
+#endif
+  if (!file->Valid()) {
+    return nullptr;
+  }
+  return file;
+}
+
+LevelFile::~LevelFile() {
+#ifndef _WIN32
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+#endif
+}
+
+bool LevelFile::Valid() const {
+  // Whether @count things of @size bytes fit at @offset.
+  auto fits = [this](uint64_t offset, uint64_t count, size_t size) {
+    return offset % 8 == 0 && offset <= size_ &&
+           count <= (size_ - offset) / size;
+  };
+
+  if (size_ < sizeof(LevelHeader)) {
+    return false;
+  }
+  const LevelHeader& h = header();
+  if (memcmp(h.magic, LEVEL_MAGIC, sizeof(LEVEL_MAGIC)) != 0 ||
+      h.version != LEVEL_VERSION || h.file_size != size_ ||
+      !fits(h.layers, h.num_layers, sizeof(LevelLayer)) ||
+      !fits(h.objects, h.num_objects, sizeof(LevelObject)) ||
+      !fits(h.properties, h.num_properties, sizeof(LevelProperty)) ||
+      h.num_map_properties > h.num_properties ||
+      !fits(h.strings, h.strings_size, 1) || h.strings_size == 0 ||
+      *At<char>(h.strings + h.strings_size - 1) != '\0') {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < h.num_properties; ++i) {
+    if (properties()[i].name >= h.strings_size ||
+        properties()[i].value >= h.strings_size) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < h.num_objects; ++i) {
+    const LevelObject& object = objects()[i];
+    if (object.name >= h.strings_size || object.type >= h.strings_size ||
+        object.first_property > h.num_properties ||
+        object.num_properties > h.num_properties - object.first_property) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < h.num_layers; ++i) {
+    const LevelLayer& layer = layers()[i];
+    if (layer.name >= h.strings_size || layer.w <= 0 || layer.h <= 0 ||
+        layer.max_tile < 0 || layer.max_tile > 0xffff) {
+      return false;
+    }
+    uint64_t num_chunks =
+        (uint64_t)ChunksAcross(layer.w) * ChunksAcross(layer.h);
+    if (!fits(layer.chunks, num_chunks, sizeof(LevelChunk))) {
+      return false;
+    }
+    size_t chunk_bytes = CHUNK_TILES * TileMap::TileBytes(layer.max_tile);
+    const LevelChunk* chunks = At<LevelChunk>(layer.chunks);
+    for (uint64_t j = 0; j < num_chunks; ++j) {
+      if (chunks[j].tiles && !fits(chunks[j].tiles, 1, chunk_bytes)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+LevelChunkSource::LevelChunkSource(shared_ptr<const LevelFile> file,
+                                   const LevelLayer* layer)
+    : file_(move(file)), layer_(layer), chunks_w_(ChunksAcross(layer->w)) {
+  const size_t num_chunks = (size_t)chunks_w_ * ChunksAcross(layer->h);
+  const size_t chunk_bytes = CHUNK_TILES * TileMap::TileBytes(layer->max_tile);
+  const LevelChunk* chunks = file_->At<LevelChunk>(layer->chunks);
+  bytes_ = num_chunks * sizeof(LevelChunk);
+  for (size_t i = 0; i < num_chunks; ++i) {
+    if (chunks[i].tiles) {
+      bytes_ += chunk_bytes;
+    }
+  }
+}
+
+void LevelChunkSource::LoadChunk(int chunk_x, int chunk_y,
+                                 vector<uint16_t>* tiles) const {
+  const uint8_t* packed;
+  uint16_t uniform;
+  MapChunk(chunk_x, chunk_y, &packed, &uniform);
+  tiles->assign(CHUNK_TILES, uniform);
+  if (!packed) {
+    return;
+  }
+  int tile_bytes = TileMap::TileBytes(layer_->max_tile);
+  for (int y = 0; y < TileMap::CHUNK_SIZE; ++y) {
+    for (int x = 0; x < TileMap::CHUNK_SIZE; ++x) {
+      size_t i = TileMap::ZIndex(x, y);
+      uint16_t& tile = (*tiles)[y * TileMap::CHUNK_SIZE + x];
+      if (tile_bytes == 1) {
+        tile = packed[i];
+      } else {
+        memcpy(&tile, &packed[2 * i], 2);
+      }
+    }
+  }
+}
+
+bool LevelChunkSource::MapChunk(int chunk_x, int chunk_y,
+                                const uint8_t** tiles,
+                                uint16_t* uniform) const {
+  const LevelChunk& chunk =
+      file_->At<LevelChunk>(layer_->chunks)[chunk_y * chunks_w_ + chunk_x];
+  *tiles = chunk.tiles ? file_->At<uint8_t>(chunk.tiles) : nullptr;
+  *uniform = chunk.uniform;
+  return true;
+}
+
+int WriteLevel(const Map& map, const string& filename) {
+  vector<uint8_t> out(sizeof(LevelHeader));
+  // Appends @size bytes, 8 byte aligned, and returns where they went.
+  auto append = [&out](const void* data, size_t size) -> uint64_t {
+    out.resize((out.size() + 7) & ~(size_t)7);
+    uint64_t offset = out.size();
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+    return offset;
+  };
+  string strings;
+  auto add_string = [&strings](const string& s) -> uint32_t {
+    uint32_t offset = strings.size();
+    strings += s;
+    strings.push_back('\0');
+    return offset;
+  };
+
+  vector<LevelLayer> layers;
+  vector<uint16_t> tiles(CHUNK_TILES);
+  TileMap::Chunk chunk;
+  for (const auto& named_layer : map.GetLayers()) {
+    const TileMap& tile_map = named_layer.second;
+    vector<LevelChunk> chunks;
+    for (int chunk_y = 0; chunk_y < tile_map.chunks_h(); ++chunk_y) {
+      for (int chunk_x = 0; chunk_x < tile_map.chunks_w(); ++chunk_x) {
+        for (int y = 0; y < TileMap::CHUNK_SIZE; ++y) {
+          for (int x = 0; x < TileMap::CHUNK_SIZE; ++x) {
+            tiles[y * TileMap::CHUNK_SIZE + x] =
+                tile_map.At(chunk_x * TileMap::CHUNK_SIZE + x,
+                            chunk_y * TileMap::CHUNK_SIZE + y);
+          }
+        }
+        TileMap::PackChunk(tiles, tile_map.tile_bytes(), &chunk);
+        LevelChunk level_chunk = {};
+        level_chunk.uniform = chunk.uniform;
+        if (chunk.tiles) {
+          level_chunk.tiles = append(chunk.tiles, chunk.storage.size());
+        }
+        chunks.push_back(level_chunk);
+      }
+    }
+    LevelLayer layer = {};
+    layer.name = add_string(named_layer.first);
+    layer.w = tile_map.GetWidth();
+    layer.h = tile_map.GetHeight();
+    layer.max_tile = tile_map.source()->max_tile();
+    layer.chunks = append(chunks.data(), chunks.size() * sizeof(LevelChunk));
+    layers.push_back(layer);
+  }
+
+  vector<LevelProperty> properties;
+  for (const auto& property : map.GetProperties()) {
+    properties.push_back(
+        {add_string(property.first), add_string(property.second)});
+  }
+  uint32_t num_map_properties = properties.size();
+
+  vector<LevelObject> objects;
+  for (const auto& id_object : map.GetObjects()) {
+    const MapObject& mo = id_object.second;
+    LevelObject object = {};
+    object.id = id_object.first;
+    object.name = add_string(mo.name);
+    object.type = add_string(mo.type);
+    object.first_property = properties.size();
+    for (const auto& property : mo.properties) {
+      properties.push_back(
+          {add_string(property.first), add_string(property.second)});
+    }
+    object.num_properties = properties.size() - object.first_property;
+    object.pos[0] = mo.pos.x;
+    object.pos[1] = mo.pos.y;
+    object.bounds[0] = mo.bounds.lowerLeft.x;
+    object.bounds[1] = mo.bounds.lowerLeft.y;
+    object.bounds[2] = mo.bounds.w;
+    object.bounds[3] = mo.bounds.h;
+    objects.push_back(object);
+  }
+
+  LevelHeader header = {};
+  memcpy(header.magic, LEVEL_MAGIC, sizeof(LEVEL_MAGIC));
+  header.version = LEVEL_VERSION;
+  header.num_layers = layers.size();
+  header.num_objects = objects.size();
+  header.num_map_properties = num_map_properties;
+  header.num_properties = properties.size();
+  header.layers = append(layers.data(), layers.size() * sizeof(LevelLayer));
+  header.objects =
+      append(objects.data(), objects.size() * sizeof(LevelObject));
+  header.properties =
+      append(properties.data(), properties.size() * sizeof(LevelProperty));
+  header.strings = append(strings.data(), strings.size());
+  header.strings_size = strings.size();
+  header.file_size = out.size();
+  memcpy(out.data(), &header, sizeof(header));
+
+  ofstream file(filename, ios::binary);
+  file.write(reinterpret_cast<const char*>(out.data()), out.size());
+  return file ? 0 : -1;
+}
@@ -0,0 +1,138 @@
+// Cooked levels: what Map::LoadTmx gets out of a .tmx, laid out so the file
+// can be mapped into memory and used in place. Written by tools/cook_level.
+// Offsets are in bytes from the start of the file, and everything is in the
+// byte order of the machine that cooked it.
+#ifndef LEVELFILE_H
+#define LEVELFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TileMap.h"
+
+const char LEVEL_MAGIC[4] = {'C', 'B', 'M', 'L'};
+// Bump whenever anything below changes.
+const uint32_t LEVEL_VERSION = 1;
+
+struct LevelHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t file_size;
+  uint32_t num_layers;
+  uint32_t num_objects;
+  // The map's own properties come first, then the objects'.
+  uint32_t num_map_properties;
+  uint32_t num_properties;
+  // LevelLayer[num_layers]
+  uint64_t layers;
+  // LevelObject[num_objects]
+  uint64_t objects;
+  // LevelProperty[num_properties]
+  uint64_t properties;
+  // NUL terminated strings, referred to by offsets from here.
+  uint64_t strings;
+  uint64_t strings_size;
+};
+
+struct LevelLayer {
+  uint32_t name;
+  int32_t w, h;
+  int32_t max_tile;
+  // LevelChunk[chunks_w * chunks_h], row by row from the lower left.
+  uint64_t chunks;
+};
+
+// Tiles are stored exactly as TileMap keeps them resident, so the collision
+// layer can be queried straight out of the file.
+struct LevelChunk {
+  // TileMap::ZIndex() order, or 0 if every tile is uniform.
+  uint64_t tiles;
+  uint16_t uniform;
+  uint16_t padding[3];
+};
+
+struct LevelObject {
+  int32_t id;
+  uint32_t name;
+  uint32_t type;
+  // This object's properties are properties[first_property, +num_properties).
+  uint32_t first_property;
+  uint32_t num_properties;
+  uint32_t padding;
+  double pos[2];
+  // x, y, w, h
+  double bounds[4];
+};
+
+struct LevelProperty {
+  uint32_t name;
+  uint32_t value;
+};
+
+// A level file mapped into memory.
+class LevelFile {
+ public:
+  // Maps @filename. Returns null if it can't be read, isn't a level file of
+  // this version, or its tables run past the end of it.
+  static std::shared_ptr<const LevelFile> Open(const std::string& filename);
+  ~LevelFile();
+
+  const LevelHeader& header() const {
+    return *reinterpret_cast<const LevelHeader*>(data_);
+  }
+  const LevelLayer* layers() const { return At<LevelLayer>(header().layers); }
+  const LevelObject* objects() const {
+    return At<LevelObject>(header().objects);
+  }
+  const LevelProperty* properties() const {
+    return At<LevelProperty>(header().properties);
+  }
+  const char* String(uint32_t offset) const {
+    return At<char>(header().strings + offset);
+  }
+  template <typename T>
+  const T* At(uint64_t offset) const {
+    return reinterpret_cast<const T*>(data_ + offset);
+  }
+
+ private:
+  LevelFile() {}
+  bool Valid() const;
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  // No mmap; the file is read in whole instead.
+  std::vector<uint8_t> buffer_;
+#endif
+};
+
+// Serves a layer's chunks out of a LevelFile without copying them.
+class LevelChunkSource : public ChunkSource {
+ public:
+  LevelChunkSource(std::shared_ptr<const LevelFile> file,
+                   const LevelLayer* layer);
+  void LoadChunk(int chunk_x, int chunk_y,
+                 std::vector<uint16_t>* tiles) const override;
+  int max_tile() const override { return layer_->max_tile; }
+  // The layer's chunk table and tiles within the file. The layers of a file
+  // split it between them, so the file is only counted once per level.
+  size_t bytes() const override { return bytes_; }
+  bool MapChunk(int chunk_x, int chunk_y, const uint8_t** tiles,
+                uint16_t* uniform) const override;
+
+ private:
+  std::shared_ptr<const LevelFile> file_;
+  const LevelLayer* layer_;
+  int chunks_w_;
+  size_t bytes_ = 0;
+};
+
+// Cooks @map into a level file at @filename. Every layer of @map must be
+// fully resident. Returns 0 on success.
+int WriteLevel(const Map& map, const std::string& filename);
+
+#endif  // LEVELFILE_H
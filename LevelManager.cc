@@ -0,0 +1,237 @@
+#include "LevelManager.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+const char COOKED_EXTENSION[] = ".cbl";
+
+// Where tools/cook_level puts the cooked version of @filename.
+string CookedName(const string& filename) {
+  size_t dot = filename.rfind('.');
+  size_t slash = filename.find_last_of("/\\");
+  if (dot == string::npos || (slash != string::npos && dot < slash)) {
+    return filename + COOKED_EXTENSION;
+  }
+  return filename.substr(0, dot) + COOKED_EXTENSION;
+}
+
+// Whether @cooked exists and is at least as new as the .tmx it was cooked
+// from, @tmx. A level edited since it was cooked loads from the .tmx.
+bool CookedIsCurrent(const string& cooked, const string& tmx) {
+  struct stat cooked_stat, tmx_stat;
+  if (stat(cooked.c_str(), &cooked_stat) != 0) {
+    return false;
+  }
+  if (stat(tmx.c_str(), &tmx_stat) != 0) {
+    // Shipped without the .tmx; the cooked level is all there is.
+    return true;
+  }
+  return cooked_stat.st_mtime >= tmx_stat.st_mtime;
+}
+
+bool IsLink(const string& property_name) {
+  return property_name == "link" || property_name.compare(0, 5, "link.") == 0;
+}
+}  // namespace
+
+size_t Level::bytes() const {
+  size_t total = 0;
+  for (const auto& layer : map.GetLayers()) {
+    total += layer.second.resident_bytes() + layer.second.source()->bytes();
+  }
+  return total;
+}
+
+LevelManager::LevelManager(size_t memory_budget)
+    : memory_budget_(memory_budget) {
+  thread_ = std::thread(&LevelManager::Run, this);
+}
+
+LevelManager::~LevelManager() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void LevelManager::Load(const string& filename) {
+  if (!Touch(filename)) {
+    Queue(filename, true);
+  }
+}
+
+Level* LevelManager::Enter(const string& filename) {
+  Level* level = Touch(filename);
+  if (!level) {
+    return nullptr;
+  }
+  current_ = level;
+  for (const string& link : level->links) {
+    if (!Touch(link)) {
+      Queue(link, false);
+    }
+  }
+  // Whatever was current before may no longer fit.
+  Trim();
+  return level;
+}
+
+Level* LevelManager::EnterNow(const string& filename) {
+  Load(filename);
+  while (true) {
+    if (Touch(filename)) {
+      return Enter(filename);
+    }
+    if (find(in_flight_.begin(), in_flight_.end(), filename) ==
+        in_flight_.end()) {
+      // It failed to load.
+      return nullptr;
+    }
+    {
+      unique_lock<mutex> lock(mutex_);
+      loaded_cv_.wait(lock, [this] { return !loaded_.empty(); });
+    }
+    TakeLoaded();
+  }
+}
+
+void LevelManager::Update() {
+  TakeLoaded();
+  Trim();
+}
+
+size_t LevelManager::cached_bytes() const {
+  size_t total = 0;
+  for (const auto& level : cache_) {
+    total += level->bytes();
+  }
+  return total;
+}
+
+void LevelManager::Queue(const string& filename, bool urgent) {
+  if (find(in_flight_.begin(), in_flight_.end(), filename) !=
+      in_flight_.end()) {
+    if (!urgent) {
+      return;
+    }
+    // Promote a queued prefetch; if it's already loading this does nothing.
+    lock_guard<mutex> lock(mutex_);
+    auto queued = find_if(requests_.begin(), requests_.end(),
+                          [&filename](const Request& request) {
+                            return request.filename == filename;
+                          });
+    if (queued != requests_.end() && !queued->urgent) {
+      requests_.erase(queued);
+      requests_.push_front({filename, true});
+    }
+    return;
+  }
+  in_flight_.push_back(filename);
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (urgent) {
+      requests_.push_front({filename, true});
+    } else {
+      requests_.push_back({filename, false});
+    }
+  }
+  cv_.notify_one();
+}
+
+void LevelManager::TakeLoaded() {
+  vector<pair<string, unique_ptr<Level>>> loaded;
+  {
+    lock_guard<mutex> lock(mutex_);
+    loaded.swap(loaded_);
+  }
+  for (auto& load : loaded) {
+    in_flight_.erase(find(in_flight_.begin(), in_flight_.end(), load.first));
+    if (!load.second) {
+      cout << "Couldn't load level " << load.first << endl;
+      continue;
+    }
+    // Everything loaded was asked for by the current level, so it is more
+    // likely to be needed than whatever was used before.
+    cache_.push_front(move(load.second));
+  }
+}
+
+void LevelManager::Trim() {
+  size_t total = cached_bytes();
+  if (current_) {
+    total -= current_->bytes();
+  }
+  while (total > memory_budget_) {
+    auto victim = find_if(cache_.rbegin(), cache_.rend(),
+                          [this](const unique_ptr<Level>& level) {
+                            return level.get() != current_;
+                          });
+    if (victim == cache_.rend()) {
+      break;
+    }
+    total -= (*victim)->bytes();
+    cache_.erase(next(victim).base());
+  }
+}
+
+Level* LevelManager::Touch(const string& filename) {
+  auto cached = find_if(cache_.begin(), cache_.end(),
+                        [&filename](const unique_ptr<Level>& level) {
+                          return level->filename == filename;
+                        });
+  if (cached == cache_.end()) {
+    return nullptr;
+  }
+  cache_.splice(cache_.begin(), cache_, cached);
+  return cache_.front().get();
+}
+
+void LevelManager::Run() {
+  unique_lock<mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+    if (stop_) {
+      return;
+    }
+    string filename = move(requests_.front().filename);
+    requests_.pop_front();
+    lock.unlock();
+    unique_ptr<Level> level = Build(filename);
+    lock.lock();
+    loaded_.emplace_back(move(filename), move(level));
+    loaded_cv_.notify_all();
+  }
+}
+
+unique_ptr<Level> LevelManager::Build(const string& filename) {
+  unique_ptr<Level> level(new Level());
+  level->filename = filename;
+  const string cooked = CookedName(filename);
+  if ((!CookedIsCurrent(cooked, filename) || level->map.LoadLevel(cooked)) &&
+      level->map.LoadTmx(filename)) {
+    return nullptr;
+  }
+  level->collision_layers = CollisionLayers::FromMap(level->map);
+  level->triggers.reset(
+      new TriggerSystem(level->map, level->collision_layers));
+
+  for (const auto& property : level->map.GetProperties()) {
+    if (IsLink(property.first)) {
+      level->links.push_back(property.second);
+    }
+  }
+  for (const auto& object : level->map.GetObjects()) {
+    const auto link = object.second.properties.find("level");
+    if (link != object.second.properties.end()) {
+      level->links.push_back(link->second);
+    }
+  }
+  return level;
+}
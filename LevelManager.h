@@ -0,0 +1,114 @@
+// Loads levels in the background, so moving between levels doesn't stall the
+// game on parsing.
+#ifndef LEVELMANAGER_H
+#define LEVELMANAGER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Physics.h"
+#include "TileMap.h"
+#include "Trigger.h"
+
+// Everything about a level that can be made before entering it.
+struct Level {
+  // The .tmx it was loaded from, or would have been if a cooked level was
+  // found next to it.
+  std::string filename;
+  Map map;
+  CollisionLayers collision_layers;
+  std::unique_ptr<TriggerSystem> triggers;
+  // Levels reachable from this one, see LevelManager.
+  std::vector<std::string> links;
+
+  // Tiles held by the level in memory: its layers' chunk sources, whether
+  // a mapped level file or a .tmx's packed tiles, plus whatever they have
+  // resident beyond that.
+  size_t bytes() const;
+};
+
+// Reads levels on a background thread and keeps recently used ones in a least
+// recently used cache within a memory budget. Nothing of a level is on the
+// GPU until it is drawn through a TileMapWindow, so entering a cached level
+// takes no uploads.
+//
+// A level links to others through properties: map properties named "link" or
+// "link.<anything>", and the "level" property of objects such as doors, each
+// holding the path of a .tmx. Entering a level prefetches everything it links
+// to, so by the time the player gets to a door the next level is ready.
+//
+// Levels are loaded from the cooked .cbl next to their .tmx when there is one
+// that isn't older than the .tmx.
+// Entities are left to the caller, since EntityManager is only used from the
+// main thread.
+class LevelManager {
+ public:
+  // Keeps cached levels to @memory_budget bytes, not counting the current
+  // one.
+  explicit LevelManager(size_t memory_budget);
+  ~LevelManager();
+
+  // Starts loading @filename ahead of any prefetches, unless it is already
+  // cached or loading.
+  void Load(const std::string& filename);
+  // Makes @filename the current level and prefetches the levels it links to.
+  // Returns null, and changes nothing, if the level isn't loaded yet; call
+  // Load() first and keep trying on later frames.
+  Level* Enter(const std::string& filename);
+  // Loads @filename if need be, waits for it and enters it, e.g. for the
+  // first level, when there is nothing to show yet.
+  // Returns null if it couldn't be loaded.
+  Level* EnterNow(const std::string& filename);
+
+  // Takes levels that finished loading and evicts what no longer fits. Call
+  // once a frame.
+  void Update();
+
+  Level* current() const { return current_; }
+  // Bytes held by cached levels, including the current one.
+  size_t cached_bytes() const;
+
+ private:
+  struct Request {
+    std::string filename;
+    // Only set for Load()s, which jump ahead of prefetches.
+    bool urgent;
+  };
+
+  void Queue(const std::string& filename, bool urgent);
+  // Finds @filename in the cache and marks it most recently used.
+  Level* Touch(const std::string& filename);
+  // Moves levels that finished loading into the cache.
+  void TakeLoaded();
+  // Evicts least recently used levels until the rest fit the budget.
+  void Trim();
+  void Run();
+  // Builds the level in @filename, or returns null if it can't be read.
+  static std::unique_ptr<Level> Build(const std::string& filename);
+
+  size_t memory_budget_;
+  // Most recently used first.
+  std::list<std::unique_ptr<Level>> cache_;
+  Level* current_ = nullptr;
+  // Queued or loading, but not yet in the cache. Used from the main thread
+  // only.
+  std::vector<std::string> in_flight_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::deque<Request> requests_;
+  // Loaded levels, or null for levels that failed, with their filenames.
+  std::vector<std::pair<std::string, std::unique_ptr<Level>>> loaded_;
+  std::condition_variable loaded_cv_;
+};
+
+#endif  // LEVELMANAGER_H
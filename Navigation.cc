@@ -0,0 +1,498 @@
+#include "Navigation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+using namespace std;
+
+namespace {
+// Makes walking win over jumping when they take about as long.
+const Seconds JUMP_PENALTY = 0.1;
+// How far below a character's feet NodeAt() looks for ground.
+const int MAX_NODE_DROP = 3;
+// Step used to check jump and fall arcs against the map.
+const Seconds ARC_STEP = 1.0 / 60.0;
+// Lifts the character's box off the floor it takes off from and lands on.
+const double FLOOR_CLEARANCE = 0.05;
+// Answers PathPlanner keeps waiting to be taken before dropping the oldest.
+const size_t MAX_ANSWERS = 1024;
+
+double Length(const vec2d& v) { return sqrt(v.x * v.x + v.y * v.y); }
+}  // namespace
+
+NavGraph::NavGraph(const TileMap& collision_map, const JumpProfile& profile)
+    : map_(collision_map), profile_(profile) {
+  BuildNodes();
+  BuildLinks();
+}
+
+int NavGraph::NodeAt(const vec2d& feet) const {
+  int x = floor(feet.x);
+  int y = floor(feet.y);
+  for (int drop = 0; drop <= MAX_NODE_DROP; ++drop) {
+    int node = TileNode(x, y - drop);
+    if (node >= 0) {
+      return node;
+    }
+  }
+  return -1;
+}
+
+bool NavGraph::StandableAt(int x, int y, Floor* floor) const {
+  if (x < 0 || y < 0 || x >= map_.GetWidth() || y >= map_.GetHeight()) {
+    return false;
+  }
+  TileType tile_type = map_.At(x, y);
+  if (tile_type == TILE_BLOCK) {
+    return false;
+  }
+  if (IsSlope(tile_type)) {
+    *floor = {y + HeightAtX(0, tile_type), y + HeightAtX(1, tile_type)};
+  } else if (map_.At(x, y - 1) == TILE_BLOCK) {
+    *floor = {(double)y, (double)y};
+  } else {
+    return false;
+  }
+  // Room for the character's head.
+  double top = max(floor->left, floor->right) + profile_.height;
+  for (int head_y = y + 1; head_y < top; ++head_y) {
+    if (map_.At(x, head_y) == TILE_BLOCK) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int NavGraph::TileNode(int x, int y) const {
+  if (x < 0 || y < 0 || x >= map_.GetWidth() || y >= map_.GetHeight()) {
+    return -1;
+  }
+  return tile_nodes_[y * map_.GetWidth() + x];
+}
+
+void NavGraph::BuildNodes() {
+  const int w = map_.GetWidth();
+  const int h = map_.GetHeight();
+  vector<Floor> floors(w * h);
+  vector<bool> standable(w * h);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      standable[y * w + x] = StandableAt(x, y, &floors[y * w + x]);
+    }
+  }
+
+  // The tile next to (x, y) in direction @dir whose floor continues this
+  // one's, or -1. Slopes can take the floor up or down a tile.
+  auto neighbor = [&](int x, int y, int dir) {
+    const Floor& floor = floors[y * w + x];
+    double edge = dir > 0 ? floor.right : floor.left;
+    int next_x = x + dir;
+    if (next_x < 0 || next_x >= w) {
+      return -1;
+    }
+    for (int dy : {0, 1, -1}) {
+      int next_y = y + dy;
+      if (next_y < 0 || next_y >= h || !standable[next_y * w + next_x]) {
+        continue;
+      }
+      const Floor& next = floors[next_y * w + next_x];
+      if (fabs((dir > 0 ? next.left : next.right) - edge) < 1e-6) {
+        return next_y * w + next_x;
+      }
+    }
+    return -1;
+  };
+
+  // Walk each surface from its left end, numbering nodes as we go.
+  tile_nodes_.assign(w * h, -1);
+  auto add_surface = [&](int tile) {
+    NavSurface surface = {(int)nodes_.size(), 0};
+    while (tile >= 0 && tile_nodes_[tile] < 0) {
+      const Floor& floor = floors[tile];
+      NavNode node;
+      node.tile = {tile % w, tile / w};
+      node.feet = {node.tile.x + 0.5, (floor.left + floor.right) / 2};
+      node.surface = surfaces_.size();
+      node.offset = surface.num_nodes == 0
+                        ? 0
+                        : nodes_.back().offset +
+                              Length(node.feet - nodes_.back().feet);
+      tile_nodes_[tile] = nodes_.size();
+      nodes_.push_back(node);
+      ++surface.num_nodes;
+      tile = neighbor(node.tile.x, node.tile.y, 1);
+    }
+    surfaces_.push_back(surface);
+  };
+  for (int tile = 0; tile < w * h; ++tile) {
+    if (standable[tile] && neighbor(tile % w, tile / w, -1) < 0) {
+      add_surface(tile);
+    }
+  }
+  // Odd slope arrangements can leave a tile with two neighbors on one side.
+  // Whatever is left over starts its own surface.
+  for (int tile = 0; tile < w * h; ++tile) {
+    if (standable[tile] && tile_nodes_[tile] < 0) {
+      add_surface(tile);
+    }
+  }
+}
+
+void NavGraph::BuildLinks() {
+  vector<NavLink> candidates;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    candidates.clear();
+    FindJumps(i, &candidates);
+    FindFalls(i, &candidates);
+    // Keep only the quickest way to each other surface.
+    sort(candidates.begin(), candidates.end(),
+         [this](const NavLink& a, const NavLink& b) {
+           int surface_a = nodes_[a.to].surface;
+           int surface_b = nodes_[b.to].surface;
+           return surface_a < surface_b ||
+                  (surface_a == surface_b && a.cost < b.cost);
+         });
+    nodes_[i].first_link = links_.size();
+    for (size_t c = 0; c < candidates.size(); ++c) {
+      if (c == 0 ||
+          nodes_[candidates[c].to].surface !=
+              nodes_[candidates[c - 1].to].surface) {
+        links_.push_back(candidates[c]);
+      }
+    }
+    nodes_[i].last_link = links_.size();
+  }
+
+  for (const NavSurface& surface : surfaces_) {
+    int first = surface.first_node;
+    int last = first + surface.num_nodes - 1;
+    int next = -1;
+    for (int i = first; i <= last; ++i) {
+      nodes_[i].next_point[0] = next;
+      if (nodes_[i].first_link != nodes_[i].last_link) {
+        next = i;
+      }
+    }
+    next = -1;
+    for (int i = last; i >= first; --i) {
+      nodes_[i].next_point[1] = next;
+      if (nodes_[i].first_link != nodes_[i].last_link) {
+        next = i;
+      }
+    }
+  }
+}
+
+void NavGraph::FindJumps(int node, vector<NavLink>* candidates) const {
+  const NavNode& from = nodes_[node];
+  // A full jump, the longest a character can stay in the air before coming
+  // down max_fall below where it started.
+  const Seconds longest = JumpTime(-profile_.max_fall);
+  const int reach = ceil(profile_.run_speed * longest);
+  const int rise = ceil(profile_.jump_speed * profile_.max_jump_time +
+                        profile_.jump_release_speed *
+                            profile_.jump_release_speed /
+                            (2 * profile_.gravity));
+  const int drop = ceil(profile_.max_fall);
+  for (int y = from.tile.y - drop; y <= from.tile.y + rise; ++y) {
+    for (int x = from.tile.x - reach; x <= from.tile.x + reach; ++x) {
+      int to = TileNode(x, y);
+      if (to < 0 || nodes_[to].surface == from.surface) {
+        continue;
+      }
+      vec2d d = nodes_[to].feet - from.feet;
+      Seconds t = JumpTime(d.y);
+      if (t < 0) {
+        continue;
+      }
+      // Going straight up first clears ledges in the way.
+      for (double wait : {0.0, 0.25, 0.5}) {
+        Seconds delay = wait * t;
+        if (fabs(d.x) > profile_.run_speed * (t - delay)) {
+          break;
+        }
+        Arc arc = {from.feet, delay, d.x / (t - delay), profile_.jump_speed,
+                   profile_.max_jump_time, profile_.jump_release_speed};
+        if (ArcClear(arc, t)) {
+          candidates->push_back({node, to, NavMove::JUMP, t + JUMP_PENALTY});
+          break;
+        }
+      }
+    }
+  }
+}
+
+void NavGraph::FindFalls(int node, vector<NavLink>* candidates) const {
+  const NavNode& from = nodes_[node];
+  const NavSurface& surface = surfaces_[from.surface];
+  for (int dir : {-1, 1}) {
+    int end = dir < 0 ? surface.first_node
+                      : surface.first_node + surface.num_nodes - 1;
+    if (node != end) {
+      continue;
+    }
+    Floor floor;
+    bool standable = StandableAt(from.tile.x, from.tile.y, &floor);
+    assert(standable);
+    (void)standable;
+    // The character drops once its box is past the edge.
+    double edge_x = from.tile.x + (dir > 0 ? 1 : 0);
+    vec2d start = {edge_x + dir * profile_.width / 2,
+                   dir > 0 ? floor.right : floor.left};
+    Seconds walk = fabs(start.x - from.feet.x) / profile_.run_speed;
+    const Seconds longest = sqrt(2 * profile_.max_fall / profile_.gravity);
+    const int reach = ceil(profile_.run_speed * longest + profile_.width);
+    const int drop = ceil(profile_.max_fall);
+    for (int y = from.tile.y - drop; y < from.tile.y; ++y) {
+      for (int x = from.tile.x; x != from.tile.x + dir * (reach + 1);
+           x += dir) {
+        int to = TileNode(x, y);
+        if (to < 0 || nodes_[to].surface == from.surface) {
+          continue;
+        }
+        vec2d d = nodes_[to].feet - start;
+        if (d.y >= 0 || d.x * dir < 0) {
+          continue;
+        }
+        Seconds t = sqrt(-2 * d.y / profile_.gravity);
+        if (fabs(d.x) > profile_.run_speed * t) {
+          continue;
+        }
+        Arc arc = {start, 0, d.x / t, 0, 0, 0};
+        if (ArcClear(arc, t)) {
+          candidates->push_back({node, to, NavMove::FALL, walk + t});
+        }
+      }
+    }
+  }
+}
+
+Seconds NavGraph::JumpTime(double dy) const {
+  const double g = profile_.gravity;
+  const double v = profile_.jump_release_speed;
+  double apex =
+      profile_.jump_speed * profile_.max_jump_time + v * v / (2 * g);
+  // Landings right at the apex leave no room for error.
+  if (dy > apex - FLOOR_CLEARANCE * 2) {
+    return -1;
+  }
+  return profile_.max_jump_time + v / g + sqrt(2 * (apex - dy) / g);
+}
+
+vec2d NavGraph::ArcAt(const Arc& arc, Seconds t) const {
+  double y;
+  if (t < arc.hold) {
+    y = arc.hold_speed * t;
+  } else {
+    Seconds free = t - arc.hold;
+    y = arc.hold_speed * arc.hold + arc.free_speed * free -
+        0.5 * profile_.gravity * free * free;
+  }
+  return arc.start + vec2d{arc.vx * max(t - arc.delay, 0.0), y};
+}
+
+// Only blocks are checked. Clipping the corner of a slope is left to the
+// character following the path.
+bool NavGraph::ArcClear(const Arc& arc, Seconds duration) const {
+  for (Seconds t = 0; t < duration; t += ARC_STEP) {
+    vec2d feet = ArcAt(arc, t);
+    int x0 = floor(feet.x - profile_.width / 2);
+    int x1 = floor(feet.x + profile_.width / 2);
+    int y0 = floor(feet.y + FLOOR_CLEARANCE);
+    int y1 = floor(feet.y + profile_.height);
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        if (map_.At(x, y) == TILE_BLOCK) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+PathPlanner::PathPlanner(const NavGraph* graph, size_t cache_size)
+    : graph_(graph), cache_size_(cache_size) {
+  search_.resize(graph_->nodes().size());
+}
+
+NavPath PathPlanner::FindPath(const vec2d& from, const vec2d& to) {
+  int start = graph_->NodeAt(from);
+  int goal = graph_->NodeAt(to);
+  if (start < 0 || goal < 0) {
+    return NavPath();
+  }
+  const auto& nodes = graph_->nodes();
+  if (nodes[start].surface == nodes[goal].surface) {
+    return MakePath(from, to, {true, {}});
+  }
+  return MakePath(from, to, FindRoute(start, goal));
+}
+
+PathPlanner::Request PathPlanner::RequestPath(const vec2d& from,
+                                              const vec2d& to) {
+  Request request = next_request_++;
+  queue_.push_back({request, from, to});
+  return request;
+}
+
+void PathPlanner::Update(Seconds budget) {
+  typedef std::chrono::steady_clock Clock;
+  auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<Seconds>(budget));
+  while (!queue_.empty()) {
+    const Pending& pending = queue_.front();
+    answers_[pending.request] = FindPath(pending.from, pending.to);
+    queue_.pop_front();
+    if (answers_.size() > MAX_ANSWERS) {
+      answers_.erase(answers_.begin());
+    }
+    if (Clock::now() >= end) {
+      break;
+    }
+  }
+}
+
+bool PathPlanner::TakePath(Request request, NavPath* path) {
+  auto answer = answers_.find(request);
+  if (answer == answers_.end()) {
+    return false;
+  }
+  *path = std::move(answer->second);
+  answers_.erase(answer);
+  return true;
+}
+
+// Any start on one surface can walk to any other, so a route found from one
+// node is good for the whole surface. It may not be the quickest from every
+// node, but it's close.
+const PathPlanner::Route& PathPlanner::FindRoute(int start, int goal) {
+  const auto& nodes = graph_->nodes();
+  uint64_t key = (uint64_t)nodes[start].surface << 32 |
+                 (uint32_t)nodes[goal].surface;
+  auto cached = cache_index_.find(key);
+  if (cached != cache_index_.end()) {
+    ++cache_hits_;
+    cache_.splice(cache_.begin(), cache_, cached->second);
+    return cached->second->second;
+  }
+  ++cache_misses_;
+  cache_.emplace_front(key, Search(start, goal));
+  cache_index_[key] = cache_.begin();
+  if (cache_.size() > cache_size_) {
+    cache_index_.erase(cache_.back().first);
+    cache_.pop_back();
+  }
+  return cache_.front().second;
+}
+
+NavPath PathPlanner::MakePath(const vec2d& from, const vec2d& to,
+                              const Route& route) const {
+  NavPath path;
+  path.found = route.found;
+  if (!route.found) {
+    return path;
+  }
+  const auto& nodes = graph_->nodes();
+  const auto& links = graph_->links();
+  auto add = [&path](const vec2d& pos, NavMove move) {
+    if (!path.waypoints.empty() && move == NavMove::WALK &&
+        path.waypoints.back().pos.x == pos.x &&
+        path.waypoints.back().pos.y == pos.y) {
+      return;
+    }
+    path.waypoints.push_back({pos, move});
+  };
+  add(from, NavMove::WALK);
+  for (int link : route.links) {
+    add(nodes[links[link].from].feet, NavMove::WALK);
+    add(nodes[links[link].to].feet, links[link].move);
+  }
+  add(to, NavMove::WALK);
+  return path;
+}
+
+PathPlanner::Route PathPlanner::Search(int start, int goal) {
+  if (++generation_ == 0) {
+    for (auto& node : search_) {
+      node.generation = 0;
+    }
+    generation_ = 1;
+  }
+  open_.clear();
+  const auto& nodes = graph_->nodes();
+  const auto& links = graph_->links();
+  const int goal_surface = nodes[goal].surface;
+
+  Open(start, -1, -1, 0, goal);
+  while (!open_.empty()) {
+    pop_heap(open_.begin(), open_.end(), greater<pair<Seconds, int>>());
+    int node = open_.back().second;
+    open_.pop_back();
+    if (search_[node].closed) {
+      continue;
+    }
+    search_[node].closed = true;
+    const Seconds cost = search_[node].cost;
+
+    if (node == goal) {
+      Route route = {true, {}};
+      for (; node != start; node = search_[node].parent) {
+        if (search_[node].link >= 0) {
+          route.links.push_back(search_[node].link);
+        }
+      }
+      reverse(route.links.begin(), route.links.end());
+      return route;
+    }
+
+    const NavNode& n = nodes[node];
+    if (n.surface == goal_surface) {
+      Open(goal, node, -1, cost + WalkCost(node, goal), goal);
+    }
+    for (int next : n.next_point) {
+      if (next >= 0) {
+        Open(next, node, -1, cost + WalkCost(node, next), goal);
+      }
+    }
+    for (int link = n.first_link; link < n.last_link; ++link) {
+      Open(links[link].to, node, link, cost + links[link].cost, goal);
+    }
+  }
+  return {false, {}};
+}
+
+Seconds PathPlanner::WalkCost(int a, int b) const {
+  const auto& nodes = graph_->nodes();
+  return fabs(nodes[a].offset - nodes[b].offset) /
+         graph_->profile().run_speed;
+}
+
+// Nothing moves sideways faster than running, so this never overestimates.
+Seconds PathPlanner::Heuristic(int node, int goal) const {
+  const auto& nodes = graph_->nodes();
+  return fabs(nodes[node].feet.x - nodes[goal].feet.x) /
+         graph_->profile().run_speed;
+}
+
+void PathPlanner::Open(int node, int parent, int link, Seconds cost,
+                       int goal) {
+  SearchNode& s = search_[node];
+  if (s.generation != generation_) {
+    s.generation = generation_;
+    s.closed = false;
+    s.cost = numeric_limits<Seconds>::infinity();
+  }
+  if (s.closed || cost >= s.cost) {
+    return;
+  }
+  s.cost = cost;
+  s.parent = parent;
+  s.link = link;
+  open_.push_back({cost + Heuristic(node, goal), node});
+  push_heap(open_.begin(), open_.end(), greater<pair<Seconds, int>>());
+}
@@ -0,0 +1,220 @@
+// Platformer navigation over the collision map: where a character can stand,
+// how it can get between those places by walking, jumping and falling, and
+// path finding on top of that.
+#ifndef NAVIGATION_H
+#define NAVIGATION_H
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Geometry.h"
+#include "System.h"
+#include "TileMap.h"
+
+// How a character moves, in tiles and seconds. See MakeBogJumpProfile().
+struct JumpProfile {
+  double width;
+  double height;
+  double gravity;
+  // Upward speed held for up to max_jump_time while jumping.
+  double jump_speed;
+  Seconds max_jump_time;
+  // Upward speed left when the jump ends.
+  double jump_release_speed;
+  double run_speed;
+  // Longest drop considered for jumps and falls.
+  double max_fall = 12;
+};
+
+enum class NavMove { WALK, JUMP, FALL };
+
+// A tile the character can stand in, resting on a block below or on a slope
+// inside the tile.
+struct NavNode {
+  TilePos tile;
+  // Where the character's feet rest in the middle of the tile.
+  vec2d feet;
+  int surface;
+  // Distance walked along the surface from its left end.
+  double offset;
+  // The closest node in each direction (0 is left, 1 is right) along the
+  // surface that has links, or -1. Walking never has to stop anywhere else on
+  // the way to another surface, so the search skips straight to these.
+  int next_point[2];
+  // Outgoing links are links[first_link, last_link).
+  int first_link;
+  int last_link;
+};
+
+// A jump or fall from one surface to another.
+struct NavLink {
+  int from;
+  int to;
+  NavMove move;
+  // Travel time, including the walk to the edge for falls.
+  Seconds cost;
+};
+
+// A run of nodes that can be walked along without jumping. Nodes of a surface
+// are numbered contiguously from left to right.
+struct NavSurface {
+  int first_node;
+  int num_nodes;
+};
+
+// Built once per level from the collision map. Read only afterwards, so it can
+// be shared between any number of PathPlanners.
+class NavGraph {
+ public:
+  NavGraph(const TileMap& collision_map, const JumpProfile& profile);
+
+  // The node under a character whose feet are at @feet, looking a few tiles
+  // down if it is in the air. -1 if there isn't one.
+  int NodeAt(const vec2d& feet) const;
+
+  const JumpProfile& profile() const { return profile_; }
+  const std::vector<NavNode>& nodes() const { return nodes_; }
+  const std::vector<NavLink>& links() const { return links_; }
+  const std::vector<NavSurface>& surfaces() const { return surfaces_; }
+
+ private:
+  // Heights of the floor at the left and right edges of a standable tile.
+  struct Floor {
+    double left, right;
+  };
+
+  // Flight of the character's feet: up at hold_speed for hold seconds, then
+  // free_speed under gravity. Sideways it waits for delay seconds, then moves
+  // at vx.
+  struct Arc {
+    vec2d start;
+    Seconds delay;
+    double vx;
+    double hold_speed;
+    Seconds hold;
+    double free_speed;
+  };
+
+  bool StandableAt(int x, int y, Floor* floor) const;
+  int TileNode(int x, int y) const;
+  void BuildNodes();
+  void BuildLinks();
+  // Adds the candidate jumps and falls from @node to @candidates.
+  void FindJumps(int node, std::vector<NavLink>* candidates) const;
+  void FindFalls(int node, std::vector<NavLink>* candidates) const;
+  // Time in the air for a full jump landing @dy above where it started, or
+  // a negative number if it can't get that high.
+  Seconds JumpTime(double dy) const;
+  vec2d ArcAt(const Arc& arc, Seconds t) const;
+  // Whether the character's box stays clear of blocks along @arc.
+  bool ArcClear(const Arc& arc, Seconds duration) const;
+
+  const TileMap& map_;
+  JumpProfile profile_;
+  // Tile -> node, or -1.
+  std::vector<int> tile_nodes_;
+  std::vector<NavNode> nodes_;
+  std::vector<NavLink> links_;
+  std::vector<NavSurface> surfaces_;
+};
+
+struct NavWaypoint {
+  // Where the character's feet should be, in tiles.
+  vec2d pos;
+  // How to get here from the previous waypoint.
+  NavMove move;
+};
+
+struct NavPath {
+  bool found = false;
+  // Starts at the requested start position and ends at the goal.
+  std::vector<NavWaypoint> waypoints;
+};
+
+// A* over a NavGraph. Routes between surfaces are cached, and queued requests
+// are answered in Update() within a time budget, so many characters can ask
+// for paths each frame without stalling it.
+class PathPlanner {
+ public:
+  typedef int Request;
+
+  // Keeps up to @cache_size routes.
+  explicit PathPlanner(const NavGraph* graph, size_t cache_size = 256);
+
+  // Finds a path right away.
+  NavPath FindPath(const vec2d& from, const vec2d& to);
+
+  // Queues a path request to be answered by Update().
+  Request RequestPath(const vec2d& from, const vec2d& to);
+  // Answers queued requests, oldest first, until @budget has passed. At least
+  // one request is answered per call so the queue always drains.
+  void Update(Seconds budget);
+  // Moves the answer to @request into @path and returns true, or returns
+  // false if it hasn't been answered yet. Answers left untaken are dropped,
+  // oldest first, once too many pile up, so take them within a few frames.
+  bool TakePath(Request request, NavPath* path);
+  int pending() const { return (int)queue_.size(); }
+
+  int cache_hits() const { return cache_hits_; }
+  int cache_misses() const { return cache_misses_; }
+
+ private:
+  // Links taken between two surfaces. found is false if there is no way.
+  struct Route {
+    bool found;
+    std::vector<int> links;
+  };
+
+  struct Pending {
+    Request request;
+    vec2d from;
+    vec2d to;
+  };
+
+  // Per node search state, reused between searches. A node is untouched in
+  // the current search unless its generation matches.
+  struct SearchNode {
+    uint32_t generation = 0;
+    bool closed;
+    Seconds cost;
+    int parent;
+    // Link taken from parent, or -1 for walking.
+    int link;
+  };
+
+  const Route& FindRoute(int start, int goal);
+  NavPath MakePath(const vec2d& from, const vec2d& to,
+                   const Route& route) const;
+  Route Search(int start, int goal);
+  Seconds WalkCost(int a, int b) const;
+  Seconds Heuristic(int node, int goal) const;
+  void Open(int node, int parent, int link, Seconds cost, int goal);
+
+  const NavGraph* graph_;
+
+  size_t cache_size_;
+  // Most recently used first.
+  std::list<std::pair<uint64_t, Route>> cache_;
+  std::unordered_map<uint64_t,
+                     std::list<std::pair<uint64_t, Route>>::iterator>
+      cache_index_;
+  int cache_hits_ = 0;
+  int cache_misses_ = 0;
+
+  std::vector<SearchNode> search_;
+  uint32_t generation_ = 0;
+  // Min-heap of (estimated total cost, node).
+  std::vector<std::pair<Seconds, int>> open_;
+
+  Request next_request_ = 0;
+  std::deque<Pending> queue_;
+  // Ordered by request, i.e. by age.
+  std::map<Request, NavPath> answers_;
+};
+
+#endif  // NAVIGATION_H
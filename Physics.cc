@@ -2,6 +2,7 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <sstream>
 
 #include "Physics.h"
 
@@ -14,7 +15,7 @@ Location operator|(Location lhs, Location rhs) {
   return static_cast<Location>(static_cast<int>(lhs) | static_cast<int>(rhs));
 }
 
-vec2f PointOfRect(const Rect& rect, Location loc) {
+vec2d PointOfRect(const Rect& rect, Location loc) {
   double x =
       loc & Location::LEFT ? rect.lowerLeft.x : rect.lowerLeft.x + rect.w;
   double y =
@@ -22,15 +23,17 @@ vec2f PointOfRect(const Rect& rect, Location loc) {
   return {x, y};
 }
 
+// @tile is set to the tile tested, whether or not it collided.
 bool PointMap(const TileMap& tile_map, const Rect& rect, Location loc,
-              Axis axis, double* fix) {
-  vec2f contact_pt = PointOfRect(rect, loc);
+              Axis axis, double* fix, TilePos* tile) {
+  vec2d contact_pt = PointOfRect(rect, loc);
   // If we're on the top or right edge of tile x or y == 1, we need to be
   // okay/not colliding with an x_pos or y_pos == 2.
   int tile_x =
       (loc & Location::RIGHT) ? (ceil(contact_pt.x) - 1) : floor(contact_pt.x);
   int tile_y =
       (loc & Location::TOP) ? (ceil(contact_pt.y) - 1) : floor(contact_pt.y);
+  *tile = {tile_x, tile_y};
 
   int tile_type = tile_map.At(tile_x, tile_y);
   if (tile_type == TILE_BLOCK) {
@@ -48,39 +51,13 @@ bool PointMap(const TileMap& tile_map, const Rect& rect, Location loc,
   return false;
 }
 
-// TODO: These might belong in TileMap.cc
-double HeightAtX(double tilespace_x, int tile_type) {
-  switch (tile_type) {
-    case TILE_SLOPE_01:
-      return tilespace_x;
-    case TILE_SLOPE_10:
-      return 1 - tilespace_x;
-    case TILE_SLOPE_05:
-      return 0.5 * tilespace_x;
-    case TILE_SLOPE_51:
-      return 0.5 + 0.5 * tilespace_x;
-    case TILE_SLOPE_15:
-      return 1 - 0.5 * tilespace_x;
-    case TILE_SLOPE_50:
-      return 0.5 - 0.5 * tilespace_x;
-    default:
-      assert(false);
-      return -10;
-  }
-}
-
-bool IsSlope(TileType tile_type) {
-  return tile_type == TILE_SLOPE_01 || tile_type == TILE_SLOPE_10 ||
-         tile_type == TILE_SLOPE_05 || tile_type == TILE_SLOPE_51 ||
-         tile_type == TILE_SLOPE_15 || tile_type == TILE_SLOPE_50;
-};
-
 // TODO: Velocity after @fix should be parallel to the slope so jittering
 // doesn't occur.
-bool PointMapSlope(const TileMap& tile_map, const vec2f& contact_pt,
-                   double* y_fix) {
+bool PointMapSlope(const TileMap& tile_map, const vec2d& contact_pt,
+                   double* y_fix, TilePos* tile) {
   double map_x = floor(contact_pt.x);
   double map_y = floor(contact_pt.y);
+  *tile = {(int)map_x, (int)map_y};
 
   TileType tile_type = tile_map.At(contact_pt.x, contact_pt.y);
   if (IsSlope(tile_type)) {
@@ -114,12 +91,115 @@ bool AxisCheck(double a1, double a2, double b1, double b2, double* fix) {
   }
   return false;
 }
+
+// Clips @ray to @rect. On success [*t_enter, *t_exit] is the part of [0, 1]
+// inside the rect and @normal is the side entered through, zero if the ray
+// starts inside. Touching an edge without crossing it does not count.
+bool ClipRay(const Ray& ray, const Rect& rect, double* t_enter, double* t_exit,
+             vec2d* normal) {
+  *t_enter = 0;
+  *t_exit = 1;
+  *normal = {0, 0};
+  const double origin[2] = {ray.origin.x, ray.origin.y};
+  const double delta[2] = {ray.delta.x, ray.delta.y};
+  const double lo[2] = {rect.lowerLeft.x, rect.lowerLeft.y};
+  const double hi[2] = {rect.lowerLeft.x + rect.w, rect.lowerLeft.y + rect.h};
+  for (int axis = 0; axis < 2; ++axis) {
+    if (delta[axis] == 0) {
+      if (origin[axis] <= lo[axis] || origin[axis] >= hi[axis]) {
+        return false;
+      }
+      continue;
+    }
+    double t0 = (lo[axis] - origin[axis]) / delta[axis];
+    double t1 = (hi[axis] - origin[axis]) / delta[axis];
+    double side = -1;
+    if (t0 > t1) {
+      swap(t0, t1);
+      side = 1;
+    }
+    if (t0 > *t_enter) {
+      *t_enter = t0;
+      *normal = axis == 0 ? vec2d{side, 0} : vec2d{0, side};
+    }
+    *t_exit = min(*t_exit, t1);
+  }
+  return *t_enter < *t_exit;
+}
+
+// Finds where @ray, between t_enter and t_exit, first goes below the surface
+// of the slope tile at @tile.
+bool RaySlope(const Ray& ray, TilePos tile, TileType tile_type, double t_enter,
+              double t_exit, const vec2d& enter_normal, double* t,
+              vec2d* normal) {
+  auto below = [&](double t) {
+    double u = ray.origin.x + ray.delta.x * t - tile.x;
+    double v = ray.origin.y + ray.delta.y * t - tile.y;
+    return v - HeightAtX(min(max(u, 0.0), 1.0), tile_type);
+  };
+  double enter = below(t_enter);
+  if (enter <= 0) {
+    *t = t_enter;
+    *normal = enter_normal;
+    return true;
+  }
+  double exit = below(t_exit);
+  if (exit > 0) {
+    return false;
+  }
+  // The distance below the surface is linear along the ray within a tile.
+  *t = t_enter + (t_exit - t_enter) * enter / (enter - exit);
+  double rise = HeightAtX(1, tile_type) - HeightAtX(0, tile_type);
+  double length = sqrt(rise * rise + 1);
+  *normal = {-rise / length, 1 / length};
+  return true;
+}
+
+// Walks the tiles along @ray in order (a DDA grid traversal), calling
+// fn(tile, t_enter, t_exit, normal) with the part of [0, 1] spent in each and
+// the side it was entered through, until fn returns true or the ray ends.
+template <typename Fn>
+void WalkTiles(const Ray& ray, const Fn& fn) {
+  TilePos tile = {(int)floor(ray.origin.x), (int)floor(ray.origin.y)};
+  const int step_x = ray.delta.x > 0 ? 1 : -1;
+  const int step_y = ray.delta.y > 0 ? 1 : -1;
+  const double t_delta_x =
+      ray.delta.x != 0 ? abs(1 / ray.delta.x) : INFINITY;
+  const double t_delta_y =
+      ray.delta.y != 0 ? abs(1 / ray.delta.y) : INFINITY;
+  double t_max_x = ray.delta.x > 0   ? (tile.x + 1 - ray.origin.x) / ray.delta.x
+                   : ray.delta.x < 0 ? (ray.origin.x - tile.x) / -ray.delta.x
+                                     : INFINITY;
+  double t_max_y = ray.delta.y > 0   ? (tile.y + 1 - ray.origin.y) / ray.delta.y
+                   : ray.delta.y < 0 ? (ray.origin.y - tile.y) / -ray.delta.y
+                                     : INFINITY;
+  double t_enter = 0;
+  vec2d normal = {0, 0};
+  for (;;) {
+    const double t_exit = min(min(t_max_x, t_max_y), 1.0);
+    if (fn(tile, t_enter, t_exit, normal) || t_exit >= 1) {
+      return;
+    }
+    if (t_max_x < t_max_y) {
+      tile.x += step_x;
+      t_enter = t_max_x;
+      t_max_x += t_delta_x;
+      normal = {(double)-step_x, 0};
+    } else {
+      tile.y += step_y;
+      t_enter = t_max_y;
+      t_max_y += t_delta_y;
+      normal = {0, (double)-step_y};
+    }
+  }
+}
+
 }  // namespace
 
 // Returns true if @first and @second collide. @fix is set to the correction
 // that @first must make to no longer collide with @second.
 bool Physics::RectRectCollision(const Rect& first, const Rect& second,
-                                vec2f* fix) {
+                                vec2d* fix) const {
   double x_fix, y_fix;
   if (AxisCheck(first.lowerLeft.x, first.lowerLeft.x + first.w,
                 second.lowerLeft.x, second.lowerLeft.x + second.w, &x_fix) &&
@@ -137,40 +217,69 @@ bool Physics::RectRectCollision(const Rect& first, const Rect& second,
   return false;
 }
 
-bool Physics::XCollision(const Rect& rect, double* x_fix) {
+bool Physics::XCollision(const Rect& rect, double* x_fix,
+                         TilePos* tile) const {
   double tmp;
-  PointMap(*tile_map_, rect, Location::RIGHT | Location::BOTTOM, Axis::X, x_fix);
-  PointMap(*tile_map_, rect, Location::RIGHT | Location::TOP, Axis::X, &tmp);
-  *x_fix = min(*x_fix, tmp);
+  TilePos tmp_tile;
+  PointMap(*tile_map_, rect, Location::RIGHT | Location::BOTTOM, Axis::X, x_fix,
+           tile);
+  PointMap(*tile_map_, rect, Location::RIGHT | Location::TOP, Axis::X, &tmp,
+           &tmp_tile);
+  if (tmp < *x_fix) {
+    *x_fix = tmp;
+    *tile = tmp_tile;
+  }
 
   if (*x_fix == 0) {
-    PointMap(*tile_map_, rect, Location::LEFT | Location::BOTTOM, Axis::X, x_fix);
-    PointMap(*tile_map_, rect, Location::LEFT | Location::TOP, Axis::X, &tmp);
-    *x_fix = max(*x_fix, tmp);
+    PointMap(*tile_map_, rect, Location::LEFT | Location::BOTTOM, Axis::X,
+             x_fix, tile);
+    PointMap(*tile_map_, rect, Location::LEFT | Location::TOP, Axis::X, &tmp,
+             &tmp_tile);
+    if (tmp > *x_fix) {
+      *x_fix = tmp;
+      *tile = tmp_tile;
+    }
   }
 
   return *x_fix != 0;
 }
 
-bool Physics::YCollision(const Rect& rect, double* y_fix) {
+bool Physics::YCollision(const Rect& rect, double* y_fix,
+                         TilePos* tile) const {
   double tmp;
-  PointMap(*tile_map_, rect, Location::BOTTOM | Location::LEFT, Axis::Y, y_fix);
-  PointMap(*tile_map_, rect, Location::BOTTOM | Location::RIGHT, Axis::Y, &tmp);
-  *y_fix = max(*y_fix, tmp);
+  TilePos tmp_tile;
+  PointMap(*tile_map_, rect, Location::BOTTOM | Location::LEFT, Axis::Y, y_fix,
+           tile);
+  PointMap(*tile_map_, rect, Location::BOTTOM | Location::RIGHT, Axis::Y, &tmp,
+           &tmp_tile);
+  if (tmp > *y_fix) {
+    *y_fix = tmp;
+    *tile = tmp_tile;
+  }
 
   if (*y_fix == 0) {
-    PointMap(*tile_map_, rect, Location::LEFT | Location::TOP, Axis::Y, y_fix);
-    PointMap(*tile_map_, rect, Location::RIGHT | Location::TOP, Axis::Y, &tmp);
-    *y_fix = min(*y_fix, tmp);
+    PointMap(*tile_map_, rect, Location::LEFT | Location::TOP, Axis::Y, y_fix,
+             tile);
+    PointMap(*tile_map_, rect, Location::RIGHT | Location::TOP, Axis::Y, &tmp,
+             &tmp_tile);
+    if (tmp < *y_fix) {
+      *y_fix = tmp;
+      *tile = tmp_tile;
+    }
   }
 
   return *y_fix != 0;
 }
 
-bool Physics::RectMapCollision(const Rect& rect, const vec2f& last_pos,
-                               vec2f* fix) {
+// @x_tile is set to the tile that caused the x part of @fix, and @y_tile to
+// the one that caused the y part.
+bool Physics::RectMapCollision(const Rect& rect, const vec2d& last_pos,
+                               vec2d* fix, TilePos* x_tile,
+                               TilePos* y_tile) const {
   // TODO: Remove this from outside this function (only set to zero once).
   *fix = {0,0};
+  *x_tile = {0, 0};
+  *y_tile = {0, 0};
 
   bool was_on_slope =
       IsSlope(tile_map_->At(last_pos.x + (rect.w / 2.0), last_pos.y));
@@ -179,12 +288,12 @@ bool Physics::RectMapCollision(const Rect& rect, const vec2f& last_pos,
     // We weren't on a slope, check X
     Rect x_only = rect;
     x_only.lowerLeft.y = last_pos.y;
-    XCollision(x_only, &fix->x);
+    XCollision(x_only, &fix->x, x_tile);
   }
 
   if (PointMapSlope(*tile_map_,
                     {rect.lowerLeft.x + (rect.w / 2.0), last_pos.y},
-                    &fix->y)) {
+                    &fix->y, y_tile)) {
     if (last_pos.y + fix->y > rect.lowerLeft.y) {
       // y is below slope after x movement, so we collided with it.
       // fix should be based on rect.lowerLeft, so we need to correct from
@@ -201,55 +310,826 @@ bool Physics::RectMapCollision(const Rect& rect, const vec2f& last_pos,
     // Not on a slope, check Y w.r.t. block map.
     Rect x_fixed = rect;
     x_fixed.lowerLeft.x += fix->x;
-    YCollision(x_fixed, &fix->y);
+    YCollision(x_fixed, &fix->y, y_tile);
   } else {
     PointMapSlope(*tile_map_,
                   {rect.lowerLeft.x + (rect.w / 2.0), rect.lowerLeft.y},
-                  &fix->y);
+                  &fix->y, y_tile);
   }
 
   return fix->x != 0 || fix->y != 0;
 }
 
+void Physics::ParallelFor(size_t n, size_t grain,
+                          const WorkerPool::RangeFn& fn) const {
+  if (worker_pool_) {
+    worker_pool_->ParallelFor(n, grain, fn);
+  } else {
+    for (size_t begin = 0; begin < n; begin += grain) {
+      fn(begin, min(begin + grain, n), 0);
+    }
+  }
+}
+
+void Physics::GatherMotion(size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    Body* body = bodies_[i];
+    bool moving = body->enabled;
+    if (moving && body->sleeping) {
+      moving = body->vel.x != 0 || body->vel.y != 0 || body->accel.x != 0 ||
+               body->accel.y != 0;
+      if (moving) {
+        body->Wake();
+      }
+    }
+    moving_[i] = moving;
+    positions_[i] = body->bbox.lowerLeft;
+    if (!moving) {
+      // Held still, so the passes over the arrays need no branches.
+      velocities_[i] = {0, 0};
+      accels_[i] = {0, 0};
+      drags_[i] = {0, 0};
+      max_speeds_[i] = {0, 0};
+      continue;
+    }
+    velocities_[i] = body->vel;
+    accels_[i] = gravity_ * body->gravity_scale + body->accel;
+    drags_[i] = body->drag;
+    max_speeds_[i] = body->max_speed;
+  }
+}
+
+// Straight passes over the arrays, branch free apart from the clamps.
+void Physics::Integrate(size_t begin, size_t end, Seconds dt) {
+  const size_t n = end - begin;
+  vec2d* vel = &velocities_[begin];
+  MultiplyAdd(vel, &accels_[begin], dt, vel, n);
+  const vec2d* drag = &drags_[begin];
+  const vec2d* max_speed = &max_speeds_[begin];
+  for (size_t i = 0; i < n; ++i) {
+    double x = vel[i].x / (1 + drag[i].x * dt);
+    double y = vel[i].y / (1 + drag[i].y * dt);
+    vel[i] = {max(min(x, max_speed[i].x), -max_speed[i].x),
+              max(min(y, max_speed[i].y), -max_speed[i].y)};
+  }
+  MultiplyAdd(&positions_[begin], vel, dt, &positions_[begin], n);
+}
+
+bool Physics::AtRest(const Body& body) const {
+  return abs(body.bbox.lowerLeft.x - body.last_pos.x) < sleep_distance_ &&
+         abs(body.bbox.lowerLeft.y - body.last_pos.y) < sleep_distance_ &&
+         abs(body.vel.x) < sleep_speed_ && abs(body.vel.y) < sleep_speed_;
+}
+
+uint64_t Physics::CellKey(int cell_x, int cell_y) const {
+  return ((uint64_t)(uint32_t)cell_x << 32) | (uint32_t)cell_y;
+}
+
+void Physics::AddCells(int body, vector<CellEntry>* cells) const {
+  const Body* b = bodies_[body];
+  // Bodies that can't collide with anything never enter the broadphase.
+  if (b->layer == 0 || b->mask == 0) {
+    return;
+  }
+  const Rect& bbox = b->bbox;
+  int x0 = floor(bbox.lowerLeft.x / cell_size_);
+  int x1 = floor((bbox.lowerLeft.x + bbox.w) / cell_size_);
+  int y0 = floor(bbox.lowerLeft.y / cell_size_);
+  int y1 = floor((bbox.lowerLeft.y + bbox.h) / cell_size_);
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      cells->push_back({CellKey(x, y), body, b->layer, b->mask});
+    }
+  }
+}
+
+namespace {
+bool CellEntryLess(uint64_t cell, int body, uint64_t other_cell,
+                   int other_body) {
+  return cell < other_cell || (cell == other_cell && body < other_body);
+}
+}  // namespace
+
+// Bins every enabled body into each grid cell its bbox touches, then sorts so
+// that the bodies sharing a cell are contiguous. Sleeping bodies go into their
+// own list, which is only rebuilt when the set of sleepers changes. Bodies
+// AddCells leaves out are listed in unbinned_ along with the disabled ones.
+void Physics::BuildBroadphase() {
+  cells_.clear();
+  cell_runs_.clear();
+  sleepers_.clear();
+  unbinned_.clear();
+  for (size_t i = 0; i < bodies_.size(); ++i) {
+    const Body* body = bodies_[i];
+    if (!body->enabled || body->layer == 0 || body->mask == 0) {
+      unbinned_.push_back(i);
+    }
+    if (!body->enabled) {
+      continue;
+    }
+    if (body->sleeping) {
+      sleepers_.push_back({body, (int)i, body->layer, body->mask});
+    } else {
+      AddCells(i, &cells_);
+    }
+  }
+
+  auto less = [](const CellEntry& a, const CellEntry& b) {
+    return CellEntryLess(a.cell, a.body, b.cell, b.body);
+  };
+  sort(cells_.begin(), cells_.end(), less);
+  for (size_t i = 0; i < cells_.size(); ++i) {
+    if (i == 0 || cells_[i].cell != cells_[i - 1].cell) {
+      cell_runs_.push_back(i);
+    }
+  }
+
+  if (sleepers_ != last_sleepers_) {
+    sleeping_cells_.clear();
+    for (size_t i = 0; i < bodies_.size(); ++i) {
+      if (bodies_[i]->enabled && bodies_[i]->sleeping) {
+        AddCells(i, &sleeping_cells_);
+      }
+    }
+    sort(sleeping_cells_.begin(), sleeping_cells_.end(), less);
+    last_sleepers_.swap(sleepers_);
+  }
+}
+
+// A pair that spans several cells is only reported by the cell holding the
+// lower left corner of their overlap, so no pair is reported twice.
+void Physics::CollidePair(const CellEntry& a, const CellEntry& b,
+                          vector<Contact>* contacts) const {
+  if (!(a.layer & b.mask) || !(b.layer & a.mask)) {
+    return;
+  }
+  const uint64_t cell = a.cell;
+  int i = a.body;
+  int j = b.body;
+  if (j < i) {
+    swap(i, j);
+  }
+  const Rect& first = bodies_[i]->bbox;
+  const Rect& second = bodies_[j]->bbox;
+  int owner_x = floor(max(first.lowerLeft.x, second.lowerLeft.x) / cell_size_);
+  int owner_y = floor(max(first.lowerLeft.y, second.lowerLeft.y) / cell_size_);
+  vec2d fix;
+  if (CellKey(owner_x, owner_y) == cell &&
+      RectRectCollision(first, second, &fix)) {
+    contacts->push_back({i, j, {0, 0}, fix});
+  }
+}
+
+// Tests every pair of awake bodies in cells_[run_begin, run_end), and each of
+// them against the sleeping bodies in the same cell.
+void Physics::CollideCell(size_t run_begin, size_t run_end,
+                          vector<Contact>* contacts) const {
+  const uint64_t cell = cells_[run_begin].cell;
+  auto sleeping = lower_bound(
+      sleeping_cells_.begin(), sleeping_cells_.end(), cell,
+      [](const CellEntry& entry, uint64_t cell) { return entry.cell < cell; });
+  for (size_t a = run_begin; a < run_end; ++a) {
+    for (size_t b = a + 1; b < run_end; ++b) {
+      CollidePair(cells_[a], cells_[b], contacts);
+    }
+    for (auto s = sleeping; s != sleeping_cells_.end() && s->cell == cell;
+         ++s) {
+      CollidePair(cells_[a], *s, contacts);
+    }
+  }
+}
+
+// Whether a contact that was not found this Update should stay cached
+// because nothing could have moved it.
+bool Physics::KeepAsleep(const Contact& contact) const {
+  if (contact.first >= (int)bodies_.size() ||
+      contact.second >= (int)bodies_.size()) {
+    return false;
+  }
+  const Body* first = bodies_[contact.first];
+  if (!first->enabled || !first->sleeping) {
+    return false;
+  }
+  if (contact.second == MAP_BODY_ID) {
+    return true;
+  }
+  const Body* second = bodies_[contact.second];
+  return second->enabled && second->sleeping;
+}
+
+void Physics::AddEvent(const Contact& contact, ContactPhase phase,
+                       vector<std::unique_ptr<Event>>* events) const {
+  std::unique_ptr<CollisionEvent> collision(new CollisionEvent());
+  collision->first = contact.first;
+  collision->second = contact.second;
+  collision->fix = phase == ContactPhase::END ? vec2d{0, 0} : contact.fix;
+  collision->phase = phase;
+  collision->tile = contact.tile;
+  events->push_back(std::move(collision));
+}
+
+CollisionLayers::CollisionLayers() {
+  names_.push_back("default");
+  masks_.push_back(~0u);
+}
+
+CollisionLayers CollisionLayers::FromMap(const Map& map) {
+  std::string layer_list = map.GetProperty("collision_layers");
+  if (layer_list.empty()) {
+    return CollisionLayers();
+  }
+
+  CollisionLayers layers;
+  layers.names_.clear();
+  layers.masks_.clear();
+  std::stringstream names(layer_list);
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    if (!layers.AddLayer(name)) {
+      std::cout << "Too many collision layers, ignoring \"" << name << "\"."
+                << std::endl;
+    }
+  }
+  for (size_t i = 0; i < layers.names_.size(); ++i) {
+    std::stringstream others(map.GetProperty("collides." + layers.names_[i]));
+    std::string other;
+    while (std::getline(others, other, ',')) {
+      if (!layers.SetCollides(layers.names_[i], other)) {
+        std::cout << "Unknown collision layer \"" << other << "\"."
+                  << std::endl;
+      }
+    }
+  }
+  return layers;
+}
+
+bool CollisionLayers::AddLayer(const std::string& name) {
+  if (names_.size() >= 32) {
+    return false;
+  }
+  names_.push_back(name);
+  masks_.push_back(~0u);
+  return true;
+}
+
+bool CollisionLayers::SetCollides(const std::string& first,
+                                  const std::string& second) {
+  int a = Find(first);
+  int b = Find(second);
+  if (a < 0 || b < 0) {
+    return false;
+  }
+  restricted_ |= 1u << a;
+  pairs_.push_back({a, b});
+
+  for (size_t layer = 0; layer < masks_.size(); ++layer) {
+    masks_[layer] = (restricted_ & (1u << layer)) ? 0 : ~0u;
+  }
+  for (const auto& pair : pairs_) {
+    masks_[pair.first] |= 1u << pair.second;
+    masks_[pair.second] |= 1u << pair.first;
+  }
+  return true;
+}
+
+uint32_t CollisionLayers::Layer(const std::string& name) const {
+  int layer = Find(name);
+  return layer < 0 ? 0 : 1u << layer;
+}
+
+uint32_t CollisionLayers::Mask(const std::string& name) const {
+  int layer = Find(name);
+  return layer < 0 ? 0 : masks_[layer];
+}
+
+void CollisionLayers::Assign(const std::string& name, Body* body) const {
+  int layer = Find(name);
+  if (layer >= 0) {
+    body->layer = 1u << layer;
+    body->mask = masks_[layer];
+  }
+}
+
+int CollisionLayers::Find(const std::string& name) const {
+  for (size_t i = 0; i < names_.size(); ++i) {
+    if (names_[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool Physics::ContactLess(const Contact& a, const Contact& b) {
+  if (a.first != b.first) return a.first < b.first;
+  if (a.second != b.second) return a.second < b.second;
+  if (a.tile.x != b.tile.x) return a.tile.x < b.tile.x;
+  return a.tile.y < b.tile.y;
+}
+
+int Physics::FindIsland(int body) {
+  while (islands_[body] != body) {
+    islands_[body] = islands_[islands_[body]];
+    body = islands_[body];
+  }
+  return body;
+}
+
+// Groups touching bodies into islands. An island falls asleep once all of its
+// bodies have been at rest for sleep_ticks_, and wakes up as soon as any of its
+// bodies moves.
+void Physics::UpdateSleep() {
+  if (sleep_ticks_ <= 0) {
+    return;
+  }
+  const size_t n = bodies_.size();
+  islands_.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    islands_[i] = i;
+  }
+  for (const Contact& contact : contacts_) {
+    if (contact.second != MAP_BODY_ID) {
+      islands_[FindIsland(contact.first)] = FindIsland(contact.second);
+    }
+  }
+
+  island_moving_.assign(n, false);
+  island_resting_.assign(n, true);
+  for (size_t i = 0; i < n; ++i) {
+    const Body* body = bodies_[i];
+    if (body->enabled && !body->sleeping) {
+      int island = FindIsland(i);
+      if (body->rest_ticks == 0) {
+        island_moving_[island] = true;
+      }
+      if (body->rest_ticks < sleep_ticks_) {
+        island_resting_[island] = false;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    Body* body = bodies_[i];
+    if (!body->enabled) {
+      continue;
+    }
+    int island = FindIsland(i);
+    if (body->sleeping) {
+      if (island_moving_[island]) {
+        body->Wake();
+      }
+    } else if (island_resting_[island]) {
+      body->sleeping = true;
+      body->vel = {0, 0};
+    }
+  }
+}
+
 vector<std::unique_ptr<Event>> Physics::Update(Seconds dt,
                                                const vector<Entity>& entities) {
   assert(tile_map_);
-  vector<std::unique_ptr<Event>> collisions;
+  // Bodies are integrated in batches of this many per task.
+  const size_t kBodyGrain = 256;
+  // Broadphase cells are collided in batches of this many per task.
+  const size_t kCellGrain = 64;
 
+  bodies_.resize(entities.size());
   for (size_t i = 0; i < entities.size(); ++i) {
-    auto* body = entities[i].GetComponent<Body>();
-    assert(body);
-    if (body->enabled) {
+    bodies_[i] = entities[i].GetComponent<Body>();
+    assert(bodies_[i]);
+  }
+
+  const int num_threads = worker_pool_ ? worker_pool_->size() : 1;
+  thread_contacts_.resize(num_threads);
+  for (auto& contacts : thread_contacts_) {
+    contacts.clear();
+  }
+
+  map_fixes_.assign(bodies_.size(), {0, 0});
+  moving_.resize(bodies_.size());
+  positions_.resize(bodies_.size());
+  velocities_.resize(bodies_.size());
+  accels_.resize(bodies_.size());
+  drags_.resize(bodies_.size());
+  max_speeds_.resize(bodies_.size());
+
+  // Integration and tile map collision only touch their own body. Each batch
+  // is gathered into the motion arrays, integrated there and written back.
+  ParallelFor(bodies_.size(), kBodyGrain,
+              [this, dt](size_t begin, size_t end, int thread) {
+    GatherMotion(begin, end);
+    Integrate(begin, end, dt);
+    for (size_t i = begin; i < end; ++i) {
+      Body* body = bodies_[i];
+      if (!body->enabled) {
+        body->contacts = 0;
+        continue;
+      }
+      if (!moving_[i]) {
+        continue;
+      }
+      body->rest_ticks = AtRest(*body) ? body->rest_ticks + 1 : 0;
+      body->vel = velocities_[i];
       body->last_pos = body->bbox.lowerLeft;
-      body->bbox.lowerLeft += body->vel * dt;
+      body->bbox.lowerLeft = positions_[i];
       // tilemap collision
-      vec2f fix{0, 0};
-      if (RectMapCollision(body->bbox, body->last_pos, &fix)) {
-        std::unique_ptr<CollisionEvent> collision(new CollisionEvent());
-        collision->first = i;
-        collision->second = MAP_BODY_ID;
-        collision->fix = fix;
-        collisions.push_back(std::move(collision));
-      }
-
-      // rect rect collisions
-      vec2f rect_fix{0, 0};
-      auto collide_to = body;
-      collide_to++;
-      for (size_t target_i = i + 1; target_i < entities.size(); ++target_i) {
-        auto* target_body = entities[target_i].GetComponent<Body>();
-        assert(target_body);
-        if (target_body->enabled &&
-            RectRectCollision(body->bbox, target_body->bbox, &rect_fix)) {
-          std::unique_ptr<CollisionEvent> collision(new CollisionEvent());
-          collision->first = i;
-          collision->second = target_i;
-          collision->fix = rect_fix;
-          collisions.push_back(std::move(collision));
+      vec2d fix{0, 0};
+      TilePos x_tile, y_tile;
+      if (RectMapCollision(body->bbox, body->last_pos, &fix, &x_tile,
+                           &y_tile)) {
+        vector<Contact>& contacts = thread_contacts_[thread];
+        if (fix.x != 0 && fix.y != 0 &&
+            (x_tile.x != y_tile.x || x_tile.y != y_tile.y)) {
+          // Against a wall and on the floor at once: a contact for each, so
+          // both get their BEGIN and END.
+          contacts.push_back({(int)i, MAP_BODY_ID, x_tile, {fix.x, 0}});
+          contacts.push_back({(int)i, MAP_BODY_ID, y_tile, {0, fix.y}});
+        } else {
+          contacts.push_back(
+              {(int)i, MAP_BODY_ID, fix.y != 0 ? y_tile : x_tile, fix});
         }
+        map_fixes_[i] += fix;
+      }
+    }
+  });
+
+  // Resolve map collisions, so bodies are back out of the map before they're
+  // collided with each other.
+  ParallelFor(bodies_.size(), kBodyGrain,
+              [this](size_t begin, size_t end, int) {
+    for (size_t i = begin; i < end; ++i) {
+      Body* body = bodies_[i];
+      if (!body->enabled || body->sleeping) {
+        continue;
+      }
+      const vec2d& fix = map_fixes_[i];
+      uint8_t contacts = 0;
+      if (fix.x != 0) {
+        body->vel.x = 0;
+        contacts |= CONTACT_WALL;
+      }
+      if (fix.y != 0) {
+        body->vel.y = 0;
+        contacts |= fix.y > 0 ? CONTACT_GROUND : CONTACT_CEILING;
+      }
+      body->bbox.lowerLeft += fix;
+      body->contacts = contacts;
+    }
+  });
+
+  // rect rect collisions
+  BuildBroadphase();
+  ParallelFor(cell_runs_.size(), kCellGrain,
+              [this](size_t begin, size_t end, int thread) {
+    for (size_t run = begin; run < end; ++run) {
+      size_t run_end =
+          run + 1 < cell_runs_.size() ? cell_runs_[run + 1] : cells_.size();
+      CollideCell(cell_runs_[run], run_end, &thread_contacts_[thread]);
+    }
+  });
+
+  // Merge into a canonical order: by first body, with its map collisions ahead
+  // of its body collisions. This makes the result independent of how the work
+  // was split between threads.
+  contacts_.clear();
+  for (const auto& contacts : thread_contacts_) {
+    contacts_.insert(contacts_.end(), contacts.begin(), contacts.end());
+  }
+  sort(contacts_.begin(), contacts_.end(), ContactLess);
+
+  UpdateSleep();
+
+  // Diff against last Update's contacts to find the ones that began, persisted
+  // and ended.
+  vector<std::unique_ptr<Event>> collisions;
+  vector<Contact> next_contacts;
+  next_contacts.reserve(contacts_.size());
+  auto last = last_contacts_.begin();
+  auto current = contacts_.begin();
+  while (last != last_contacts_.end() || current != contacts_.end()) {
+    if (current == contacts_.end() ||
+        (last != last_contacts_.end() && ContactLess(*last, *current))) {
+      if (KeepAsleep(*last)) {
+        next_contacts.push_back(*last);
+      } else if (last->first < (int)bodies_.size() &&
+                 last->second < (int)bodies_.size()) {
+        AddEvent(*last, ContactPhase::END, &collisions);
+      }
+      ++last;
+    } else if (last == last_contacts_.end() ||
+               ContactLess(*current, *last)) {
+      AddEvent(*current, ContactPhase::BEGIN, &collisions);
+      next_contacts.push_back(*current);
+      ++current;
+    } else {
+      if (report_persisting_) {
+        AddEvent(*current, ContactPhase::PERSIST, &collisions);
       }
+      next_contacts.push_back(*current);
+      ++last;
+      ++current;
     }
   }
+  last_contacts_.swap(next_contacts);
 
   return collisions;
 }
+
+bool Physics::Queryable(int body, const QueryFilter& filter) const {
+  return body != filter.ignore && body < (int)bodies_.size() &&
+         bodies_[body]->enabled && (bodies_[body]->layer & filter.mask);
+}
+
+template <typename Fn>
+void Physics::ForEachInCell(int cell_x, int cell_y, const Fn& fn) const {
+  const uint64_t cell = CellKey(cell_x, cell_y);
+  auto less = [](const CellEntry& entry, uint64_t cell) {
+    return entry.cell < cell;
+  };
+  for (auto entry = lower_bound(cells_.begin(), cells_.end(), cell, less);
+       entry != cells_.end() && entry->cell == cell; ++entry) {
+    fn(entry->body);
+  }
+  for (auto entry = lower_bound(sleeping_cells_.begin(), sleeping_cells_.end(),
+                                cell, less);
+       entry != sleeping_cells_.end() && entry->cell == cell; ++entry) {
+    fn(entry->body);
+  }
+}
+
+template <typename Fn>
+void Physics::ForEachInRect(const Rect& rect, const Fn& fn) const {
+  int x0 = floor(rect.lowerLeft.x / cell_size_);
+  int x1 = floor((rect.lowerLeft.x + rect.w) / cell_size_);
+  int y0 = floor(rect.lowerLeft.y / cell_size_);
+  int y1 = floor((rect.lowerLeft.y + rect.h) / cell_size_);
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      ForEachInCell(x, y, fn);
+    }
+  }
+}
+
+// Stops at the first solid block or at the first point below a slope.
+bool Physics::RaycastTiles(const Ray& ray, RaycastHit* hit) const {
+  WalkTiles(ray, [this, &ray, hit](TilePos tile, double t_enter, double t_exit,
+                                   const vec2d& normal) {
+    TileType tile_type = tile_map_->At(tile.x, tile.y);
+    double t;
+    vec2d hit_normal;
+    bool solid = false;
+    if (tile_type == TILE_BLOCK) {
+      solid = true;
+      t = t_enter;
+      hit_normal = normal;
+    } else if (IsSlope(tile_type)) {
+      solid = RaySlope(ray, tile, tile_type, t_enter, t_exit, normal, &t,
+                       &hit_normal);
+    }
+    if (solid) {
+      hit->hit = true;
+      hit->body = MAP_BODY_ID;
+      hit->tile = tile;
+      hit->fraction = t;
+      hit->point = ray.origin + ray.delta * t;
+      hit->normal = hit_normal;
+    }
+    return solid;
+  });
+  return hit->hit;
+}
+
+// Walks the broadphase cells along @ray, testing the bodies in each, until a
+// hit is closer than the next cell.
+bool Physics::RaycastBodies(const Ray& ray, const QueryFilter& filter,
+                            RaycastHit* hit) const {
+  const double max_fraction = hit->hit ? hit->fraction : 1;
+  int cell_x = floor(ray.origin.x / cell_size_);
+  int cell_y = floor(ray.origin.y / cell_size_);
+  const int step_x = ray.delta.x > 0 ? 1 : -1;
+  const int step_y = ray.delta.y > 0 ? 1 : -1;
+  const double t_delta_x =
+      ray.delta.x != 0 ? abs(cell_size_ / ray.delta.x) : INFINITY;
+  const double t_delta_y =
+      ray.delta.y != 0 ? abs(cell_size_ / ray.delta.y) : INFINITY;
+  double t_max_x =
+      ray.delta.x > 0
+          ? ((cell_x + 1) * cell_size_ - ray.origin.x) / ray.delta.x
+      : ray.delta.x < 0 ? (ray.origin.x - cell_x * cell_size_) / -ray.delta.x
+                        : INFINITY;
+  double t_max_y =
+      ray.delta.y > 0
+          ? ((cell_y + 1) * cell_size_ - ray.origin.y) / ray.delta.y
+      : ray.delta.y < 0 ? (ray.origin.y - cell_y * cell_size_) / -ray.delta.y
+                        : INFINITY;
+
+  RaycastHit best;
+  best.fraction = max_fraction;
+  double t_enter = 0;
+  while (t_enter < best.fraction) {
+    ForEachInCell(cell_x, cell_y, [&](int body) {
+      if (!Queryable(body, filter)) {
+        return;
+      }
+      double t0, t1;
+      vec2d normal;
+      if (ClipRay(ray, bodies_[body]->bbox, &t0, &t1, &normal) &&
+          (t0 < best.fraction ||
+           (t0 == best.fraction && best.hit && body < best.body))) {
+        best.hit = true;
+        best.body = body;
+        best.fraction = t0;
+        best.normal = normal;
+      }
+    });
+    if (min(t_max_x, t_max_y) >= 1) {
+      break;
+    }
+    if (t_max_x < t_max_y) {
+      cell_x += step_x;
+      t_enter = t_max_x;
+      t_max_x += t_delta_x;
+    } else {
+      cell_y += step_y;
+      t_enter = t_max_y;
+      t_max_y += t_delta_y;
+    }
+  }
+
+  if (!best.hit) {
+    return false;
+  }
+  best.point = ray.origin + ray.delta * best.fraction;
+  *hit = best;
+  return true;
+}
+
+bool Physics::Raycast(const Ray& ray, const QueryFilter& filter,
+                      RaycastHit* hit) const {
+  *hit = RaycastHit();
+  if (filter.tiles) {
+    RaycastTiles(ray, hit);
+  }
+  if (filter.bodies) {
+    RaycastBodies(ray, filter, hit);
+  }
+  return hit->hit;
+}
+
+void Physics::RaycastBatch(const vector<Ray>& rays, const QueryFilter& filter,
+                           vector<RaycastHit>* hits) const {
+  // Rays are cast in batches of this many per task.
+  const size_t kRayGrain = 64;
+  hits->resize(rays.size());
+  ParallelFor(rays.size(), kRayGrain,
+              [this, &rays, &filter, hits](size_t begin, size_t end, int) {
+    for (size_t i = begin; i < end; ++i) {
+      Raycast(rays[i], filter, &(*hits)[i]);
+    }
+  });
+}
+
+bool Physics::OverlapTiles(const Rect& rect) const {
+  const double right = rect.lowerLeft.x + rect.w;
+  const double top = rect.lowerLeft.y + rect.h;
+  // Same edge handling as PointMap: a rect ending exactly on a tile boundary
+  // does not reach into the next tile.
+  int x0 = floor(rect.lowerLeft.x);
+  int x1 = ceil(right) - 1;
+  int y0 = floor(rect.lowerLeft.y);
+  int y1 = ceil(top) - 1;
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      TileType tile_type = tile_map_->At(x, y);
+      if (tile_type == TILE_BLOCK) {
+        return true;
+      }
+      if (IsSlope(tile_type)) {
+        // Heights are linear in x, so the highest point under the rect is at
+        // one end of the overlap.
+        double u0 = max(rect.lowerLeft.x - x, 0.0);
+        double u1 = min(right - x, 1.0);
+        double height =
+            y + max(HeightAtX(u0, tile_type), HeightAtX(u1, tile_type));
+        if (rect.lowerLeft.y < height) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+bool Physics::Overlap(const Rect& rect, const QueryFilter& filter,
+                      vector<EntityId>* bodies) const {
+  bool overlaps = filter.tiles && OverlapTiles(rect);
+  if (filter.bodies) {
+    vector<EntityId> found;
+    ForEachInRect(rect, [&](int body) {
+      vec2d fix;
+      if (Queryable(body, filter) &&
+          RectRectCollision(rect, bodies_[body]->bbox, &fix)) {
+        found.push_back(body);
+      }
+    });
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+    overlaps = overlaps || !found.empty();
+    if (bodies) {
+      bodies->insert(bodies->end(), found.begin(), found.end());
+    }
+  }
+  return overlaps;
+}
+
+void Physics::TilesChanged(const TileRect& tiles) {
+  // A tile border away, so bodies resting on or against them wake too.
+  Rect rect = {{tiles.x - 1.0, tiles.y - 1.0}, tiles.w + 2.0, tiles.h + 2.0};
+  ForEachInRect(rect, [&](int body) {
+    vec2d fix;
+    if (body < (int)bodies_.size() && bodies_[body]->sleeping &&
+        RectRectCollision(rect, bodies_[body]->bbox, &fix)) {
+      bodies_[body]->Wake();
+    }
+  });
+}
+
+// Sweeps are rays from the rect's lower left against everything grown by the
+// rect's size (the Minkowski sum), except slopes, which are hit by a ray from
+// the rect's bottom center. Tiles are found by walking the lower left's ray
+// like RaycastTiles: while it is in a tile, the rect can only touch the tiles
+// from there up to its size further up and right, and every hit found there
+// happens before the ray leaves the tile.
+bool Physics::Sweep(const Rect& rect, const vec2d& delta,
+                    const QueryFilter& filter, RaycastHit* hit) const {
+  *hit = RaycastHit();
+  const Ray ray = {rect.lowerLeft, delta};
+  const Ray center_ray = {rect.lowerLeft + vec2d{rect.w / 2, 0}, delta};
+  Rect bounds = rect;
+  bounds.lowerLeft.x += min(delta.x, 0.0);
+  bounds.lowerLeft.y += min(delta.y, 0.0);
+  bounds.w += abs(delta.x);
+  bounds.h += abs(delta.y);
+
+  auto consider = [hit](EntityId body, TilePos tile, double t,
+                        const vec2d& normal) {
+    if (!hit->hit || t < hit->fraction) {
+      hit->hit = true;
+      hit->body = body;
+      hit->tile = tile;
+      hit->fraction = t;
+      hit->normal = normal;
+    }
+  };
+
+  if (filter.tiles) {
+    // Tiles past the rect's size, in whole tiles.
+    const int span_x = ceil(rect.w);
+    const int span_y = ceil(rect.h);
+    WalkTiles(ray, [&](TilePos cell, double, double t_exit, const vec2d&) {
+      for (int y = cell.y; y <= cell.y + span_y; ++y) {
+        for (int x = cell.x; x <= cell.x + span_x; ++x) {
+          TileType tile_type = tile_map_->At(x, y);
+          double t0, t1;
+          vec2d normal;
+          if (tile_type == TILE_BLOCK) {
+            Rect grown = {{x - rect.w, y - rect.h}, 1 + rect.w, 1 + rect.h};
+            if (ClipRay(ray, grown, &t0, &t1, &normal)) {
+              consider(MAP_BODY_ID, {x, y}, t0, normal);
+            }
+          } else if (IsSlope(tile_type)) {
+            Rect tile_rect = {{(double)x, (double)y}, 1, 1};
+            double t;
+            if (ClipRay(center_ray, tile_rect, &t0, &t1, &normal) &&
+                RaySlope(center_ray, {x, y}, tile_type, t0, t1, normal, &t,
+                         &normal)) {
+              consider(MAP_BODY_ID, {x, y}, t, normal);
+            }
+          }
+        }
+      }
+      // Tiles further along can only be hit later.
+      return hit->hit && hit->fraction <= t_exit;
+    });
+  }
+
+  if (filter.bodies) {
+    ForEachInRect(bounds, [&](int body) {
+      if (!Queryable(body, filter)) {
+        return;
+      }
+      const Rect& bbox = bodies_[body]->bbox;
+      Rect grown = {bbox.lowerLeft - vec2d{rect.w, rect.h}, bbox.w + rect.w,
+                    bbox.h + rect.h};
+      double t0, t1;
+      vec2d normal;
+      if (ClipRay(ray, grown, &t0, &t1, &normal)) {
+        consider(body, {0, 0}, t0, normal);
+      }
+    });
+  }
+
+  if (hit->hit) {
+    hit->point = rect.lowerLeft + delta * hit->fraction;
+  }
+  return hit->hit;
+}
@@ -3,6 +3,10 @@
 #ifndef PHYSICS_H
 #define PHYSICS_H
 
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "Entity.h"
@@ -10,35 +14,152 @@
 #include "Geometry.h"
 #include "TileMap.h"
 #include "System.h"
+#include "WorkerPool.h"
 
 using namespace std;
 
 const EntityId MAP_BODY_ID = -1;
 
+// Bits of Body::contacts.
+enum ContactFlag {
+  // Pushed up out of the map, i.e. standing on it.
+  CONTACT_GROUND = 1,
+  // Pushed down out of the map.
+  CONTACT_CEILING = 2,
+  // Pushed sideways out of the map.
+  CONTACT_WALL = 4,
+};
+
 class Body : public Component {
  public:
   Body() {}
-  Body(bool enabled, Rect bbox, vec2f vel)
+  Body(bool enabled, Rect bbox, vec2d vel)
       : enabled(enabled), bbox(bbox), vel(vel), last_pos(bbox.lowerLeft) {}
 
   bool enabled = false;
   Rect bbox = {{0,0},0,0};
-  vec2f vel = {0,0};
-  vec2f last_pos = {0,0};
+  vec2d vel = {0,0};
+  vec2d last_pos = {0,0};
+  // Physics applies these to vel every Update, before moving the body:
+  // gravity times gravity_scale plus accel, then drag (per axis, in 1/s, so
+  // vel decays like dv/dt = -drag * vel), then clamps each axis to
+  // max_speed. State machines steer bodies by setting these rather than vel.
+  double gravity_scale = 1;
+  vec2d accel = {0, 0};
+  vec2d drag = {0, 0};
+  vec2d max_speed = {INFINITY, INFINITY};
+  // Bodies that stay at rest for a while are put to sleep and skipped by
+  // Physics. Setting a non-zero vel or accel wakes a body up on the next
+  // Update, as does being touched by an awake body. Call Wake() after moving
+  // a sleeping body by hand.
+  bool sleeping = false;
+  // Consecutive Updates this body has spent at rest.
+  int rest_ticks = 0;
+  // Collision layer bits this body is on, and the layers it collides with.
+  // Two bodies are only tested against each other if each one's layer is in
+  // the other's mask. See CollisionLayers.
+  uint32_t layer = 1;
+  uint32_t mask = ~0u;
+  // ContactFlags for how Physics pushed this body out of the map on the last
+  // Update. Kept as is while the body sleeps.
+  uint8_t contacts = 0;
+
+  void Wake() {
+    sleeping = false;
+    rest_ticks = 0;
+  }
 
   ComponentType type() const override { return ComponentType::BODY; }
 
   ~Body() override {}
 };
 
+// Where a contact is in its lifetime. BEGIN is sent on the first Update two
+// things touch, PERSIST on every following Update they still touch (if
+// enabled), and END on the first Update they no longer do.
+enum class ContactPhase { BEGIN, PERSIST, END };
+
 class CollisionEvent : public Event {
  public:
   EventType type() const override { return EventType::COLLISION; }
   EntityId first;
   EntityId second;
-  vec2f fix;
+  vec2d fix;
+  ContactPhase phase = ContactPhase::BEGIN;
+  // The tile touched, for map collisions.
+  TilePos tile = {0, 0};
+};
+
+// Returned by Physics::Raycast and Physics::Sweep when something is hit.
+struct RaycastHit {
+  // The body hit, or MAP_BODY_ID for a tile.
+  EntityId body = MAP_BODY_ID;
+  // The tile hit, if body is MAP_BODY_ID.
+  TilePos tile = {0, 0};
+  // How far along the cast the hit is, from 0 (start) to 1 (end).
+  double fraction = 1;
+  // Where the ray (or the swept rect's lower left) stops.
+  vec2d point = {0, 0};
+  // Surface normal at the hit. Zero if the cast started inside something.
+  vec2d normal = {0, 0};
+  bool hit = false;
+};
+
+// A line segment from origin to origin + delta.
+struct Ray {
+  vec2d origin;
+  vec2d delta;
+};
+
+// What a Physics query should look at.
+struct QueryFilter {
+  bool tiles = true;
+  bool bodies = true;
+  // A body to skip, e.g. the one doing the looking. MAP_BODY_ID skips nothing.
+  EntityId ignore = MAP_BODY_ID;
+  // Only bodies on one of these layers are considered.
+  uint32_t mask = ~0u;
+};
+
+// Named collision layers, and which of them collide. A level sets these up
+// with map properties:
+//   collision_layers = "player,enemy,projectile"
+//   collides.projectile = "enemy"
+// A layer without a collides.* property collides with every layer. Listing a
+// pair under either layer makes it collide both ways.
+class CollisionLayers {
+ public:
+  // A single "default" layer that collides with everything.
+  CollisionLayers();
+  static CollisionLayers FromMap(const Map& map);
+
+  // Returns false if all 32 layers are taken.
+  bool AddLayer(const std::string& name);
+  // Makes @first and @second collide, and restricts @first to only the
+  // layers it has been paired with. Returns false if either is unknown.
+  bool SetCollides(const std::string& first, const std::string& second);
+
+  // Layer bit and mask of a named layer, 0 if unknown.
+  uint32_t Layer(const std::string& name) const;
+  uint32_t Mask(const std::string& name) const;
+  // Puts @body on the named layer. Does nothing if the layer is unknown.
+  void Assign(const std::string& name, Body* body) const;
+
+ private:
+  int Find(const std::string& name) const;
+
+  std::vector<std::string> names_;
+  std::vector<uint32_t> masks_;
+  // Layers whose mask has been narrowed by SetCollides, and every pair it was
+  // given.
+  uint32_t restricted_ = 0;
+  std::vector<std::pair<int, int>> pairs_;
 };
 
+// Moves bodies, pushes them back out of the map (zeroing their velocity
+// along the push and setting Body::contacts), and reports contacts as
+// CollisionEvents. Map contacts are already resolved by the time their events
+// go out; the fix they carry is informational.
 class Physics : public System {
  public:
   // tile_map must outlive this object.
@@ -46,12 +167,188 @@ class Physics : public System {
   vector<std::unique_ptr<Event>> Update(
       Seconds dt, const vector<Entity>& entities) override;
 
+  // Spreads Update across @pool, which must outlive this object (or be reset
+  // to nullptr). Events come out identical, in the same order, no matter how
+  // many threads are used.
+  void worker_pool(WorkerPool* pool) { worker_pool_ = pool; }
+  // Acceleration on every body, scaled by Body::gravity_scale.
+  vec2d gravity() const { return gravity_; }
+  void gravity(const vec2d& gravity) { gravity_ = gravity; }
+  // Edge length of a broadphase cell, in tiles. Should be a bit larger than
+  // a typical body.
+  double cell_size() const { return cell_size_; }
+  void cell_size(double cell_size) { cell_size_ = cell_size; }
+  // Number of Updates a body, and every body touching it, must stay at rest
+  // before they are put to sleep together. 0 turns sleeping off.
+  int sleep_ticks() const { return sleep_ticks_; }
+  void sleep_ticks(int sleep_ticks) { sleep_ticks_ = sleep_ticks; }
+  // A body is at rest if it moved less than sleep_distance tiles during the
+  // last Update and has a speed below sleep_speed tiles/s on each axis.
+  void sleep_distance(double sleep_distance) {
+    sleep_distance_ = sleep_distance;
+  }
+  void sleep_speed(double sleep_speed) { sleep_speed_ = sleep_speed; }
+  // Whether to send PERSIST events for contacts that were already touching
+  // last Update. BEGIN and END events are always sent. Off by default, since
+  // Body::contacts covers the usual need for them.
+  void report_persisting(bool report_persisting) {
+    report_persisting_ = report_persisting;
+  }
+
+  // Queries against the tile map and bodies. Bodies are found through the
+  // broadphase built by the last Update, so bodies are only seen once Update
+  // has run, and at most a collision fix away from where they were binned.
+  //
+  // Finds the first thing along @ray. Returns true and fills @hit if there is
+  // one.
+  bool Raycast(const Ray& ray, const QueryFilter& filter,
+               RaycastHit* hit) const;
+  // Casts each of @rays, split across the worker pool. @hits is resized to
+  // match @rays, with hit set on the ones that hit something. Called from
+  // inside another job on the pool, e.g. a task of Update, it casts them all
+  // on the calling thread.
+  void RaycastBatch(const vector<Ray>& rays, const QueryFilter& filter,
+                    vector<RaycastHit>* hits) const;
+  // Returns true if @rect overlaps anything. Overlapping bodies are appended
+  // to @bodies, if given, in ascending order.
+  bool Overlap(const Rect& rect, const QueryFilter& filter,
+               vector<EntityId>* bodies) const;
+  // Moves @rect along @delta and finds the first thing it would hit. Slopes are
+  // tested against the rect's bottom center, like in Update.
+  bool Sweep(const Rect& rect, const vec2d& delta, const QueryFilter& filter,
+             RaycastHit* hit) const;
+  // Size of the entity list given to the last Update. Queries know bodies by
+  // their index in it.
+  size_t num_bodies() const { return bodies_.size(); }
+  // Bodies the last Update left out of the broadphase, in ascending order:
+  // disabled ones and ones on no layer or colliding with none. Queries never
+  // find these.
+  const vector<EntityId>& unbinned() const { return unbinned_; }
+
+  // Tells Physics that @tiles of the map changed. Tiles are read straight
+  // from the map, so all this has to do is wake the sleeping bodies next to
+  // them, whose broadphase entries and map contacts would otherwise be kept
+  // as they were.
+  void TilesChanged(const TileRect& tiles);
+
  private:
-  bool RectRectCollision(const Rect& first, const Rect& second, vec2f* fix);
-  bool XCollision(const Rect& rect, double* x_fix);
-  bool YCollision(const Rect& rect, double* y_fix);
-  bool RectMapCollision(const Rect& rect, const vec2f& last_pos, vec2f* fix);
+  // Contacts are kept sorted by (first, second, tile), which is also the order
+  // their events are sent in.
+  struct Contact {
+    EntityId first;
+    EntityId second;
+    TilePos tile;
+    vec2d fix;
+  };
+  // One entry per (broadphase cell, body overlapping that cell). The body's
+  // layer and mask are copied in so that filtered pairs can be rejected
+  // without touching the Body.
+  struct CellEntry {
+    uint64_t cell;
+    int body;
+    uint32_t layer;
+    uint32_t mask;
+  };
+  // What sleeping_cells_ were built from. A sleeping body's entries depend
+  // on its index in the entity list and its layers as well as on the body.
+  struct Sleeper {
+    const Body* body;
+    int index;
+    uint32_t layer;
+    uint32_t mask;
+
+    bool operator==(const Sleeper& other) const {
+      return body == other.body && index == other.index &&
+             layer == other.layer && mask == other.mask;
+    }
+  };
+
+  static bool ContactLess(const Contact& a, const Contact& b);
+  bool RectRectCollision(const Rect& first, const Rect& second,
+                         vec2d* fix) const;
+  bool XCollision(const Rect& rect, double* x_fix, TilePos* tile) const;
+  bool YCollision(const Rect& rect, double* y_fix, TilePos* tile) const;
+  bool RectMapCollision(const Rect& rect, const vec2d& last_pos, vec2d* fix,
+                        TilePos* x_tile, TilePos* y_tile) const;
+
+  // Runs fn(begin, end, thread) over [0, n) on the worker pool if there is
+  // one, inline otherwise.
+  void ParallelFor(size_t n, size_t grain,
+                   const WorkerPool::RangeFn& fn) const;
+  // Copies the motion of bodies [begin, end) into the arrays below, waking
+  // the sleepers that were set moving.
+  void GatherMotion(size_t begin, size_t end);
+  // Applies gravity, accel, drag and max_speed to velocities_[begin, end),
+  // then moves positions_ along them.
+  void Integrate(size_t begin, size_t end, Seconds dt);
+  bool AtRest(const Body& body) const;
+  uint64_t CellKey(int cell_x, int cell_y) const;
+  void AddCells(int body, vector<CellEntry>* cells) const;
+  void BuildBroadphase();
+  void CollidePair(const CellEntry& a, const CellEntry& b,
+                   vector<Contact>* contacts) const;
+  void CollideCell(size_t run_begin, size_t run_end,
+                   vector<Contact>* contacts) const;
+  int FindIsland(int body);
+  void UpdateSleep();
+  bool KeepAsleep(const Contact& contact) const;
+  void AddEvent(const Contact& contact, ContactPhase phase,
+                vector<std::unique_ptr<Event>>* events) const;
+  bool RaycastTiles(const Ray& ray, RaycastHit* hit) const;
+  bool RaycastBodies(const Ray& ray, const QueryFilter& filter,
+                     RaycastHit* hit) const;
+  bool OverlapTiles(const Rect& rect) const;
+  // Calls fn(body) for every body binned into the given cell. A body spanning
+  // several cells is visited once per cell.
+  template <typename Fn>
+  void ForEachInCell(int cell_x, int cell_y, const Fn& fn) const;
+  template <typename Fn>
+  void ForEachInRect(const Rect& rect, const Fn& fn) const;
+  bool Queryable(int body, const QueryFilter& filter) const;
+
   const TileMap* tile_map_;
+  WorkerPool* worker_pool_ = nullptr;
+  vec2d gravity_ = {0, 0};
+  double cell_size_ = 4;
+  int sleep_ticks_ = 60;
+  double sleep_distance_ = 1e-3;
+  double sleep_speed_ = 1;
+  bool report_persisting_ = false;
+
+  // Scratch space reused across Updates.
+  vector<Body*> bodies_;
+  // Motion of each body, as structure of arrays so it is integrated in
+  // vectorized passes. Bodies that aren't moving this Update have moving_
+  // unset and are left still.
+  vector<uint8_t> moving_;
+  vector<vec2d> positions_;
+  vector<vec2d> velocities_;
+  // Gravity times gravity_scale, plus accel.
+  vector<vec2d> accels_;
+  vector<vec2d> drags_;
+  vector<vec2d> max_speeds_;
+  // Sum of each body's map fixes this Update, resolved in one pass.
+  vector<vec2d> map_fixes_;
+  // Broadphase entries of awake bodies, rebuilt every Update.
+  vector<CellEntry> cells_;
+  // Broadphase entries of sleeping bodies. These only change when a body
+  // falls asleep or wakes up, or when the entity list is reordered or a
+  // sleeper's layers change, so they are kept until sleepers_ changes.
+  vector<CellEntry> sleeping_cells_;
+  vector<Sleeper> sleepers_;
+  vector<Sleeper> last_sleepers_;
+  vector<EntityId> unbinned_;
+  // Union-find over touching bodies, and per-island flags.
+  vector<int> islands_;
+  vector<bool> island_moving_;
+  vector<bool> island_resting_;
+  // Index into cells_ of the first entry of each distinct cell.
+  vector<size_t> cell_runs_;
+  // Per-thread contact lists.
+  vector<vector<Contact>> thread_contacts_;
+  vector<Contact> contacts_;
+  // Every contact from the last Update, plus those of sleeping bodies.
+  vector<Contact> last_contacts_;
 };
 
 #endif
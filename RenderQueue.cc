@@ -0,0 +1,130 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+namespace {
+// Key fields, from the most significant: layer, program, texture on unit 0,
+// texture on unit 1, depth. Programs and textures only need to be told
+// apart, so truncating them only costs some sharing, never correctness.
+const int LAYER_SHIFT = 56;
+const int PROGRAM_SHIFT = 48;
+const int TEXTURE0_SHIFT = 32;
+const int TEXTURE1_SHIFT = 16;
+
+// The program and textures in use, to tell which changes a command needs.
+struct State {
+  const Program* program = nullptr;
+  TextureRef textures[2] = {};
+  bool bound[2] = {};
+
+  bool ChangeProgram(const Program* p) {
+    if (p == program) {
+      return false;
+    }
+    program = p;
+    return true;
+  }
+
+  bool ChangeTexture(int unit, TextureRef texture) {
+    if (bound[unit] && texture == textures[unit]) {
+      return false;
+    }
+    textures[unit] = texture;
+    bound[unit] = true;
+    return true;
+  }
+};
+}  // namespace
+
+RenderQueue::RenderQueue(TextureManager* texture_manager)
+    : texture_manager_(texture_manager) {
+  assert(texture_manager_);
+}
+
+void RenderQueue::Submit(RenderLayer layer, Program* program,
+                         TextureRef texture0, TextureRef texture1,
+                         function<void()> draw, uint16_t depth) {
+  // Textures on the same atlas page bind the same thing.
+  texture0 = texture_manager_->page(texture0);
+  texture1 = texture_manager_->page(texture1);
+  uint64_t key = (uint64_t)layer << LAYER_SHIFT |
+                 ProgramIndex(program) << PROGRAM_SHIFT |
+                 (uint64_t)(texture0 & 0xffff) << TEXTURE0_SHIFT |
+                 (uint64_t)(texture1 & 0xffff) << TEXTURE1_SHIFT | depth;
+  order_.push_back({key, (uint32_t)commands_.size()});
+  commands_.push_back({program, {texture0, texture1}, move(draw)});
+}
+
+void RenderQueue::Execute() {
+  stats_ = RenderStats();
+  stats_.commands = commands_.size();
+  if (commands_.empty()) {
+    return;
+  }
+  State unsorted;
+  for (const Command& command : commands_) {
+    stats_.unsorted_program_changes += unsorted.ChangeProgram(command.program);
+    for (int unit = 0; unit < 2; ++unit) {
+      stats_.unsorted_texture_binds +=
+          unsorted.ChangeTexture(unit, command.textures[unit]);
+    }
+  }
+
+  RadixSort();
+
+  State state;
+  for (const Sortable& s : order_) {
+    Command& command = commands_[s.command];
+    if (state.ChangeProgram(command.program)) {
+      command.program->Use();
+      ++stats_.program_changes;
+    }
+    for (int unit = 0; unit < 2; ++unit) {
+      if (state.ChangeTexture(unit, command.textures[unit])) {
+        texture_manager_->BindTexture(command.textures[unit], unit);
+        ++stats_.texture_binds;
+      }
+    }
+    command.draw();
+  }
+
+  commands_.clear();
+  order_.clear();
+}
+
+uint64_t RenderQueue::ProgramIndex(Program* program) {
+  auto found = find(programs_.begin(), programs_.end(), program);
+  if (found == programs_.end()) {
+    programs_.push_back(program);
+    found = programs_.end() - 1;
+  }
+  return (found - programs_.begin()) & 0xff;
+}
+
+void RenderQueue::RadixSort() {
+  sorted_.resize(order_.size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t counts[256] = {};
+    for (const Sortable& s : order_) {
+      ++counts[(s.key >> shift) & 0xff];
+    }
+    // Most fields are the same for every command, e.g. depth, so most
+    // passes would move nothing.
+    if (counts[(order_.front().key >> shift) & 0xff] == order_.size()) {
+      continue;
+    }
+    size_t offset = 0;
+    for (size_t& count : counts) {
+      size_t n = count;
+      count = offset;
+      offset += n;
+    }
+    for (const Sortable& s : order_) {
+      sorted_[counts[(s.key >> shift) & 0xff]++] = s;
+    }
+    order_.swap(sorted_);
+  }
+}
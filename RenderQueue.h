@@ -0,0 +1,87 @@
+// Orders a frame's draws to cut down on program and texture changes.
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "ShaderManager.h"
+#include "TextureManager.h"
+
+// Layers are drawn bottom to top in this order, whatever order their draws
+// were submitted in.
+enum class RenderLayer : uint8_t {
+  BACKGROUND,
+  TILES,
+  DEBUG_TILES,
+  DEBUG_SHAPES,
+  SPRITES,
+  TEXT,
+};
+
+// State changes made by the last Execute(), and how many there would have
+// been had commands run in the order they were submitted.
+struct RenderStats {
+  size_t commands = 0;
+  size_t program_changes = 0;
+  size_t texture_binds = 0;
+  size_t unsorted_program_changes = 0;
+  size_t unsorted_texture_binds = 0;
+};
+
+// Collects a frame's draws as commands, each a program, the textures for
+// units 0 and 1, and a function that sets uniforms and draws. Execute() sorts
+// them by a 64 bit key of layer, program, textures and depth, then runs them,
+// only changing the program or textures when the next command needs
+// different ones.
+//
+// Commands run after they're submitted, so whatever their functions refer to
+// must last until Execute().
+class RenderQueue {
+ public:
+  explicit RenderQueue(TextureManager* texture_manager);
+
+  // Queues @draw, to run with @program in use and @texture0 and @texture1
+  // bound to units 0 and 1. @depth orders commands in a layer that share a
+  // program and textures; otherwise commands with equal keys run in the
+  // order they were submitted.
+  void Submit(RenderLayer layer, Program* program, TextureRef texture0,
+              TextureRef texture1, std::function<void()> draw,
+              uint16_t depth = 0);
+  // Runs and clears the queue.
+  void Execute();
+
+  size_t size() const { return commands_.size(); }
+  const RenderStats& stats() const { return stats_; }
+
+ private:
+  struct Command {
+    Program* program;
+    TextureRef textures[2];
+    std::function<void()> draw;
+  };
+
+  // Orders commands for the key, keeping the order of equal keys.
+  struct Sortable {
+    uint64_t key;
+    uint32_t command;
+  };
+
+  // A small number for @program, for keys.
+  uint64_t ProgramIndex(Program* program);
+  // Sorts order_ by key, least significant byte first.
+  void RadixSort();
+
+  // Not owned.
+  TextureManager* texture_manager_;
+  std::vector<Program*> programs_;
+  std::vector<Command> commands_;
+  std::vector<Sortable> order_;
+  // Scratch space for RadixSort().
+  std::vector<Sortable> sorted_;
+  RenderStats stats_;
+};
+
+#endif  // RENDERQUEUE_H
@@ -0,0 +1,33 @@
+#include "RenderThread.h"
+
+#include <cassert>
+
+#include <SDL.h>
+
+#include "Display.h"
+
+using namespace std;
+
+RenderThread::RenderThread(Display* display,
+                           function<void(RenderSnapshot*)> render)
+    : display_(display), render_(move(render)) {
+  assert(display_);
+  assert(render_);
+  display_->ReleaseCurrent();
+  thread_ = std::thread(&RenderThread::Run, this);
+}
+
+RenderThread::~RenderThread() {
+  snapshots_.Stop();
+  thread_.join();
+  display_->MakeCurrent();
+}
+
+void RenderThread::Run() {
+  display_->MakeCurrent();
+  while (snapshots_.Acquire()) {
+    render_(&snapshots_.front());
+    display_->Swap();
+  }
+  display_->ReleaseCurrent();
+}
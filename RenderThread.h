@@ -0,0 +1,62 @@
+// Draws frames on a thread of its own, from snapshots the simulation hands
+// over, so the simulation never waits on the GPU or the swap.
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "Camera.h"
+#include "Geometry.h"
+#include "SpriteBatch.h"
+#include "TileMapWindow.h"
+#include "TripleBuffer.h"
+
+class Display;
+
+// Everything needed to draw a frame, copied out of the simulation, so drawing
+// it reads nothing the simulation goes on to change.
+struct RenderSnapshot {
+  Camera camera{{0, 0}, {1, 1}};
+  bool debug = false;
+  std::vector<SpriteInstance> sprites;
+  // Entity bounding boxes, in tiles, when debug is set.
+  std::vector<Rect> boxes;
+  // From TileMapWindow::TakeUploads(), to apply before drawing.
+  TileUploads tiles;
+  TileUploads collision;
+};
+
+// Owns the GL context while running. Everything GL, from programs and
+// textures to GLState, belongs to the render thread until it is destroyed;
+// the thread that made it may only fill in snapshot() and Publish() it.
+class RenderThread {
+ public:
+  // Takes @display's GL context off the calling thread and calls @render
+  // with each published snapshot, followed by a swap. @display must outlive
+  // this object.
+  RenderThread(Display* display,
+               std::function<void(RenderSnapshot*)> render);
+  // Finishes the frame being drawn and gives the GL context back to the
+  // calling thread.
+  ~RenderThread();
+
+  // The snapshot to fill in for the next frame. It holds an older frame, so
+  // set or clear all of it.
+  RenderSnapshot& snapshot() { return snapshots_.back(); }
+  // Hands snapshot() over to be drawn. Waits only if the render thread has
+  // yet to start on the last one.
+  void Publish() { snapshots_.Publish(); }
+
+ private:
+  void Run();
+
+  // Not owned.
+  Display* display_;
+  std::function<void(RenderSnapshot*)> render_;
+  TripleBuffer<RenderSnapshot> snapshots_;
+  std::thread thread_;
+};
+
+#endif  // RENDERTHREAD_H
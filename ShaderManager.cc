@@ -3,6 +3,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "GLState.h"
 #include "ShaderManager.h"
 
 using namespace std;
@@ -124,7 +125,7 @@ GLuint LoadProgram(char const *vertexShaderFile,
   return id;
 }
 
-void Program::Use() { glUseProgram(id); }
+void Program::Use() { GLState::UseProgram(id); }
 
 std::unique_ptr<TextureProgram> TextureProgram::Make() {
   std::unique_ptr<TextureProgram> program(new TextureProgram());
@@ -193,6 +194,25 @@ void MapProgram::Setup() {
   glUniform2f(offset_uniform_, map_offset_.x, map_offset_.y);
 }
 
+std::unique_ptr<SpriteProgram> SpriteProgram::Make() {
+  std::unique_ptr<SpriteProgram> program(new SpriteProgram());
+  program->id = LoadProgram("resources/sprite_vertex.glsl",
+                            "resources/texture_fragment.glsl");
+  if (!program->id) {
+    return nullptr;
+  }
+
+  program->texture_uniform_ = glGetUniformLocation(program->id, "tex");
+  program->half_size_uniform_ = glGetUniformLocation(program->id, "halfSize");
+
+  return program;
+}
+
+void SpriteProgram::Setup() {
+  glUniform1i(texture_uniform_, 0);
+  glUniform2f(half_size_uniform_, half_size_.x, half_size_.y);
+}
+
 std::unique_ptr<ColorProgram> ColorProgram::Make() {
   std::unique_ptr<ColorProgram> program(new ColorProgram());
   program->id = LoadProgram("resources/color_vertex.glsl",
@@ -53,6 +53,18 @@ class MapProgram : public Program {
   GLint tileset_uniform_, tilemap_uniform_, offset_uniform_;
 };
 
+// Draws instanced sprites for SpriteBatch.
+class SpriteProgram : public Program {
+ public:
+  void Setup();
+  void half_size(const vec2f& half_size) { half_size_ = half_size; }
+  static std::unique_ptr<SpriteProgram> Make();
+ private:
+  SpriteProgram() {}
+  vec2f half_size_ = {1, 1};
+  GLint texture_uniform_, half_size_uniform_;
+};
+
 class ColorProgram : public Program {
  public:
   void Setup();
@@ -0,0 +1,159 @@
+#include "SpriteBatch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+#include "GLState.h"
+
+using namespace std;
+
+namespace {
+// A unit quad as a triangle strip.
+const float CORNERS[8] = {0, 0, 1, 0, 0, 1, 1, 1};
+}  // namespace
+
+SpriteBatch::SpriteBatch(StreamBuffer* stream_buffer)
+    : stream_buffer_(stream_buffer) {
+  assert(stream_buffer_);
+  glGenVertexArrays(1, &vertex_array_);
+  glGenBuffers(1, &corner_buffer_);
+
+  GLState::BindVertexArray(vertex_array_);
+  GLState::BindBuffer(GL_ARRAY_BUFFER, corner_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(CORNERS), CORNERS, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  // Pointed at each run of instances in Draw().
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glVertexAttribDivisor(1, 1);
+  glVertexAttribDivisor(2, 1);
+}
+
+SpriteBatch::~SpriteBatch() {
+  GLState::DeleteBuffer(corner_buffer_);
+  GLState::DeleteVertexArray(vertex_array_);
+}
+
+void SpriteBatch::Add(const SpriteInstance& sprite) {
+  queued_.push_back(sprite);
+}
+
+void SpriteBatch::Submit(RenderQueue* queue, RenderLayer layer,
+                         const Camera& camera, SpriteProgram* program,
+                         TextureManager* texture_manager) {
+  draw_calls_ = 0;
+  written_ = false;
+  if (queued_.empty()) {
+    return;
+  }
+
+  // Move atlased sprites onto their pages. Consecutive sprites mostly share
+  // a texture, so only look up changes.
+  TextureRef last = queued_.front().texture + 1;
+  TextureRef page = 0;
+  for (SpriteInstance& sprite : queued_) {
+    if (sprite.texture != last) {
+      last = sprite.texture;
+      page = texture_manager->page(last);
+    }
+    if (page != last) {
+      sprite.source = texture_manager->MapRegion(last, sprite.source);
+    }
+    sprite.texture = page;
+  }
+
+  // Count each texture's sprites, then place them, so every texture's
+  // instances are contiguous. There are only ever a few textures.
+  runs_.clear();
+  size_t run = 0;
+  for (const SpriteInstance& sprite : queued_) {
+    if (run >= runs_.size() || runs_[run].texture != sprite.texture) {
+      for (run = 0; run < runs_.size(); ++run) {
+        if (runs_[run].texture == sprite.texture) {
+          break;
+        }
+      }
+      if (run == runs_.size()) {
+        runs_.push_back({sprite.texture, 0, 0});
+      }
+    }
+    ++runs_[run].count;
+  }
+  size_t first = 0;
+  for (Run& r : runs_) {
+    r.first = first;
+    first += r.count;
+    // Filled back up below.
+    r.count = 0;
+  }
+
+  // Relative to the camera in doubles, so sprites far out in big levels
+  // don't lose precision as floats.
+  vec2d center = camera.center();
+  instances_.resize(queued_.size());
+  run = 0;
+  for (const SpriteInstance& sprite : queued_) {
+    if (runs_[run].texture != sprite.texture) {
+      for (run = 0; runs_[run].texture != sprite.texture; ++run) {
+      }
+    }
+    Instance& instance = instances_[runs_[run].first + runs_[run].count++];
+    instance.dest[0] = (float)(sprite.dest.lowerLeft.x - center.x);
+    instance.dest[1] = (float)(sprite.dest.lowerLeft.y - center.y);
+    instance.dest[2] = (float)sprite.dest.w;
+    instance.dest[3] = (float)sprite.dest.h;
+    instance.source[0] = (float)sprite.source.lowerLeft.x;
+    instance.source[1] = (float)sprite.source.lowerLeft.y;
+    instance.source[2] = (float)sprite.source.w;
+    instance.source[3] = (float)sprite.source.h;
+  }
+  queued_.clear();
+
+  vec2f half_size = vec2_cast<float>(camera.half_size());
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    queue->Submit(layer, program, runs_[i].texture, -1,
+                  [this, i, program, half_size] {
+      // Written here rather than in Submit() so a full stream buffer region
+      // can't be fenced before these draws are made.
+      if (!written_) {
+        base_ = stream_buffer_->Write(instances_.data(),
+                                      instances_.size() * sizeof(Instance));
+        written_ = true;
+      }
+      program->half_size(half_size);
+      program->Setup();
+      GLState::BindVertexArray(vertex_array_);
+      GLState::Blend(true);
+      GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      const Run& run = runs_[i];
+      if (base_ >= 0) {
+        DrawInstances(base_ + run.first * sizeof(Instance), run.count);
+        return;
+      }
+      // Too many sprites for one write, so this texture's go up now, a
+      // region at a time.
+      const size_t max_count =
+          stream_buffer_->region_size() / sizeof(Instance);
+      assert(max_count > 0);
+      for (size_t first = run.first; first < run.first + run.count;
+           first += max_count) {
+        size_t count = min(max_count, run.first + run.count - first);
+        DrawInstances(stream_buffer_->Write(&instances_[first],
+                                            count * sizeof(Instance)),
+                      count);
+      }
+    });
+  }
+}
+
+void SpriteBatch::DrawInstances(GLintptr offset, size_t count) {
+  GLState::BindBuffer(GL_ARRAY_BUFFER, stream_buffer_->buffer());
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void*)(offset + offsetof(Instance, dest)));
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void*)(offset + offsetof(Instance, source)));
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+  ++draw_calls_;
+}
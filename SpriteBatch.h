@@ -0,0 +1,92 @@
+// Draws many sprites with a few instanced draw calls.
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Camera.h"
+#include "Geometry.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+#include "StreamBuffer.h"
+#include "TextureManager.h"
+
+// A sprite to draw: @source of @texture, in texture coordinates, over @dest,
+// in tiles. A negative source width or height flips the sprite. @source is
+// within @texture's own image even if it is atlased.
+struct SpriteInstance {
+  TextureRef texture;
+  Rect dest;
+  Rect source;
+};
+
+// Collects sprites over a frame, then submits all the sprites of each texture
+// as one instanced draw call. Textures in the same atlas page count as one
+// texture. Each sprite is a single instance (where it goes and the part of
+// the texture it shows), and all of them are written to a StreamBuffer at
+// once, when the first of the draws runs. If there are too many for that,
+// each texture's are written as it is drawn, a draw call per StreamBuffer
+// region's worth.
+//
+// Sprites of a texture are drawn in the order they were added, and textures
+// in whatever order the RenderQueue sorts them into, so sprites of different
+// textures don't keep their order.
+class SpriteBatch {
+ public:
+  // @stream_buffer must outlive this object.
+  explicit SpriteBatch(StreamBuffer* stream_buffer);
+  ~SpriteBatch();
+
+  // Queues @sprite to be drawn.
+  void Add(const SpriteInstance& sprite);
+  void Add(TextureRef texture, const Rect& dest, const Rect& source) {
+    Add({texture, dest, source});
+  }
+  // Submits the batch's draws to @queue in @layer and empties it. The batch
+  // must not be submitted again until @queue has been executed.
+  void Submit(RenderQueue* queue, RenderLayer layer, const Camera& camera,
+              SpriteProgram* program, TextureManager* texture_manager);
+
+  size_t size() const { return queued_.size(); }
+  // Draw calls made for the last Submit().
+  int draw_calls() const { return draw_calls_; }
+
+ private:
+  // Matches the instanced attributes of sprite_vertex.glsl.
+  struct Instance {
+    // x, y relative to the camera's center, then w, h; in tiles.
+    float dest[4];
+    float source[4];
+  };
+
+  // Sprites of one texture or atlas page, which are
+  // instances_[first, first + count).
+  struct Run {
+    TextureRef texture;
+    size_t first;
+    size_t count;
+  };
+
+  // Points the instanced attributes at the @count instances written at
+  // @offset in the stream buffer and draws them.
+  void DrawInstances(GLintptr offset, size_t count);
+
+  std::vector<SpriteInstance> queued_;
+  std::vector<Instance> instances_;
+  std::vector<Run> runs_;
+  int draw_calls_ = 0;
+  // Where instances_ are in the stream buffer, once they have been written,
+  // or -1 if they didn't fit.
+  bool written_ = false;
+  GLintptr base_ = 0;
+
+  GLuint vertex_array_;
+  GLuint corner_buffer_;
+  // Not owned.
+  StreamBuffer* stream_buffer_;
+};
+
+#endif  // SPRITEBATCH_H
@@ -13,6 +13,7 @@
 #include "Input.h"
 #include "Physics.h"
 #include "System.h"
+#include "Trigger.h"
 
 #define CASE(x) case x: return #x
 
@@ -56,6 +57,11 @@ class StateBehavior {
                                     const CollisionEvent*) const {
     return state();
   };
+  // Handles entering and leaving trigger volumes.
+  virtual StateEnum HandleTrigger(ComponentType*, const Entity*,
+                                  const TriggerEvent*) const {
+    return state();
+  };
   virtual StateEnum state() const = 0;
 };
 
@@ -109,6 +115,19 @@ class StateMachineSystem : public System {
           HandleTransition(&entity, state_component, new_state);
         }
       }
+    } else if (event->type() == EventType::TRIGGER) {
+      auto* trigger = static_cast<const TriggerEvent*>(event);
+      if (trigger->body < (int)entities.size()) {
+        const Entity& entity = entities[trigger->body];
+        ComponentType* state_component = entity.GetComponent<ComponentType>();
+        if (state_component) {
+          auto state = state_component->state();
+          const StateBehavior<ComponentType>* behavior = behaviors_[state].get();
+          auto new_state =
+              behavior->HandleTrigger(state_component, &entity, trigger);
+          HandleTransition(&entity, state_component, new_state);
+        }
+      }
     }
 
     return {};
@@ -129,6 +148,11 @@ class StateMachineSystem : public System {
                         StateEnum new_state) {
     const StateEnum old_state = state_component->state();
     if (new_state != old_state) {
+      // Whatever the new state does to the body, it should get simulated.
+      Body* body = entity->GetComponent<Body>();
+      if (body) {
+        body->Wake();
+      }
       const StateBehavior<ComponentType>* old_behavior =
           behaviors_[old_state].get();
       const StateBehavior<ComponentType>* new_behavior =
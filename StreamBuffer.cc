@@ -0,0 +1,95 @@
+#include "StreamBuffer.h"
+
+#include <cstring>
+
+#include "GLState.h"
+
+namespace {
+// Enough for any vertex attribute.
+const size_t ALIGNMENT = 16;
+// How long to wait on a fence at a time, in nanoseconds.
+const GLuint64 FENCE_TIMEOUT = 1000000;
+}  // namespace
+
+StreamBuffer::StreamBuffer(size_t region_size)
+    : region_size_((region_size + ALIGNMENT - 1) & ~(ALIGNMENT - 1)) {
+  GLsizeiptr size = region_size_ * REGIONS;
+  glGenBuffers(1, &buffer_);
+  GLState::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+  if (GLEW_ARB_buffer_storage) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    mapped_ =
+        static_cast<char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  }
+}
+
+StreamBuffer::~StreamBuffer() {
+  for (GLsync fence : fences_) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  if (mapped_) {
+    GLState::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+  GLState::DeleteBuffer(buffer_);
+}
+
+GLintptr StreamBuffer::Write(const void* data, size_t size) {
+  if (size > region_size_) {
+    return -1;
+  }
+  if (used_ + size > region_size_) {
+    Advance();
+  }
+  GLintptr offset = region_ * region_size_ + used_;
+  used_ = (used_ + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  if (mapped_) {
+    memcpy(mapped_ + offset, data, size);
+  } else {
+    GLState::BindBuffer(GL_ARRAY_BUFFER, buffer_);
+    void* range = glMapBufferRange(
+        GL_ARRAY_BUFFER, offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+            GL_MAP_INVALIDATE_RANGE_BIT);
+    memcpy(range, data, size);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+  return offset;
+}
+
+void StreamBuffer::EndFrame() {
+  if (used_ > 0) {
+    Advance();
+  }
+}
+
+void StreamBuffer::Advance() {
+  if (fences_[region_]) {
+    glDeleteSync(fences_[region_]);
+  }
+  fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  region_ = (region_ + 1) % REGIONS;
+  used_ = 0;
+
+  GLsync& fence = fences_[region_];
+  if (!fence) {
+    return;
+  }
+  // Flush on the first wait so the fence is sure to be signalled eventually.
+  GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+  while (true) {
+    GLenum result = glClientWaitSync(fence, flags, FENCE_TIMEOUT);
+    if (result != GL_TIMEOUT_EXPIRED) {
+      break;
+    }
+    flags = 0;
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
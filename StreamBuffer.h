@@ -0,0 +1,59 @@
+// Streams per-frame vertex data to the GPU without reallocating buffers.
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <cstddef>
+
+#include <GL/glew.h>
+
+// A GL_ARRAY_BUFFER split into three regions used in turn, one a frame, so
+// the CPU fills one while the GPU may still be drawing from the other two.
+// A fence at the end of each frame guards its region until the GPU is done
+// with it, so writes never have to wait on or orphan the buffer the way
+// glBufferData does.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently, and writes
+// are plain copies. Otherwise each write maps its range unsynchronized, which
+// the fences make safe.
+class StreamBuffer {
+ public:
+  // Each frame may write up to @region_size bytes. Needs a current GL
+  // context.
+  explicit StreamBuffer(size_t region_size);
+  ~StreamBuffer();
+
+  // Copies @size bytes of @data into the buffer and returns their offset in
+  // it, for glVertexAttribPointer(). Writes are 16 byte aligned. May bind
+  // buffer() to GL_ARRAY_BUFFER through GLState.
+  // If the frame's region is full, moves on to the next one early, which may
+  // wait on the GPU. That fences only the draws made so far, so write
+  // everything a draw call reads in one go.
+  // Returns -1, writing nothing, if @size is more than region_size(); split
+  // bigger writes across draw calls.
+  GLintptr Write(const void* data, size_t size);
+  // Fences the frame's writes and moves on to the next region. Call once a
+  // frame, after the last draw that uses the buffer.
+  void EndFrame();
+
+  GLuint buffer() const { return buffer_; }
+  // The most a single Write() takes.
+  size_t region_size() const { return region_size_; }
+  bool persistent() const { return mapped_ != nullptr; }
+
+ private:
+  static const int REGIONS = 3;
+
+  // Fences the current region and waits until the next one is free.
+  void Advance();
+
+  size_t region_size_;
+  GLuint buffer_;
+  // The whole buffer, if it is persistently mapped.
+  char* mapped_ = nullptr;
+  int region_ = 0;
+  // Next free byte of the current region.
+  size_t used_ = 0;
+  GLsync fences_[REGIONS] = {};
+};
+
+#endif  // STREAMBUFFER_H
@@ -1,12 +1,18 @@
 #include "Text.h"
 
 #include <iostream>
+#include <iterator>
 
-std::unique_ptr<Text> Text::MakeText(const Font* font) {
-  std::unique_ptr<Text> text = std::unique_ptr<Text>(new Text(font));
+#include "GLState.h"
+
+std::unique_ptr<Text> Text::MakeText(const Font* font,
+                                     StreamBuffer* stream_buffer) {
+  std::unique_ptr<Text> text =
+      std::unique_ptr<Text>(new Text(font, stream_buffer));
   glGenVertexArrays(1, &text->vertex_array_object_);
-  glGenBuffers(1, &text->position_buffer_);
-  glGenBuffers(1, &text->texture_coord_buffer_);
+  GLState::BindVertexArray(text->vertex_array_object_);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
   return text;
 }
 
@@ -15,67 +21,45 @@ void Text::AddCharacter(char c) {
 
   Character character = font_->GetCharacter(c);
 
-  // Top left triangle postions
-  positions_.push_back(last_pos_.x);
-  positions_.push_back(last_pos_.y);
-  positions_.push_back(last_pos_.x);
-  positions_.push_back(last_pos_.y - 1);
-  positions_.push_back(last_pos_.x + 1);
-  positions_.push_back(last_pos_.y);
-
-  // Bottom right triangle positions
-  positions_.push_back(last_pos_.x + 1);
-  positions_.push_back(last_pos_.y);
-  positions_.push_back(last_pos_.x);
-  positions_.push_back(last_pos_.y - 1);
-  positions_.push_back(last_pos_.x + 1);
-  positions_.push_back(last_pos_.y - 1);
-
+  float left = last_pos_.x;
+  float right = last_pos_.x + 1;
+  float top = last_pos_.y;
+  float bottom = last_pos_.y - 1;
   last_pos_.x += character.width;
 
-  // Top left triangle tex coords
-  texture_coords_.push_back(character.lower_left.x);
-  texture_coords_.push_back(character.upper_right.y);
-  texture_coords_.push_back(character.lower_left.x);
-  texture_coords_.push_back(character.lower_left.y);
-  texture_coords_.push_back(character.upper_right.x);
-  texture_coords_.push_back(character.upper_right.y);
-
-  // Bottom right triangle tex coords
-  texture_coords_.push_back(character.upper_right.x);
-  texture_coords_.push_back(character.upper_right.y);
-  texture_coords_.push_back(character.lower_left.x);
-  texture_coords_.push_back(character.lower_left.y);
-  texture_coords_.push_back(character.upper_right.x);
-  texture_coords_.push_back(character.lower_left.y);
+  const GLfloat quad[] = {
+      // Top left triangle
+      left, top, character.lower_left.x, character.upper_right.y,
+      left, bottom, character.lower_left.x, character.lower_left.y,
+      right, top, character.upper_right.x, character.upper_right.y,
+      // Bottom right triangle
+      right, top, character.upper_right.x, character.upper_right.y,
+      left, bottom, character.lower_left.x, character.lower_left.y,
+      right, bottom, character.upper_right.x, character.lower_left.y,
+  };
+  vertices_.insert(vertices_.end(), std::begin(quad), std::end(quad));
 }
 
 void Text::Draw() const {
-  glBindVertexArray(vertex_array_object_);
-
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-
-  glBindBuffer(GL_ARRAY_BUFFER, position_buffer_);
-  // Given GL_STATIC_DRAW and GL_DYNAMIC_DRAW, it seems like this is probably
-  // shouldn't be reuploaded every time :P
-  glBufferData(GL_ARRAY_BUFFER, positions_.size() * sizeof(GLfloat),
-               positions_.data(), GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-  glBindBuffer(GL_ARRAY_BUFFER, texture_coord_buffer_);
-  glBufferData(GL_ARRAY_BUFFER, texture_coords_.size() * sizeof(GLfloat),
-               texture_coords_.data(), GL_STATIC_DRAW);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  if (characters_.empty()) {
+    return;
+  }
+  GLintptr offset = stream_buffer_->Write(
+      vertices_.data(), vertices_.size() * sizeof(GLfloat));
+  if (offset < 0) {
+    // More text than the stream buffer takes in a frame.
+    return;
+  }
+
+  GLState::BindVertexArray(vertex_array_object_);
+  GLState::BindBuffer(GL_ARRAY_BUFFER, stream_buffer_->buffer());
+  GLsizei stride = 4 * sizeof(GLfloat);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                        (void*)(offset + 2 * sizeof(GLfloat)));
+
+  GLState::Blend(true);
+  GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   // 6 vertices per character
   glDrawArrays(GL_TRIANGLES, 0, characters_.size() * 6);
-  glDisable(GL_BLEND);
-
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
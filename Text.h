@@ -7,29 +7,30 @@
 
 #include "Font.h"
 #include "Geometry.h"
+#include "StreamBuffer.h"
 
 class Text {
  public:
-  static std::unique_ptr<Text> MakeText(const Font* font);
+  // Both must outlive the Text.
+  static std::unique_ptr<Text> MakeText(const Font* font,
+                                        StreamBuffer* stream_buffer);
   void AddCharacter(char c);
   void Draw() const;
  private:
-  Text(const Font* font) : font_(font) {}
+  Text(const Font* font, StreamBuffer* stream_buffer)
+      : font_(font), stream_buffer_(stream_buffer) {}
 
   // In character coords, where character height = 1 character coord
   vec2f last_pos_;
 
   GLuint vertex_array_object_;
 
-  // Can probably combine these.
-  GLuint position_buffer_;
-  GLuint texture_coord_buffer_;
-
-  std::vector<GLfloat> positions_;
-  std::vector<GLfloat> texture_coords_;
+  // x, y, then texture x, y of each vertex.
+  std::vector<GLfloat> vertices_;
 
   // Does not own. Must outlive this object.
   const Font* font_;
+  StreamBuffer* stream_buffer_;
   std::vector<char> characters_;
 };
 
@@ -0,0 +1,69 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+
+using namespace std;
+
+SkylinePacker::SkylinePacker(int w, int h) : w_(w), h_(h) {
+  skyline_.push_back({0, 0, w});
+}
+
+bool SkylinePacker::Pack(int w, int h, int* x, int* y) {
+  if (w <= 0 || h <= 0 || w > w_ || h > h_) {
+    return false;
+  }
+  size_t best = skyline_.size();
+  int best_y = h_;
+  for (size_t i = 0; i < skyline_.size(); ++i) {
+    int fit = Fit(i, w, h);
+    if (fit >= 0 && fit < best_y) {
+      best = i;
+      best_y = fit;
+    }
+  }
+  if (best == skyline_.size()) {
+    return false;
+  }
+  *x = skyline_[best].x;
+  *y = best_y;
+
+  // The rectangle's top becomes a segment, and whatever it covers to the
+  // right is trimmed or dropped.
+  Segment top = {*x, best_y + h, w};
+  skyline_.insert(skyline_.begin() + best, top);
+  size_t next = best + 1;
+  while (next < skyline_.size() &&
+         skyline_[next].x < top.x + top.w) {
+    Segment& s = skyline_[next];
+    int covered = top.x + top.w - s.x;
+    if (covered < s.w) {
+      s.x += covered;
+      s.w -= covered;
+      break;
+    }
+    skyline_.erase(skyline_.begin() + next);
+  }
+  // Merge neighbours at the same height so Fit() has fewer to look at.
+  for (size_t i = 0; i + 1 < skyline_.size();) {
+    if (skyline_[i].y == skyline_[i + 1].y) {
+      skyline_[i].w += skyline_[i + 1].w;
+      skyline_.erase(skyline_.begin() + i + 1);
+    } else {
+      ++i;
+    }
+  }
+  return true;
+}
+
+int SkylinePacker::Fit(size_t i, int w, int h) const {
+  int x = skyline_[i].x;
+  if (x + w > w_) {
+    return -1;
+  }
+  // Rests on the highest segment under it.
+  int y = 0;
+  for (size_t j = i; j < skyline_.size() && skyline_[j].x < x + w; ++j) {
+    y = max(y, skyline_[j].y);
+  }
+  return y + h <= h_ ? y : -1;
+}
@@ -0,0 +1,40 @@
+// Packs small textures into shared atlas pages, see
+// TextureManager::LoadAtlasTexture().
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <cstddef>
+#include <vector>
+
+// Places rectangles in a @w by @h page, bottom left first. Keeps the skyline,
+// the top edge of everything placed so far, and puts each rectangle wherever
+// along it leaves its top lowest. Space under the skyline that a rectangle
+// overhangs is given up, which costs little when rectangles are added roughly
+// tallest first.
+class SkylinePacker {
+ public:
+  SkylinePacker(int w, int h);
+
+  // Finds room for a @w by @h rectangle and sets @x, @y to its lower left.
+  // Returns false, and changes nothing, if it doesn't fit.
+  bool Pack(int w, int h, int* x, int* y);
+
+  int w() const { return w_; }
+  int h() const { return h_; }
+
+ private:
+  // Runs from x to x + w at height y.
+  struct Segment {
+    int x, y, w;
+  };
+
+  // Where a @w by @h rectangle would go if its left edge were at segment
+  // @i, or -1 if it doesn't fit there.
+  int Fit(size_t i, int w, int h) const;
+
+  int w_, h_;
+  // Left to right, covering the whole page width.
+  std::vector<Segment> skyline_;
+};
+
+#endif  // TEXTUREATLAS_H
@@ -1,12 +1,23 @@
 #include <SDL.h>
 #include <SDL_image.h>
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 using namespace std;
 
 #include "TextureManager.h"
 
+#include "GLState.h"
+
+namespace {
+// Pixels along each side of an atlas page, if the GL allows it.
+const int ATLAS_PAGE_SIZE = 1024;
+// Pixels around each texture in an atlas, filled with copies of its edges so
+// sampling just past an edge doesn't pick up a neighbour.
+const int ATLAS_PADDING = 1;
+}  // namespace
+
 TextureManager::TextureManager() {
   next_unused_ref = 0;
   TextureRef ref = getUnusedRef();
@@ -18,7 +29,7 @@ TextureManager::TextureManager() {
 
   glGenTextures(1, &texture);
 
-  glBindTexture(GL_TEXTURE_2D, texture);
+  GLState::BindTextureForUpdate(0, texture);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -27,15 +38,13 @@ TextureManager::TextureManager() {
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 2, 2, 0, GL_RGB, GL_FLOAT, color);
 
-  glBindTexture(GL_TEXTURE_2D, 0);
-
   textures[ref] = texture;
 }
 
 TextureManager::~TextureManager() {
   for (map<TextureRef, GLuint>::iterator i = textures.begin();
        i != textures.end(); ++i) {
-    glDeleteTextures(1, &(i->second));
+    GLState::DeleteTexture(i->second);
   }
 }
 
@@ -102,7 +111,7 @@ TextureRef TextureManager::LoadTexture(string filename, int level) {
     GLuint texture;
     glGenTextures(1, &texture);
 
-    glBindTexture(GL_TEXTURE_2D, texture);
+    GLState::BindTextureForUpdate(0, texture);
 
     if (level == -1) {
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
@@ -123,8 +132,6 @@ TextureRef TextureManager::LoadTexture(string filename, int level) {
                    pd->format, GL_UNSIGNED_BYTE, pd->data.data());
     }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     ref = getUnusedRef();
 
     textures[ref] = texture;  // store the stats about our new texture
@@ -134,35 +141,133 @@ TextureRef TextureManager::LoadTexture(string filename, int level) {
   return ref;
 }
 
-TextureRef TextureManager::LoadTilemapTexture(const TileMap& tilemap) {
+TextureRef TextureManager::LoadAtlasTexture(string filename) {
+  map<string, TextureRef>::iterator fileref = filenames.find(filename);
+  if (fileref != filenames.end()) {
+    refcounts[fileref->second] += 1;
+    return fileref->second;
+  }
+  std::unique_ptr<PixelData> pd = LoadToPixelData(filename);
+  assert(pd.get());
+  int w = pd->w + 2 * ATLAS_PADDING;
+  int h = pd->h + 2 * ATLAS_PADDING;
+  const int page_size = AtlasPageSize();
+  if (w > page_size || h > page_size) {
+    // Too big for any page, so it gets a texture of its own.
+    return LoadTexture(filename, 0);
+  }
+
+  int x, y;
+  AtlasPage* page = nullptr;
+  for (AtlasPage& p : pages) {
+    if (p.packer.Pack(w, h, &x, &y)) {
+      page = &p;
+      break;
+    }
+  }
+  if (!page) {
+    page = &NewAtlasPage();
+    // An empty page fits anything no bigger than it.
+    bool packed = page->packer.Pack(w, h, &x, &y);
+    assert(packed);
+    (void)packed;
+  }
+
+  // Copy the image with its edges repeated out through the padding.
+  vector<GLbyte> padded(w * h * pd->bpp);
+  for (int py = 0; py < h; ++py) {
+    int sy = min(max(py - ATLAS_PADDING, 0), pd->h - 1);
+    for (int px = 0; px < w; ++px) {
+      int sx = min(max(px - ATLAS_PADDING, 0), pd->w - 1);
+      copy_n(&pd->data[(sy * pd->w + sx) * pd->bpp], pd->bpp,
+             &padded[(py * w + px) * pd->bpp]);
+    }
+  }
+  GLState::BindTextureForUpdate(0, textures[page->ref]);
+  // RGB rows needn't be a multiple of 4 long.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, pd->format, GL_UNSIGNED_BYTE,
+                  padded.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  TextureRef ref = getUnusedRef();
+  double size = page->packer.w();
+  atlased[ref] = {page->ref,
+                  {{(x + ATLAS_PADDING) / size, (y + ATLAS_PADDING) / size},
+                   pd->w / size,
+                   pd->h / size}};
+  filenames[filename] = ref;
+  refcounts[ref] = 1;
+  return ref;
+}
+
+int TextureManager::AtlasPageSize() const {
+  GLint max_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  return min<int>(ATLAS_PAGE_SIZE, max_size);
+}
+
+TextureManager::AtlasPage& TextureManager::NewAtlasPage() {
+  int size = AtlasPageSize();
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  GLState::BindTextureForUpdate(0, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  // Clear, so gaps between textures are transparent.
+  vector<GLubyte> clear(size * size * 4, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, clear.data());
+
+  TextureRef ref = getUnusedRef();
+  textures[ref] = texture;
+  // Pages are never unloaded, so they hold their own reference.
+  refcounts[ref] = 1;
+  pages.push_back({ref, SkylinePacker(size, size)});
+  return pages.back();
+}
+
+TextureRef TextureManager::page(TextureRef ref) const {
+  map<TextureRef, AtlasEntry>::const_iterator entry = atlased.find(ref);
+  return entry != atlased.end() ? entry->second.page : ref;
+}
+
+Rect TextureManager::region(TextureRef ref) const {
+  map<TextureRef, AtlasEntry>::const_iterator entry = atlased.find(ref);
+  if (entry != atlased.end()) {
+    return entry->second.region;
+  }
+  return {{0, 0}, 1, 1};
+}
+
+Rect TextureManager::MapRegion(TextureRef ref, const Rect& source) const {
+  map<TextureRef, AtlasEntry>::const_iterator entry = atlased.find(ref);
+  if (entry == atlased.end()) {
+    return source;
+  }
+  const Rect& r = entry->second.region;
+  return {{r.lowerLeft.x + source.lowerLeft.x * r.w,
+           r.lowerLeft.y + source.lowerLeft.y * r.h},
+          source.w * r.w,
+          source.h * r.h};
+}
+
+TextureRef TextureManager::CreateTilemapTexture(int w, int h) {
   GLuint texture;
   glGenTextures(1, &texture);
 
-  glBindTexture(GL_TEXTURE_2D, texture);
+  GLState::BindTextureForUpdate(0, texture);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-  int w = tilemap.GetWidth();
-  int h = tilemap.GetHeight();
-  vector<GLubyte> map_data;
-  // Textures are positive-up
-  for (int y = 0; y < h; ++y) {
-    for (int x = 0; x < w; ++x) {
-      map_data.push_back((GLubyte)tilemap.At(x, y));
-    }
-  }
-
   glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, w, h, 0, GL_RED_INTEGER,
-               GL_UNSIGNED_BYTE, map_data.data());
-
-  if (glGetError() == GL_NO_ERROR) {
-    cout << "Loaded tilemap successfully" << endl;
-  }
-
-  glBindTexture(GL_TEXTURE_2D, 0);
+               GL_UNSIGNED_BYTE, nullptr);
 
   TextureRef ref = getUnusedRef();
 
@@ -173,6 +278,20 @@ TextureRef TextureManager::LoadTilemapTexture(const TileMap& tilemap) {
   return ref;
 }
 
+void TextureManager::UpdateTilemapTexture(TextureRef ref, int x, int y, int w,
+                                          int h, const GLubyte* tiles) {
+  map<TextureRef, GLuint>::iterator tex = textures.find(ref);
+  if (tex == textures.end()) {
+    return;
+  }
+  GLState::BindTextureForUpdate(0, tex->second);
+  // Rows are a byte per tile, so they needn't be a multiple of 4 long.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RED_INTEGER,
+                  GL_UNSIGNED_BYTE, tiles);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
 void TextureManager::UnloadTexture(TextureRef ref) {
   map<TextureRef, int>::iterator refcount;
   if (ref != 0 &&
@@ -183,7 +302,13 @@ void TextureManager::UnloadTexture(TextureRef ref) {
     if (refcount->second <= 0) {  // if the texture is no longer being used by
                                   // any objects, so we can really remove it
       refcounts.erase(refcount);
-      textures.erase(ref);
+      // Its space in the page is left as it is.
+      atlased.erase(ref);
+      map<TextureRef, GLuint>::iterator tex = textures.find(ref);
+      if (tex != textures.end()) {
+        GLState::DeleteTexture(tex->second);
+        textures.erase(tex);
+      }
       for (map<string, TextureRef>::iterator i = filenames.begin();
            i != filenames.end(); ++i) {
         if (i->second == ref) {
@@ -196,16 +321,7 @@ void TextureManager::UnloadTexture(TextureRef ref) {
 }
 
 void TextureManager::BindTexture(TextureRef ref, int unit) {
-  if (unit == 0) {
-    glActiveTexture(GL_TEXTURE0);
-  } else {
-    glActiveTexture(GL_TEXTURE1);
-  }
-
-  map<TextureRef, GLuint>::iterator tex = textures.find(ref);
-  if (tex != textures.end()) {
-    glBindTexture(GL_TEXTURE_2D, tex->second);
-  } else {
-    glBindTexture(GL_TEXTURE_2D, textures[0]);
-  }
+  map<TextureRef, GLuint>::iterator tex = textures.find(page(ref));
+  GLuint texture = tex != textures.end() ? tex->second : textures[0];
+  GLState::BindTexture(unit == 0 ? 0 : 1, texture);
 }
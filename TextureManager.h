@@ -13,7 +13,8 @@
 #include <vector>
 
 #include "Component.h"
-#include "TileMap.h"
+#include "Geometry.h"
+#include "TextureAtlas.h"
 
 using namespace std;
 
@@ -34,17 +35,54 @@ class TextureManager {
   ~TextureManager();
 
   TextureRef LoadTexture(string filename, int level);
+  // Loads @filename into a shared atlas page instead of a texture of its own,
+  // so draws from different atlased textures can share a bind and a batch.
+  // Atlased textures can't repeat or be mipmapped, and their space on the page
+  // isn't reused once they are unloaded. One too big for a page is loaded as
+  // LoadTexture() would.
+  TextureRef LoadAtlasTexture(string filename);
   void UnloadTexture(TextureRef ref);
 
   void BindTexture(TextureRef ref, int unit);
-
-  TextureRef LoadTilemapTexture(const TileMap& tilemap);
+  // The texture BindTexture(@ref) binds: @ref's atlas page if it has one,
+  // otherwise @ref. Draws of textures with the same page can be batched.
+  TextureRef page(TextureRef ref) const;
+  // Where @ref's image is in page(@ref), in texture coordinates. The whole
+  // texture unless @ref is atlased.
+  Rect region(TextureRef ref) const;
+  // @source, in the texture coordinates of @ref's own image, moved to where
+  // that image is in page(@ref).
+  Rect MapRegion(TextureRef ref, const Rect& source) const;
+
+  // An empty @w by @h tilemap texture, to be filled in by
+  // UpdateTilemapTexture(), e.g. a few rows a frame.
+  TextureRef CreateTilemapTexture(int w, int h);
+  // Replaces the @w by @h tiles at @x, @y of a tilemap texture with @tiles,
+  // a byte per tile, row by row from the lower left.
+  void UpdateTilemapTexture(TextureRef ref, int x, int y, int w, int h,
+                            const GLubyte* tiles);
 
  private:
+  struct AtlasPage {
+    TextureRef ref;
+    SkylinePacker packer;
+  };
+  struct AtlasEntry {
+    TextureRef page;
+    Rect region;
+  };
+
   TextureRef getUnusedRef();
+  // Side of an atlas page, in texels.
+  int AtlasPageSize() const;
+  // Adds an empty atlas page to pages.
+  AtlasPage& NewAtlasPage();
   map<string, TextureRef> filenames;
   map<TextureRef, GLuint> textures;
   map<TextureRef, int> refcounts;
+  vector<AtlasPage> pages;
+  // Textures in atlas pages. Their refs have no entry in textures.
+  map<TextureRef, AtlasEntry> atlased;
   TextureRef next_unused_ref;
 };
 
@@ -57,7 +95,7 @@ enum class Orientation {
 class Sprite : public Component {
  public:
   Sprite() {}
-  Sprite(TextureRef texture, int index, Orientation orientation, vec2f offset)
+  Sprite(TextureRef texture, int index, Orientation orientation, vec2d offset)
       : texture(texture),
         index(index),
         orientation(orientation),
@@ -69,7 +107,7 @@ class Sprite : public Component {
   // The delta between where this sprite would normally be drawn and where it
   // will be drawn. Used for physics Bodys that do not line up with their
   // sprites.
-  vec2f offset = {0,0};
+  vec2d offset = {0,0};
 
   ComponentType type() const override { return ComponentType::SPRITE; }
 
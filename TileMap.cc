@@ -1,86 +1,612 @@
 #include "TileMap.h"
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <fstream>
 #include <memory>
 
+#include "LevelFile.h"
+#include "TmxScanner.h"
+
 using namespace std;
 
-TileMap::TileMap(const Tmx::TileLayer* tile_layer) {
-  w = tile_layer->GetWidth();
-  h = tile_layer->GetHeight();
+namespace {
+// Cooked layers up to this many chunks are made resident when loaded; bigger
+// ones need a ChunkStreamer.
+const int MAX_LOADED_CHUNKS = 4096;
 
-  tiles.resize(w*h);
+// Older tmxparsers store property values as strings, newer ones as
+// Tmx::Property.
+std::string PropertyValue(const std::string& value) { return value; }
+template <typename Property>
+std::string PropertyValue(const Property& property) {
+  return property.GetValue();
+}
 
+// Tiled has objects in pixels, y down from the top of the map.
+void PlaceObject(double x, double y, double w, double h, int map_h,
+                 int tile_w, int tile_h, MapObject* mo) {
+  // Flip the y-axis
+  mo->pos = {x / tile_w, (map_h * tile_h - y) / tile_h - 1};
+  // Tiled measures y to the top of the rectangle.
+  mo->bounds = {{mo->pos.x, (map_h * tile_h - y - h) / tile_h},
+                w / tile_w,
+                h / tile_h};
+}
+
+// Swaps x and y, so the same code can merge rects along either axis.
+void Transpose(vector<TileRect>* rects) {
+  for (TileRect& rect : *rects) {
+    swap(rect.x, rect.y);
+    swap(rect.w, rect.h);
+  }
+}
+
+// Merges rects that meet end to start along x, in the same row of chunks,
+// into their bounding box, as long as that isn't much bigger than they are.
+// Sending a few unchanged tiles is cheaper than another glTexSubImage2D.
+void MergeAlongX(vector<TileRect>* rects) {
+  sort(rects->begin(), rects->end(),
+       [](const TileRect& a, const TileRect& b) {
+         int a_row = a.y / TileMap::CHUNK_SIZE;
+         int b_row = b.y / TileMap::CHUNK_SIZE;
+         return a_row < b_row || (a_row == b_row && a.x < b.x);
+       });
+  size_t merged = 0;
+  for (size_t i = 0; i < rects->size(); ++i) {
+    const TileRect& rect = (*rects)[i];
+    if (merged > 0) {
+      TileRect& last = (*rects)[merged - 1];
+      int y0 = min(last.y, rect.y);
+      int y1 = max(last.y + last.h, rect.y + rect.h);
+      int area = (rect.x + rect.w - last.x) * (y1 - y0);
+      if (last.y / TileMap::CHUNK_SIZE == rect.y / TileMap::CHUNK_SIZE &&
+          last.x + last.w == rect.x &&
+          area <= 2 * (last.w * last.h + rect.w * rect.h)) {
+        last = {last.x, y0, rect.x + rect.w - last.x, y1 - y0};
+        continue;
+      }
+    }
+    (*rects)[merged++] = rect;
+  }
+  rects->resize(merged);
+}
+
+vector<int> LayerTiles(const Tmx::TileLayer* tile_layer) {
+  int w = tile_layer->GetWidth();
+  int h = tile_layer->GetHeight();
+  vector<int> tiles(w * h);
   for (int y = 0; y < h; ++y) {
     for (int x = 0; x < w; ++x) {
       // tmx maps have origins in the upper left, but we want lower left.
-      set(x, h - 1 - y, tile_layer->GetTileId(x, y));
+      tiles[(h - 1 - y) * w + x] = tile_layer->GetTileId(x, y);
+    }
+  }
+  return tiles;
+}
+}  // namespace
+
+bool IsSlope(TileType tile_type) {
+  return tile_type == TILE_SLOPE_01 || tile_type == TILE_SLOPE_10 ||
+         tile_type == TILE_SLOPE_05 || tile_type == TILE_SLOPE_51 ||
+         tile_type == TILE_SLOPE_15 || tile_type == TILE_SLOPE_50;
+}
+
+double HeightAtX(double tilespace_x, int tile_type) {
+  switch (tile_type) {
+    case TILE_SLOPE_01:
+      return tilespace_x;
+    case TILE_SLOPE_10:
+      return 1 - tilespace_x;
+    case TILE_SLOPE_05:
+      return 0.5 * tilespace_x;
+    case TILE_SLOPE_51:
+      return 0.5 + 0.5 * tilespace_x;
+    case TILE_SLOPE_15:
+      return 1 - 0.5 * tilespace_x;
+    case TILE_SLOPE_50:
+      return 0.5 - 0.5 * tilespace_x;
+    default:
+      assert(false);
+      return -10;
+  }
+}
+
+const uint16_t TileMap::Z_SPREAD[CHUNK_SIZE] = {
+    0x000, 0x001, 0x004, 0x005, 0x010, 0x011, 0x014, 0x015,
+    0x040, 0x041, 0x044, 0x045, 0x050, 0x051, 0x054, 0x055,
+    0x100, 0x101, 0x104, 0x105, 0x110, 0x111, 0x114, 0x115,
+    0x140, 0x141, 0x144, 0x145, 0x150, 0x151, 0x154, 0x155};
+
+MemoryChunkSource::MemoryChunkSource(int w, int h, const vector<int>& tiles)
+    : chunks_w_((w + TileMap::CHUNK_SIZE - 1) / TileMap::CHUNK_SIZE) {
+  const int size = TileMap::CHUNK_SIZE;
+  int chunks_h = (h + size - 1) / size;
+  vector<uint16_t> chunk(size * size);
+  vector<Run> runs;
+  for (int chunk_y = 0; chunk_y < chunks_h; ++chunk_y) {
+    for (int chunk_x = 0; chunk_x < chunks_w_; ++chunk_x) {
+      for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+          int tile_x = chunk_x * size + x;
+          int tile_y = chunk_y * size + y;
+          int tile = tile_x < w && tile_y < h ? tiles[tile_y * w + tile_x]
+                                              : (int)TILE_EMPTY;
+          assert(tile >= 0 && tile <= 0xffff);
+          max_tile_ = max(max_tile_, tile);
+          chunk[y * size + x] = tile;
+        }
+      }
+
+      runs.clear();
+      for (uint16_t tile : chunk) {
+        if (!runs.empty() && runs.back().tile == tile) {
+          ++runs.back().length;
+        } else {
+          runs.push_back({1, tile});
+        }
+      }
+      chunk_runs_.push_back(runs_.size());
+      chunk_raw_.push_back(raw_.size());
+      // A run costs two tiles.
+      if (runs.size() * 2 < chunk.size()) {
+        runs_.insert(runs_.end(), runs.begin(), runs.end());
+      } else {
+        raw_.insert(raw_.end(), chunk.begin(), chunk.end());
+      }
     }
   }
+  chunk_runs_.push_back(runs_.size());
 }
 
-TileType TileMap::At(int x, int y) const {
-  if (x < 0 || y < 0 || x >= w || y >= h) {
-    return TileType::TILE_EMPTY;
+size_t MemoryChunkSource::bytes() const {
+  return (chunk_runs_.size() + chunk_raw_.size()) * sizeof(uint32_t) +
+         runs_.size() * sizeof(Run) + raw_.size() * sizeof(uint16_t);
+}
+
+void MemoryChunkSource::LoadChunk(int chunk_x, int chunk_y,
+                                  vector<uint16_t>* tiles) const {
+  int i = chunk_y * chunks_w_ + chunk_x;
+  tiles->resize(TileMap::CHUNK_SIZE * TileMap::CHUNK_SIZE);
+  if (chunk_runs_[i] == chunk_runs_[i + 1]) {
+    copy_n(&raw_[chunk_raw_[i]], tiles->size(), tiles->begin());
+    return;
+  }
+  auto out = tiles->begin();
+  for (uint32_t run = chunk_runs_[i]; run < chunk_runs_[i + 1]; ++run) {
+    out = fill_n(out, runs_[run].length, runs_[run].tile);
   }
-  return (TileType)get(x, y);
+}
+
+PackedChunkSource::PackedChunkSource(int w, int h, int max_tile)
+    : w_(w),
+      chunks_w_((w + TileMap::CHUNK_SIZE - 1) / TileMap::CHUNK_SIZE),
+      max_tile_(max_tile),
+      tile_bytes_(TileMap::TileBytes(max_tile)),
+      chunk_bytes_(TileMap::CHUNK_SIZE * TileMap::CHUNK_SIZE * tile_bytes_),
+      uniform_((size_t)chunks_w_ *
+                   ((h + TileMap::CHUNK_SIZE - 1) / TileMap::CHUNK_SIZE),
+               TILE_EMPTY) {
+  assert(max_tile >= 0 && max_tile <= 0xffff);
+  tiles_.resize(uniform_.size() * chunk_bytes_, TILE_EMPTY);
+}
+
+void PackedChunkSource::SetRow(int y, const uint32_t* tiles) {
+  const int size = TileMap::CHUNK_SIZE;
+  uint8_t* row = &tiles_[(size_t)(y / size) * chunks_w_ * chunk_bytes_];
+  const size_t z_y = (size_t)TileMap::Z_SPREAD[y % size] << 1;
+  for (int x = 0; x < w_; ++x) {
+    assert(tiles[x] <= (uint32_t)max_tile_);
+    uint8_t* tile = row + (x / size) * chunk_bytes_ +
+                    (TileMap::Z_SPREAD[x % size] | z_y) * tile_bytes_;
+    if (tile_bytes_ == 1) {
+      *tile = tiles[x];
+    } else {
+      uint16_t wide = tiles[x];
+      memcpy(tile, &wide, 2);
+    }
+  }
+}
+
+void PackedChunkSource::Finish() {
+  chunk_tiles_.assign(uniform_.size(), 0);
+  size_t kept = 0;
+  for (size_t i = 0; i < uniform_.size(); ++i) {
+    const uint8_t* chunk = &tiles_[i * chunk_bytes_];
+    // Every tile matches the one after it only if they are all the same.
+    if (memcmp(chunk, chunk + tile_bytes_, chunk_bytes_ - tile_bytes_) != 0) {
+      uniform_[i] = -1;
+      chunk_tiles_[i] = kept;
+      memmove(&tiles_[kept], chunk, chunk_bytes_);
+      kept += chunk_bytes_;
+    } else if (tile_bytes_ == 1) {
+      uniform_[i] = chunk[0];
+    } else {
+      uint16_t tile;
+      memcpy(&tile, chunk, 2);
+      uniform_[i] = tile;
+    }
+  }
+  tiles_.resize(kept);
+  tiles_.shrink_to_fit();
+}
+
+size_t PackedChunkSource::bytes() const {
+  return tiles_.size() +
+         uniform_.size() * (sizeof(int) + sizeof(size_t));
+}
+
+void PackedChunkSource::LoadChunk(int chunk_x, int chunk_y,
+                                  vector<uint16_t>* tiles) const {
+  const uint8_t* packed;
+  uint16_t uniform;
+  MapChunk(chunk_x, chunk_y, &packed, &uniform);
+  tiles->assign(TileMap::CHUNK_SIZE * TileMap::CHUNK_SIZE, uniform);
+  if (!packed) {
+    return;
+  }
+  for (int y = 0; y < TileMap::CHUNK_SIZE; ++y) {
+    for (int x = 0; x < TileMap::CHUNK_SIZE; ++x) {
+      size_t i = TileMap::ZIndex(x, y);
+      uint16_t& tile = (*tiles)[y * TileMap::CHUNK_SIZE + x];
+      if (tile_bytes_ == 1) {
+        tile = packed[i];
+      } else {
+        memcpy(&tile, &packed[2 * i], 2);
+      }
+    }
+  }
+}
+
+bool PackedChunkSource::MapChunk(int chunk_x, int chunk_y,
+                                 const uint8_t** tiles,
+                                 uint16_t* uniform) const {
+  size_t i = (size_t)chunk_y * chunks_w_ + chunk_x;
+  *tiles = uniform_[i] < 0 ? &tiles_[chunk_tiles_[i]] : nullptr;
+  *uniform = uniform_[i] < 0 ? TILE_EMPTY : uniform_[i];
+  return true;
+}
+
+TileMap::TileMap(const Tmx::TileLayer* tile_layer)
+    : TileMap(tile_layer->GetWidth(), tile_layer->GetHeight(),
+              make_shared<MemoryChunkSource>(tile_layer->GetWidth(),
+                                             tile_layer->GetHeight(),
+                                             LayerTiles(tile_layer))) {
+  LoadAll();
+}
+
+TileMap::TileMap(int w, int h, shared_ptr<const ChunkSource> source)
+    : source_(move(source)),
+      w(w),
+      h(h),
+      chunks_w_((w + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      chunks_h_((h + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      tile_bytes_(TileBytes(source_->max_tile())) {
+  ReserveSlots(1, 1);
 }
 
 void TileMap::Print(std::ostream& os) const {
   for (int y = 0; y < h; ++y) {
     for (int x = 0; x < w; ++x) {
-      os << get(x, y) << " ";
+      os << At(x, y) << " ";
     }
     os << endl;
   }
 }
 
-int TileMap::get(int x, int y) const {
-  return tiles[y * w + x];
+void TileMap::ReserveSlots(int slots_w, int slots_h) {
+  slots_w_ = 1;
+  while (slots_w_ < min(slots_w, chunks_w_)) {
+    slots_w_ *= 2;
+  }
+  slots_h_ = 1;
+  while (slots_h_ < min(slots_h, chunks_h_)) {
+    slots_h_ *= 2;
+  }
+  slot_mask_x_ = slots_w_ - 1;
+  slot_mask_y_ = slots_h_ - 1;
+  for (Chunk& chunk : slots_) {
+    if (chunk.edited) {
+      edited_[chunk.y * chunks_w_ + chunk.x] = move(chunk);
+    }
+  }
+  slots_.clear();
+  slots_.resize(slots_w_ * slots_h_);
+  resident_chunks_ = 0;
+}
+
+bool TileMap::IsResident(int chunk_x, int chunk_y) const {
+  const Chunk& chunk = slots_[(chunk_y & slot_mask_y_) * slots_w_ +
+                              (chunk_x & slot_mask_x_)];
+  return chunk.x == chunk_x && chunk.y == chunk_y;
+}
+
+void TileMap::LoadAll() {
+  ReserveSlots(chunks_w_, chunks_h_);
+  vector<uint16_t> tiles;
+  Chunk chunk;
+  for (int y = 0; y < chunks_h_; ++y) {
+    for (int x = 0; x < chunks_w_; ++x) {
+      chunk.x = x;
+      chunk.y = y;
+      FetchChunk(*source_, tile_bytes_, &tiles, &chunk);
+      InstallChunk(&chunk);
+    }
+  }
+}
+
+void TileMap::FetchChunk(const ChunkSource& source, int tile_bytes,
+                         vector<uint16_t>* scratch, Chunk* chunk) {
+  if (source.MapChunk(chunk->x, chunk->y, &chunk->tiles, &chunk->uniform)) {
+    return;
+  }
+  source.LoadChunk(chunk->x, chunk->y, scratch);
+  PackChunk(*scratch, tile_bytes, chunk);
 }
 
-void TileMap::set(int x, int y, int tile) {
-  tiles[y * w + x] = tile;
+void TileMap::PackChunk(const vector<uint16_t>& tiles, int tile_bytes,
+                        Chunk* chunk) {
+  assert(tiles.size() == CHUNK_SIZE * CHUNK_SIZE);
+  if (all_of(tiles.begin(), tiles.end(),
+             [&tiles](uint16_t tile) { return tile == tiles[0]; })) {
+    chunk->uniform = tiles[0];
+    chunk->tiles = nullptr;
+    return;
+  }
+  chunk->storage.resize(tiles.size() * tile_bytes);
+  for (int y = 0; y < CHUNK_SIZE; ++y) {
+    for (int x = 0; x < CHUNK_SIZE; ++x) {
+      uint16_t tile = tiles[y * CHUNK_SIZE + x];
+      size_t i = ZIndex(x, y);
+      if (tile_bytes == 1) {
+        chunk->storage[i] = tile;
+      } else {
+        memcpy(&chunk->storage[2 * i], &tile, 2);
+      }
+    }
+  }
+  chunk->tiles = chunk->storage.data();
+}
+
+void TileMap::InstallChunk(Chunk* chunk) {
+  if (!edited_.empty()) {
+    auto edited = edited_.find(chunk->y * chunks_w_ + chunk->x);
+    if (edited != edited_.end()) {
+      swap(*chunk, edited->second);
+      edited_.erase(edited);
+    }
+  }
+  Chunk& slot = SlotOf(chunk->x, chunk->y);
+  if (slot.x < 0) {
+    ++resident_chunks_;
+  }
+  swap(slot, *chunk);
+  if (chunk->edited) {
+    edited_[chunk->y * chunks_w_ + chunk->x] = move(*chunk);
+    *chunk = Chunk();
+  }
+}
+
+size_t TileMap::resident_bytes() const {
+  size_t bytes = 0;
+  for (const Chunk& chunk : slots_) {
+    if (chunk.tiles && chunk.tiles == chunk.storage.data()) {
+      bytes += chunk.storage.size();
+    }
+  }
+  for (const auto& chunk : edited_) {
+    bytes += chunk.second.storage.size();
+  }
+  return bytes;
+}
+
+bool TileMap::Set(int x, int y, TileType tile) {
+  if (x < 0 || y < 0 || x >= w || y >= h || tile < 0 ||
+      tile >= 1 << (8 * tile_bytes_)) {
+    return false;
+  }
+  int chunk_x = x / CHUNK_SIZE;
+  int chunk_y = y / CHUNK_SIZE;
+  Chunk& chunk = SlotOf(chunk_x, chunk_y);
+  if (chunk.x != chunk_x || chunk.y != chunk_y) {
+    return false;
+  }
+  if (At(x, y) == tile) {
+    return true;
+  }
+  MakeWritable(&chunk);
+  chunk.edited = true;
+  size_t i = ZIndex(x % CHUNK_SIZE, y % CHUNK_SIZE);
+  if (tile_bytes_ == 1) {
+    chunk.storage[i] = tile;
+  } else {
+    uint16_t wide = tile;
+    memcpy(&chunk.storage[2 * i], &wide, 2);
+  }
+
+  auto dirty = dirty_.emplace(chunk_y * chunks_w_ + chunk_x,
+                              TileRect{x, y, 1, 1});
+  if (!dirty.second) {
+    TileRect& rect = dirty.first->second;
+    int x1 = max(rect.x + rect.w, x + 1);
+    int y1 = max(rect.y + rect.h, y + 1);
+    rect.x = min(rect.x, x);
+    rect.y = min(rect.y, y);
+    rect.w = x1 - rect.x;
+    rect.h = y1 - rect.y;
+  }
+  return true;
+}
+
+void TileMap::TakeDirty(vector<TileRect>* rects) {
+  rects->clear();
+  for (const auto& dirty : dirty_) {
+    rects->push_back(dirty.second);
+  }
+  dirty_.clear();
+  // An edit across chunk borders, e.g. a crater, goes up in one piece.
+  MergeAlongX(rects);
+  Transpose(rects);
+  MergeAlongX(rects);
+  Transpose(rects);
+}
+
+void TileMap::MakeWritable(Chunk* chunk) const {
+  if (chunk->tiles && chunk->tiles == chunk->storage.data()) {
+    return;
+  }
+  size_t size = CHUNK_SIZE * CHUNK_SIZE * tile_bytes_;
+  if (chunk->tiles) {
+    chunk->storage.assign(chunk->tiles, chunk->tiles + size);
+  } else if (tile_bytes_ == 1) {
+    chunk->storage.assign(size, (uint8_t)chunk->uniform);
+  } else {
+    chunk->storage.resize(size);
+    for (size_t i = 0; i < size; i += 2) {
+      memcpy(&chunk->storage[i], &chunk->uniform, 2);
+    }
+  }
+  chunk->tiles = chunk->storage.data();
 }
 
 int Map::LoadTmx(const std::string& filename) {
-  map_.reset(new Tmx::Map());
-  map_->ParseFile(filename);
+  {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    std::string text(file ? (size_t)file.tellg() : 0, '\0');
+    file.seekg(0);
+    file.read(&text[0], text.size());
+    TmxLevel level;
+    if (file && ScanTmx(text, &level)) {
+      LoadScannedTmx(&level);
+      return 0;
+    }
+  }
+  std::cout << "Falling back to tmxparser for " << filename << std::endl;
+
+  // Only needed while loading; everything kept is copied out of it.
+  unique_ptr<Tmx::Map> map(new Tmx::Map());
+  map->ParseFile(filename);
 
-  if (map_->HasError()) {
-    std::cout << "Error code: " << map_->GetErrorCode() << std::endl;
-    std::cout << "Error text: " << map_->GetErrorText() << std::endl;
+  if (map->HasError()) {
+    std::cout << "Error code: " << map->GetErrorCode() << std::endl;
+    std::cout << "Error text: " << map->GetErrorText() << std::endl;
     
-    return map_->GetErrorCode();
+    return map->GetErrorCode();
+  }
+
+  for (const auto& property : map->GetProperties().GetList()) {
+    properties_[property.first] = PropertyValue(property.second);
   }
 
-  for (int i = 0; i < map_->GetNumTileLayers(); ++i) {
-    const Tmx::TileLayer* tile_layer = map_->GetTileLayer(i);
+  for (int i = 0; i < map->GetNumTileLayers(); ++i) {
+    const Tmx::TileLayer* tile_layer = map->GetTileLayer(i);
     std::string layer_name = tile_layer->GetName();
     layers_.emplace(layer_name, TileMap(tile_layer));
     std::cout << "Found layer \"" << layer_name << "\"." << std::endl;
   }
 
-  for (int i = 0; i < map_->GetNumObjectGroups(); ++i) {
-    const Tmx::ObjectGroup* object_group = map_->GetObjectGroup(i);
+  for (int i = 0; i < map->GetNumObjectGroups(); ++i) {
+    const Tmx::ObjectGroup* object_group = map->GetObjectGroup(i);
     for (int j = 0; j < object_group->GetNumObjects(); ++j) {
       const Tmx::Object* object = object_group->GetObject(j);
       MapObject mo;
       mo.name = object->GetName();
-      // Flip the y-axis
-      mo.pos = {
-          (double)object->GetX() / map_->GetTileWidth(),
-          (double)(map_->GetHeight() * map_->GetTileHeight() - object->GetY()) /
-                  map_->GetTileHeight() -
-              1};
+      mo.type = object->GetType();
+      PlaceObject(object->GetX(), object->GetY(), object->GetWidth(),
+                  object->GetHeight(), map->GetHeight(),
+                  map->GetTileWidth(), map->GetTileHeight(), &mo);
+      for (const auto& property : object->GetProperties().GetList()) {
+        mo.properties[property.first] = PropertyValue(property.second);
+      }
       objects_[object->GetId()] = mo;
     }
   }
 
+  IndexObjects();
+  return 0;
+}
+
+void Map::LoadScannedTmx(TmxLevel* level) {
+  properties_ = move(level->properties);
+
+  for (TmxLayer& layer : level->layers) {
+    // The scanner packed the tiles the way TileMap keeps them, so the chunks
+    // just point into them.
+    auto inserted = layers_.emplace(
+        layer.name, TileMap(layer.w, layer.h, move(layer.tiles)));
+    inserted.first->second.LoadAll();
+    std::cout << "Found layer \"" << layer.name << "\"." << std::endl;
+  }
+
+  for (TmxObject& object : level->objects) {
+    MapObject mo;
+    mo.name = move(object.name);
+    mo.type = move(object.type);
+    PlaceObject(object.x, object.y, object.w, object.h, level->h,
+                level->tile_w, level->tile_h, &mo);
+    mo.properties = move(object.properties);
+    objects_[object.id] = move(mo);
+  }
+
+  IndexObjects();
+}
+
+int Map::LoadLevel(const std::string& filename) {
+  shared_ptr<const LevelFile> file = LevelFile::Open(filename);
+  if (!file) {
+    std::cout << "Couldn't load level " << filename << std::endl;
+    return -1;
+  }
+  const LevelHeader& header = file->header();
+  const LevelProperty* properties = file->properties();
+
+  for (uint32_t i = 0; i < header.num_map_properties; ++i) {
+    properties_[file->String(properties[i].name)] =
+        file->String(properties[i].value);
+  }
+
+  for (uint32_t i = 0; i < header.num_layers; ++i) {
+    const LevelLayer& layer = file->layers()[i];
+    auto inserted = layers_.emplace(
+        file->String(layer.name),
+        TileMap(layer.w, layer.h,
+                make_shared<LevelChunkSource>(file, &layer)));
+    TileMap& tile_map = inserted.first->second;
+    if (tile_map.chunks_w() * tile_map.chunks_h() <= MAX_LOADED_CHUNKS) {
+      tile_map.LoadAll();
+    }
+  }
+
+  for (uint32_t i = 0; i < header.num_objects; ++i) {
+    const LevelObject& object = file->objects()[i];
+    MapObject mo;
+    mo.name = file->String(object.name);
+    mo.type = file->String(object.type);
+    mo.pos = {object.pos[0], object.pos[1]};
+    mo.bounds = {{object.bounds[0], object.bounds[1]},
+                 object.bounds[2],
+                 object.bounds[3]};
+    for (uint32_t j = 0; j < object.num_properties; ++j) {
+      const LevelProperty& property =
+          properties[object.first_property + j];
+      mo.properties[file->String(property.name)] =
+          file->String(property.value);
+    }
+    objects_[object.id] = mo;
+  }
+
+  IndexObjects();
   return 0;
 }
 
+void Map::IndexObjects() {
+  for (const auto& object : objects_) {
+    // objects_ is ordered by id, so the first object with a name wins.
+    named_objects_.emplace(object.second.name, object.first);
+  }
+}
+
 const TileMap* Map::GetLayer(const std::string& layer_name) const {
   const auto layer = layers_.find(layer_name);
   if (layer == layers_.end()) {
@@ -89,11 +615,26 @@ const TileMap* Map::GetLayer(const std::string& layer_name) const {
   return &layer->second;
 }
 
+TileMap* Map::GetLayer(const std::string& layer_name) {
+  const auto layer = layers_.find(layer_name);
+  if (layer == layers_.end()) {
+    return nullptr;
+  }
+  return &layer->second;
+}
+
 const MapObject* Map::GetNamedObject(const std::string& object_name) const {
-  for (const auto& object : objects_) {
-    if (object.second.name == object_name) {
-      return &object.second;
-    }
+  const auto id = named_objects_.find(object_name);
+  if (id == named_objects_.end()) {
+    return nullptr;
+  }
+  return &objects_.at(id->second);
+}
+
+std::string Map::GetProperty(const std::string& name) const {
+  const auto property = properties_.find(name);
+  if (property == properties_.end()) {
+    return "";
   }
-  return nullptr;
+  return property->second;
 }
@@ -1,9 +1,13 @@
 #ifndef TILEMAP_H
 #define TILEMAP_H
 
+#include <cstdint>
+#include <cstring>
 #include <map>
 #include <memory>
 #include <ostream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "tmxparser/Tmx.h"
@@ -21,39 +25,284 @@ enum TileType {
   TILE_SLOPE_50 = 7,  // ,_
 };
 
+bool IsSlope(TileType tile_type);
+// Height of a slope's surface above the bottom of its tile, at @tilespace_x
+// in [0, 1] across the tile.
+double HeightAtX(double tilespace_x, int tile_type);
+
+// Integer tile coordinates, 0,0 is lower left.
+struct TilePos {
+  int x, y;
+};
+
+// A rectangle of tiles, from x, y up to but not including x + w, y + h.
+struct TileRect {
+  int x, y, w, h;
+};
+
+// Where a TileMap's chunks come from. Chunks are CHUNK_SIZE tiles square and
+// numbered from the lower left of the map.
+class ChunkSource {
+ public:
+  virtual ~ChunkSource() {}
+  // Fills @tiles with chunk @chunk_x, @chunk_y, row by row from its lower
+  // left. Tiles past the edge of the map are TILE_EMPTY. Called from the
+  // streaming thread, so it must be safe to call concurrently with anything
+  // the game does.
+  virtual void LoadChunk(int chunk_x, int chunk_y,
+                         std::vector<uint16_t>* tiles) const = 0;
+  // The highest tile id in the layer, which decides how TileMap stores it.
+  virtual int max_tile() const = 0;
+  // Memory the layer takes in the source, including what resident chunks
+  // point into.
+  virtual size_t bytes() const = 0;
+  // For sources that already hold chunks in TileMap's layout: points @tiles
+  // at chunk @chunk_x, @chunk_y, or at null if every tile is *@uniform, and
+  // returns true. Returns false if the chunk has to be loaded instead.
+  virtual bool MapChunk(int chunk_x, int chunk_y, const uint8_t** tiles,
+                        uint16_t* uniform) const {
+    return false;
+  }
+};
+
+// A whole layer kept in memory. Chunks are run length encoded where that is
+// smaller.
+class MemoryChunkSource : public ChunkSource {
+ public:
+  // @tiles is row by row from the lower left.
+  MemoryChunkSource(int w, int h, const std::vector<int>& tiles);
+  void LoadChunk(int chunk_x, int chunk_y,
+                 std::vector<uint16_t>* tiles) const override;
+  int max_tile() const override { return max_tile_; }
+  size_t bytes() const override;
+
+ private:
+  struct Run {
+    uint16_t length;
+    uint16_t tile;
+  };
+
+  int chunks_w_;
+  int max_tile_ = 0;
+  // Chunk i is runs_[chunk_runs_[i], chunk_runs_[i + 1]), or if that's empty
+  // it is stored raw at raw_[chunk_raw_[i]].
+  std::vector<uint32_t> chunk_runs_;
+  std::vector<uint32_t> chunk_raw_;
+  std::vector<Run> runs_;
+  std::vector<uint16_t> raw_;
+};
+
+// A whole layer kept in memory in TileMap's layout, so resident chunks point
+// straight into it rather than holding copies. Filled a row at a time, e.g.
+// as a level is decoded.
+class PackedChunkSource : public ChunkSource {
+ public:
+  // Every tile starts out TILE_EMPTY. @max_tile decides how tiles are stored,
+  // so no tile may be higher.
+  PackedChunkSource(int w, int h, int max_tile);
+  // Sets row @y, counted from the bottom, to the w tiles at @tiles.
+  void SetRow(int y, const uint32_t* tiles);
+  // Call once every row is set, before the layer is used. Drops the tiles of
+  // chunks that only have the one.
+  void Finish();
+  void LoadChunk(int chunk_x, int chunk_y,
+                 std::vector<uint16_t>* tiles) const override;
+  int max_tile() const override { return max_tile_; }
+  size_t bytes() const override;
+  bool MapChunk(int chunk_x, int chunk_y, const uint8_t** tiles,
+                uint16_t* uniform) const override;
+
+ private:
+  int w_;
+  int chunks_w_;
+  int max_tile_;
+  int tile_bytes_;
+  size_t chunk_bytes_;
+  // Chunk i's tiles start at tiles_[i * chunk_bytes_] until Finish(), then
+  // at tiles_[chunk_tiles_[i]].
+  std::vector<uint8_t> tiles_;
+  std::vector<size_t> chunk_tiles_;
+  // Chunk i's tile if it only has the one, otherwise -1. Set by Finish().
+  std::vector<int> uniform_;
+};
+
+// A tile layer split into chunks. Only a window of chunks is resident at a
+// time: chunk x, y lives in slot (x % slots_w, y % slots_h), so the window
+// slides over the map without moving anything already loaded. Chunks outside
+// the window read as TILE_EMPTY. Loading and evicting is up to whoever owns
+// the map, see ChunkStreamer.
+//
+// Tiles take one byte each, or two if the layer has ids past 255. Within a
+// chunk they are in Z-order, so the tiles around a point share cache lines
+// rather than being a row apart. Chunks of a single tile store nothing but
+// that tile.
 class TileMap {
  public:
+  static const int CHUNK_SIZE = 32;
+
+  // Move only, since tiles may point into storage.
+  struct Chunk {
+    Chunk() = default;
+    Chunk(Chunk&&) = default;
+    Chunk& operator=(Chunk&&) = default;
+
+    // Which chunk this is, or -1, -1.
+    int x = -1, y = -1;
+    // tile_bytes() per tile in Z-order, or null if every tile is uniform.
+    const uint8_t* tiles = nullptr;
+    uint16_t uniform = TILE_EMPTY;
+    // Holds tiles, unless they point into the ChunkSource.
+    std::vector<uint8_t> storage;
+    // Set once a tile has been changed with Set(), after which the chunk is
+    // never thrown away, since the source doesn't have the change.
+    bool edited = false;
+  };
+
+  // Loads the whole layer and keeps all of it resident.
   explicit TileMap(const Tmx::TileLayer* tile_layer);
+  // Nothing is resident until chunks are installed.
+  TileMap(int w, int h, std::shared_ptr<const ChunkSource> source);
+
   // 0,0 is lower left
-  TileType At(int x, int y) const;
+  TileType At(int x, int y) const {
+    if (x < 0 || y < 0 || x >= w || y >= h) {
+      return TileType::TILE_EMPTY;
+    }
+    const Chunk& chunk = slots_[((y / CHUNK_SIZE) & slot_mask_y_) * slots_w_ +
+                                ((x / CHUNK_SIZE) & slot_mask_x_)];
+    if (chunk.x != x / CHUNK_SIZE || chunk.y != y / CHUNK_SIZE) {
+      return TileType::TILE_EMPTY;
+    }
+    if (!chunk.tiles) {
+      return (TileType)chunk.uniform;
+    }
+    size_t i = ZIndex(x % CHUNK_SIZE, y % CHUNK_SIZE);
+    if (tile_bytes_ == 1) {
+      return (TileType)chunk.tiles[i];
+    }
+    uint16_t tile;
+    memcpy(&tile, &chunk.tiles[2 * i], 2);
+    return (TileType)tile;
+  }
   void Print(std::ostream &os) const;
 
   int GetWidth() const { return w; }
   int GetHeight() const { return h; }
+  int chunks_w() const { return chunks_w_; }
+  int chunks_h() const { return chunks_h_; }
+  int tile_bytes() const { return tile_bytes_; }
+  const std::shared_ptr<const ChunkSource>& source() const { return source_; }
+
+  // Makes room for at least @slots_w by @slots_h chunks, evicting everything
+  // resident. Rounded up to powers of two; never more than the map needs.
+  void ReserveSlots(int slots_w, int slots_h);
+  bool IsResident(int chunk_x, int chunk_y) const;
+  // Bytes per tile for a layer whose highest tile id is @max_tile.
+  static int TileBytes(int max_tile) { return max_tile > 0xff ? 2 : 1; }
+  // Makes every chunk resident, e.g. for maps small enough not to stream.
+  void LoadAll();
+  // Fills @chunk, whose x and y are set, from @source for a map with
+  // @tile_bytes per tile. Points straight at the source's tiles if it can,
+  // otherwise unpacks into @scratch and packs into the chunk's storage.
+  // Thread safe, so chunks can be fetched off the main thread.
+  static void FetchChunk(const ChunkSource& source, int tile_bytes,
+                         std::vector<uint16_t>* scratch, Chunk* chunk);
+  // Swaps @chunk into its slot. What was there before, if anything, is
+  // evicted and left in @chunk. Edited chunks are kept aside instead, and
+  // installed again in place of @chunk when it is loaded from the source. Not
+  // thread safe: nothing may be reading the map meanwhile.
+  void InstallChunk(Chunk* chunk);
+  int resident_chunks() const { return resident_chunks_; }
+  // Bytes of tiles held by resident and edited chunks, not counting tiles
+  // that point into the ChunkSource; see ChunkSource::bytes() for those.
+  size_t resident_bytes() const;
+
+  // Changes tile @x, @y to @tile. Returns false, changing nothing, if the
+  // tile is off the map, its chunk isn't resident or @tile doesn't fit in
+  // tile_bytes(). O(1), bar copying the chunk the first time it is edited.
+  bool Set(int x, int y, TileType tile);
+  // Moves the areas changed by Set() since the last call into @rects,
+  // coalesced into a few rectangles. Call once a frame, before anything can
+  // evict chunks, since the tiles of chunks that aren't resident read as
+  // TILE_EMPTY.
+  void TakeDirty(std::vector<TileRect>* rects);
+
+  // Packs row major @tiles into @chunk.
+  static void PackChunk(const std::vector<uint16_t>& tiles, int tile_bytes,
+                        Chunk* chunk);
+  // Position of @x, @y within a chunk in Z-order: the bits of x and y
+  // interleaved.
+  static size_t ZIndex(int x, int y) {
+    return Z_SPREAD[x] | Z_SPREAD[y] << 1;
+  }
+  // The bits of each coordinate spread out to every other bit.
+  static const uint16_t Z_SPREAD[CHUNK_SIZE];
 
  private:
-  int get(int x, int y) const;
-  void set(int x, int y, int tile);
-  std::vector<int> tiles;
+  Chunk& SlotOf(int chunk_x, int chunk_y) {
+    return slots_[(chunk_y & slot_mask_y_) * slots_w_ +
+                  (chunk_x & slot_mask_x_)];
+  }
+  // Gives @chunk storage of its own, so its tiles can be changed.
+  void MakeWritable(Chunk* chunk) const;
+
+  std::shared_ptr<const ChunkSource> source_;
   int w, h;
+  int chunks_w_, chunks_h_;
+  int tile_bytes_;
+  std::vector<Chunk> slots_;
+  int slots_w_, slots_h_;
+  int slot_mask_x_, slot_mask_y_;
+  int resident_chunks_ = 0;
+  // Edited chunks that were evicted, by chunk_y * chunks_w_ + chunk_x.
+  std::unordered_map<int, Chunk> edited_;
+  // Bounds of the tiles changed in each chunk since TakeDirty(), by
+  // chunk_y * chunks_w_ + chunk_x.
+  std::unordered_map<int, TileRect> dirty_;
 };
 
+struct TmxLevel;
+
 // Probably want some sort of typing to these.
 struct MapObject {
   std::string name;
-  vec2f pos;
+  // The object's type in Tiled, e.g. "checkpoint".
+  std::string type;
+  vec2d pos;
+  // The object's rectangle, in tiles. Zero sized for point objects.
+  Rect bounds;
+  std::map<std::string, std::string> properties;
 };
 
 class Map {
  public:
   int LoadTmx(const std::string& filename);
+  // Loads a level cooked by tools/cook_level. Layers point straight into the
+  // mapped file; ones too big to make resident are left for a ChunkStreamer.
+  int LoadLevel(const std::string& filename);
   const TileMap* GetLayer(const std::string& layer_name) const;
+  TileMap* GetLayer(const std::string& layer_name);
+  // Layer name -> layer
+  const std::map<std::string, TileMap>& GetLayers() const { return layers_; }
   const MapObject* GetNamedObject(const std::string& object_name) const;
+  // Custom property of the map itself, or "" if it isn't set.
+  std::string GetProperty(const std::string& name) const;
+  const std::map<std::string, std::string>& GetProperties() const {
+    return properties_;
+  }
+  // Object id -> object
+  const std::map<int, MapObject>& GetObjects() const { return objects_; }
  private:
-  std::unique_ptr<Tmx::Map> map_;
+  // Fills the map from the fast path's results, taking what it can.
+  void LoadScannedTmx(TmxLevel* level);
+  void IndexObjects();
+
+  std::map<std::string, std::string> properties_;
   // Layer name -> layer
   std::map<std::string, TileMap> layers_;
   std::map<int, MapObject> objects_;
+  // Object name -> id of the first object with that name.
+  std::unordered_map<std::string, int> named_objects_;
 };
 
 #endif
@@ -0,0 +1,149 @@
+#include "TileMapWindow.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+const int CHUNK_SIZE = TileMap::CHUNK_SIZE;
+
+int PowerOfTwoAtLeast(int n) {
+  int power = 1;
+  while (power < n) {
+    power *= 2;
+  }
+  return power;
+}
+
+// Chunk holding tile @tile, rounding down for negative tiles too.
+int ChunkOf(int tile) {
+  return (int)floor((double)tile / CHUNK_SIZE);
+}
+}  // namespace
+
+TileMapWindow::TileMapWindow(TextureManager* texture_manager,
+                             const TileMap* tile_map, int view_w, int view_h)
+    : texture_manager_(texture_manager),
+      tile_map_(tile_map),
+      // A view can straddle one more chunk than it spans.
+      w_(PowerOfTwoAtLeast((ChunkOf(view_w - 1) + 2) * CHUNK_SIZE)),
+      h_(PowerOfTwoAtLeast((ChunkOf(view_h - 1) + 2) * CHUNK_SIZE)) {
+  texture_ = texture_manager_->CreateTilemapTexture(w_, h_);
+}
+
+TileMapWindow::~TileMapWindow() {
+  texture_manager_->UnloadTexture(texture_);
+}
+
+void TileMapWindow::Update(const Camera& camera) {
+  vec2d lower_left = camera.center() - camera.half_size();
+  int x = ChunkOf((int)floor(lower_left.x)) * CHUNK_SIZE;
+  int y = ChunkOf((int)floor(lower_left.y)) * CHUNK_SIZE;
+  int old_x = x_;
+  int old_y = y_;
+  x_ = x;
+  y_ = y;
+  if (!filled_ || abs(x - old_x) >= w_ || abs(y - old_y) >= h_) {
+    filled_ = true;
+    missing_.clear();
+    Queue({x, y, w_, h_});
+  } else if (x != old_x || y != old_y) {
+    // Columns newly covered, all the way up the window...
+    if (x > old_x) {
+      Queue({old_x + w_, y, x - old_x, h_});
+    } else if (x < old_x) {
+      Queue({x, y, old_x - x, h_});
+    }
+    // ...then rows newly covered, across the columns covered before.
+    int x0 = max(x, old_x);
+    int x1 = min(x, old_x) + w_;
+    if (y > old_y) {
+      Queue({x0, old_y + h_, x1 - x0, y - old_y});
+    } else if (y < old_y) {
+      Queue({x0, y, x1 - x0, old_y - y});
+    }
+  }
+
+  for (size_t i = 0; i < missing_.size();) {
+    TilePos chunk = missing_[i];
+    TileRect rect = {chunk.x * CHUNK_SIZE, chunk.y * CHUNK_SIZE, CHUNK_SIZE,
+                     CHUNK_SIZE};
+    bool covered = rect.x >= x_ && rect.x < x_ + w_ && rect.y >= y_ &&
+                   rect.y < y_ + h_;
+    if (covered && !tile_map_->IsResident(chunk.x, chunk.y)) {
+      ++i;
+      continue;
+    }
+    missing_[i] = missing_.back();
+    missing_.pop_back();
+    if (covered) {
+      Queue(rect);
+    }
+  }
+}
+
+void TileMapWindow::Refresh(const TileRect& rect) {
+  if (filled_) {
+    Queue(rect);
+  }
+}
+
+void TileMapWindow::TakeUploads(TileUploads* uploads) {
+  uploads->clear();
+  // Hand over the tiles and keep @uploads' old space for the next ones.
+  swap(*uploads, queued_);
+}
+
+void TileMapWindow::Upload(const TileUploads& uploads) const {
+  const GLubyte* tiles = uploads.tiles.data();
+  for (const TileRect& rect : uploads.rects) {
+    texture_manager_->UpdateTilemapTexture(texture_, rect.x, rect.y, rect.w,
+                                           rect.h, tiles);
+    tiles += rect.w * rect.h;
+  }
+}
+
+void TileMapWindow::Queue(const TileRect& rect) {
+  int x0 = max(rect.x, x_);
+  int y0 = max(rect.y, y_);
+  int x1 = min(rect.x + rect.w, x_ + w_);
+  int y1 = min(rect.y + rect.h, y_ + h_);
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  for (int chunk_y = max(ChunkOf(y0), 0);
+       chunk_y <= min(ChunkOf(y1 - 1), tile_map_->chunks_h() - 1); ++chunk_y) {
+    for (int chunk_x = max(ChunkOf(x0), 0);
+         chunk_x <= min(ChunkOf(x1 - 1), tile_map_->chunks_w() - 1);
+         ++chunk_x) {
+      if (!tile_map_->IsResident(chunk_x, chunk_y) &&
+          none_of(missing_.begin(), missing_.end(),
+                  [chunk_x, chunk_y](const TilePos& chunk) {
+                    return chunk.x == chunk_x && chunk.y == chunk_y;
+                  })) {
+        missing_.push_back({chunk_x, chunk_y});
+      }
+    }
+  }
+
+  // Split where the texture wraps around. w_ and h_ are powers of two, so
+  // masking finds the texel even for negative tiles.
+  int rows;
+  for (int y = y0; y < y1; y += rows) {
+    int texel_y = y & (h_ - 1);
+    rows = min(y1 - y, h_ - texel_y);
+    int columns;
+    for (int x = x0; x < x1; x += columns) {
+      int texel_x = x & (w_ - 1);
+      columns = min(x1 - x, w_ - texel_x);
+      queued_.rects.push_back({texel_x, texel_y, columns, rows});
+      for (int tile_y = y; tile_y < y + rows; ++tile_y) {
+        for (int tile_x = x; tile_x < x + columns; ++tile_x) {
+          queued_.tiles.push_back((GLubyte)tile_map_->At(tile_x, tile_y));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,76 @@
+// The part of a TileMap around the camera, as a texture for MapProgram.
+#ifndef TILEMAPWINDOW_H
+#define TILEMAPWINDOW_H
+
+#include <vector>
+
+#include "Camera.h"
+#include "TextureManager.h"
+#include "TileMap.h"
+
+// Tiles to copy into a TileMapWindow's texture.
+struct TileUploads {
+  // In texels, none crossing the edge of the texture.
+  std::vector<TileRect> rects;
+  // The tiles of each rect in turn, row by row from the lower left.
+  std::vector<GLubyte> tiles;
+
+  void clear() {
+    rects.clear();
+    tiles.clear();
+  }
+};
+
+// A fixed size tilemap texture over a window of a TileMap that follows the
+// camera a chunk at a time. Tile x, y is kept at texel (x mod w, y mod h),
+// which tile_fragment.glsl undoes, so when the window moves only the rows and
+// columns it newly covers are uploaded. A level of any size takes the same
+// VRAM.
+class TileMapWindow {
+ public:
+  // Covers views up to @view_w by @view_h tiles of @tile_map, which must
+  // outlive this object.
+  TileMapWindow(TextureManager* texture_manager, const TileMap* tile_map,
+                int view_w, int view_h);
+  ~TileMapWindow();
+
+  // Moves the window over @camera and queues uploads of what it newly
+  // covers, along with chunks that have become resident since they were
+  // uploaded. Call once a frame, before drawing.
+  void Update(const Camera& camera);
+  // Queues @rect to be uploaded again if the window covers any of it, e.g.
+  // the areas from TileMap::TakeDirty().
+  void Refresh(const TileRect& rect);
+
+  // Moves the uploads queued so far into @uploads, replacing what it held.
+  // Together with Update() and Refresh(), this only touches the TileMap, so
+  // it belongs on the thread that changes it.
+  void TakeUploads(TileUploads* uploads);
+  // Copies @uploads into the texture, in the order they were queued. Needs
+  // the GL context.
+  void Upload(const TileUploads& uploads) const;
+
+  TextureRef texture() const { return texture_; }
+  // Size of the texture, in tiles. Powers of two.
+  int w() const { return w_; }
+  int h() const { return h_; }
+
+ private:
+  // Queues the part of @rect that the window covers, wrapping around the
+  // edges of the texture.
+  void Queue(const TileRect& rect);
+
+  TextureManager* texture_manager_;
+  const TileMap* tile_map_;
+  TextureRef texture_;
+  int w_, h_;
+  // Lower left tile of the window, a multiple of TileMap::CHUNK_SIZE.
+  int x_ = 0, y_ = 0;
+  bool filled_ = false;
+  // Chunks in the window that weren't resident when uploaded, and so went
+  // up as TILE_EMPTY.
+  std::vector<TilePos> missing_;
+  TileUploads queued_;
+};
+
+#endif  // TILEMAPWINDOW_H
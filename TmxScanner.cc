@@ -0,0 +1,587 @@
+#include "TmxScanner.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "TileMap.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TMX_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#ifdef USE_MINIZ
+#define MINIZ_HEADER_FILE_ONLY
+#include "miniz.c"
+#else
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+namespace {
+// Tiled keeps flip and rotation flags in the top bits of a gid.
+const uint32_t GID_MASK = 0x0fffffff;
+// The highest tile id TileMap can hold.
+const uint32_t MAX_TILE = 0xffff;
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+int Sextet(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '+') {
+    return 62;
+  }
+  if (c == '/') {
+    return 63;
+  }
+  return -1;
+}
+
+#ifdef TMX_SSSE3
+// Decodes 16 characters at a time into 12 bytes, stopping at the first block
+// with anything but base64 characters in it (whitespace, padding) for the
+// scalar decoder to pick up. Writes 16 bytes per block, so stops with at
+// least that much room left. Returns the number of characters consumed. See
+// Wojciech Muła's "Base64 decoding with SIMD instructions".
+__attribute__((target("ssse3"))) size_t DecodeBase64Ssse3(const char* in,
+                                                          size_t size,
+                                                          uint8_t* out,
+                                                          size_t capacity) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                       0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+                                       0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                       0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                       0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+                                         0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                     -1, -1, -1, -1);
+  size_t read = 0;
+  size_t written = 0;
+  while (size - read >= 16 && capacity - written >= 16) {
+    __m128i chars =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + read));
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+    __m128i lo_nibbles = _mm_and_si128(chars, mask_2f);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                         _mm_setzero_si128()))) {
+      break;
+    }
+    __m128i eq_2f = _mm_cmpeq_epi8(chars, mask_2f);
+    __m128i roll =
+        _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    __m128i sextets = _mm_add_epi8(chars, roll);
+    // Join pairs of sextets, then pairs of those, into 24 bits per lane.
+    __m128i merged =
+        _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written),
+                     _mm_shuffle_epi8(merged, pack));
+    read += 16;
+    written += 12;
+  }
+  return read;
+}
+
+bool HasSsse3() {
+  static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+  return has_ssse3;
+}
+#endif
+
+// Decodes XML's predefined entities in [@begin, @end) into @out.
+void Unescape(const char* begin, const char* end, string* out) {
+  out->clear();
+  for (const char* p = begin; p < end; ++p) {
+    if (*p != '&') {
+      out->push_back(*p);
+      continue;
+    }
+    static const struct {
+      const char* entity;
+      char c;
+    } ENTITIES[] = {{"&amp;", '&'}, {"&lt;", '<'},  {"&gt;", '>'},
+                    {"&quot;", '"'}, {"&apos;", '\''}};
+    bool found = false;
+    for (const auto& entity : ENTITIES) {
+      size_t size = strlen(entity.entity);
+      if ((size_t)(end - p) >= size && memcmp(p, entity.entity, size) == 0) {
+        out->push_back(entity.c);
+        p += size - 1;
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      out->push_back(*p);
+    }
+  }
+}
+
+// Pulls tags out of XML one at a time. Only as much XML as .tmx files use:
+// no CDATA, DOCTYPE or character references.
+class XmlScanner {
+ public:
+  explicit XmlScanner(const string& text)
+      : p_(text.data()), end_(text.data() + text.size()) {}
+
+  // Moves to the next tag. Returns false at the end or on bad XML.
+  bool Next();
+  bool error() const { return error_; }
+
+  bool Is(const char* name) const {
+    return name_size_ == strlen(name) && memcmp(name_, name, name_size_) == 0;
+  }
+  string name() const { return string(name_, name_size_); }
+  bool closing() const { return closing_; }
+  bool self_closing() const { return self_closing_; }
+  // Text between the previous tag and this one.
+  const char* text() const { return text_; }
+  const char* text_end() const { return text_end_; }
+
+  // Finds attribute @name, leaving its raw value in [*begin, *end).
+  bool Attr(const char* name, const char** begin, const char** end) const;
+  bool Attr(const char* name, string* value) const;
+  string StringAttr(const char* name) const;
+  // Numeric attributes, or @default_value if missing.
+  long long IntAttr(const char* name, long long default_value) const;
+  double DoubleAttr(const char* name, double default_value) const;
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool error_ = false;
+  const char* name_ = nullptr;
+  size_t name_size_ = 0;
+  const char* attrs_ = nullptr;
+  const char* attrs_end_ = nullptr;
+  bool closing_ = false;
+  bool self_closing_ = false;
+  const char* text_ = nullptr;
+  const char* text_end_ = nullptr;
+};
+
+bool XmlScanner::Next() {
+  text_ = p_;
+  while (true) {
+    const char* open =
+        static_cast<const char*>(memchr(p_, '<', end_ - p_));
+    if (!open) {
+      p_ = end_;
+      return false;
+    }
+    text_end_ = open;
+    p_ = open + 1;
+    if (end_ - p_ >= 3 && memcmp(p_, "!--", 3) == 0) {
+      const char* close = search(p_, end_, "-->", "-->" + 3);
+      if (close == end_) {
+        error_ = true;
+        return false;
+      }
+      p_ = close + 3;
+      continue;
+    }
+    if (p_ < end_ && *p_ == '?') {
+      const char* close = search(p_, end_, "?>", "?>" + 2);
+      if (close == end_) {
+        error_ = true;
+        return false;
+      }
+      p_ = close + 2;
+      continue;
+    }
+    break;
+  }
+  if (p_ < end_ && *p_ == '!') {
+    error_ = true;
+    return false;
+  }
+
+  closing_ = p_ < end_ && *p_ == '/';
+  if (closing_) {
+    ++p_;
+  }
+  name_ = p_;
+  while (p_ < end_ && !IsSpace(*p_) && *p_ != '/' && *p_ != '>') {
+    ++p_;
+  }
+  name_size_ = p_ - name_;
+  attrs_ = p_;
+  char quote = 0;
+  while (p_ < end_ && (quote || *p_ != '>')) {
+    if (quote && *p_ == quote) {
+      quote = 0;
+    } else if (!quote && (*p_ == '"' || *p_ == '\'')) {
+      quote = *p_;
+    }
+    ++p_;
+  }
+  if (p_ == end_ || name_size_ == 0) {
+    error_ = true;
+    return false;
+  }
+  self_closing_ = p_[-1] == '/';
+  attrs_end_ = self_closing_ ? p_ - 1 : p_;
+  ++p_;
+  return true;
+}
+
+bool XmlScanner::Attr(const char* name, const char** begin,
+                      const char** end) const {
+  size_t name_size = strlen(name);
+  const char* p = attrs_;
+  while (true) {
+    while (p < attrs_end_ && IsSpace(*p)) {
+      ++p;
+    }
+    const char* attr = p;
+    while (p < attrs_end_ && *p != '=' && !IsSpace(*p)) {
+      ++p;
+    }
+    size_t attr_size = p - attr;
+    while (p < attrs_end_ && (IsSpace(*p) || *p == '=')) {
+      ++p;
+    }
+    if (p >= attrs_end_ || (*p != '"' && *p != '\'')) {
+      return false;
+    }
+    char quote = *p++;
+    const char* value = p;
+    while (p < attrs_end_ && *p != quote) {
+      ++p;
+    }
+    if (p >= attrs_end_) {
+      return false;
+    }
+    if (attr_size == name_size && memcmp(attr, name, name_size) == 0) {
+      *begin = value;
+      *end = p;
+      return true;
+    }
+    ++p;
+  }
+}
+
+bool XmlScanner::Attr(const char* name, string* value) const {
+  const char* begin;
+  const char* end;
+  if (!Attr(name, &begin, &end)) {
+    return false;
+  }
+  Unescape(begin, end, value);
+  return true;
+}
+
+string XmlScanner::StringAttr(const char* name) const {
+  string value;
+  Attr(name, &value);
+  return value;
+}
+
+long long XmlScanner::IntAttr(const char* name,
+                              long long default_value) const {
+  const char* begin;
+  const char* end;
+  if (!Attr(name, &begin, &end) || begin == end) {
+    return default_value;
+  }
+  // Attribute values are followed by their quote, so strtoll stops in time.
+  return strtoll(begin, nullptr, 10);
+}
+
+double XmlScanner::DoubleAttr(const char* name, double default_value) const {
+  const char* begin;
+  const char* end;
+  if (!Attr(name, &begin, &end) || begin == end) {
+    return default_value;
+  }
+  return strtod(begin, nullptr);
+}
+
+// Reads the comma separated gids in [@begin, @end) into @gids.
+bool ParseCsv(const char* begin, const char* end, uint32_t* gids,
+              size_t count) {
+  size_t n = 0;
+  const char* p = begin;
+  while (true) {
+    while (p < end && (IsSpace(*p) || *p == ',')) {
+      ++p;
+    }
+    if (p == end) {
+      break;
+    }
+    if (*p < '0' || *p > '9' || n == count) {
+      return false;
+    }
+    uint32_t gid = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      gid = gid * 10 + (*p++ - '0');
+    }
+    gids[n++] = gid;
+  }
+  return n == count;
+}
+
+// Decodes the base64, maybe zlib compressed, gids in [@begin, @end) into
+// @gids.
+bool DecodeData(const char* begin, const char* end, bool zlib,
+                uint32_t* gids, size_t count) {
+  uint8_t* out = reinterpret_cast<uint8_t*>(gids);
+  size_t size = count * 4;
+  if (!zlib) {
+    if (DecodeBase64(begin, end, out, size) != (ptrdiff_t)size) {
+      return false;
+    }
+  } else {
+    vector<uint8_t> compressed((end - begin) / 4 * 3 + 3);
+    ptrdiff_t compressed_size =
+        DecodeBase64(begin, end, compressed.data(), compressed.size());
+    if (compressed_size < 0) {
+      return false;
+    }
+    uLongf out_size = size;
+    if (uncompress(out, &out_size, compressed.data(), compressed_size) !=
+            Z_OK ||
+        out_size != size) {
+      return false;
+    }
+  }
+  // Gids are little endian.
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t* bytes = out + 4 * i;
+    gids[i] = bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+              (uint32_t)bytes[3] << 24;
+  }
+  return true;
+}
+
+// Turns @gids, @layer's top row first, into tile ids within their tilesets
+// and packs them into the layer's tiles. Returns false if an id is too high
+// for TileMap.
+bool FinishLayer(const vector<uint32_t>& first_gids, vector<uint32_t>* gids,
+                 TmxLayer* layer) {
+  // Tiles mostly come from the same tileset as the one before, so only look
+  // it up when a gid falls outside [first, next). first is 0 below the first
+  // tileset.
+  uint32_t first = 0;
+  uint32_t next = 0;
+  uint32_t max_tile = 0;
+  for (uint32_t& tile : *gids) {
+    uint32_t gid = tile & GID_MASK;
+    if (gid < first || gid >= next) {
+      auto after = upper_bound(first_gids.begin(), first_gids.end(), gid);
+      first = after == first_gids.begin() ? 0 : *(after - 1);
+      next = after == first_gids.end() ? GID_MASK + 1 : *after;
+    }
+    tile = gid == 0 || first == 0 ? 0 : gid - first;
+    max_tile = max(max_tile, tile);
+  }
+  if (max_tile > MAX_TILE) {
+    return false;
+  }
+  layer->tiles =
+      make_shared<PackedChunkSource>(layer->w, layer->h, (int)max_tile);
+  // tmx maps have origins in the upper left, but we want lower left.
+  for (int y = 0; y < layer->h; ++y) {
+    layer->tiles->SetRow(layer->h - 1 - y, &(*gids)[(size_t)y * layer->w]);
+  }
+  layer->tiles->Finish();
+  return true;
+}
+}  // namespace
+
+ptrdiff_t DecodeBase64(const char* begin, const char* end, uint8_t* out,
+                       size_t capacity) {
+  while (begin < end && IsSpace(*begin)) {
+    ++begin;
+  }
+  while (end > begin && IsSpace(end[-1])) {
+    --end;
+  }
+  size_t written = 0;
+#ifdef TMX_SSSE3
+  if (HasSsse3()) {
+    size_t read = DecodeBase64Ssse3(begin, end - begin, out, capacity);
+    begin += read;
+    written = read / 4 * 3;
+  }
+#endif
+
+  uint32_t bits = 0;
+  int num_bits = 0;
+  const char* p = begin;
+  for (; p < end && *p != '='; ++p) {
+    if (IsSpace(*p)) {
+      continue;
+    }
+    int sextet = Sextet(*p);
+    if (sextet < 0) {
+      return -1;
+    }
+    bits = (bits << 6 | sextet) & 0xffffff;
+    num_bits += 6;
+    if (num_bits >= 8) {
+      num_bits -= 8;
+      if (written == capacity) {
+        return -1;
+      }
+      out[written++] = bits >> num_bits;
+    }
+  }
+  for (; p < end; ++p) {
+    if (*p != '=' && !IsSpace(*p)) {
+      return -1;
+    }
+  }
+  return written;
+}
+
+bool ScanTmx(const string& text, TmxLevel* level) {
+  XmlScanner xml(text);
+  // Names of the open elements.
+  vector<string> open;
+  vector<uint32_t> first_gids;
+  TmxObject* object = nullptr;
+  // The layer whose <data> is open, and its gids, top row first.
+  TmxLayer* layer = nullptr;
+  vector<uint32_t> gids;
+  string encoding;
+  bool zlib = false;
+  // Gids read so far from <tile> elements.
+  size_t num_tiles = 0;
+  string name, value;
+
+  while (xml.Next()) {
+    if (xml.closing()) {
+      if (open.empty() || !xml.Is(open.back().c_str())) {
+        return false;
+      }
+      open.pop_back();
+      if (xml.Is("data") && layer) {
+        size_t count = gids.size();
+        bool ok;
+        if (encoding.empty()) {
+          ok = num_tiles == count;
+        } else if (encoding == "csv") {
+          ok = ParseCsv(xml.text(), xml.text_end(), gids.data(), count);
+        } else {
+          ok = DecodeData(xml.text(), xml.text_end(), zlib, gids.data(),
+                          count);
+        }
+        if (!ok || !FinishLayer(first_gids, &gids, layer)) {
+          return false;
+        }
+        layer = nullptr;
+      } else if (xml.Is("object")) {
+        object = nullptr;
+      }
+      continue;
+    }
+
+    if (xml.Is("map")) {
+      if (xml.IntAttr("infinite", 0)) {
+        return false;
+      }
+      level->w = xml.IntAttr("width", 0);
+      level->h = xml.IntAttr("height", 0);
+      level->tile_w = xml.IntAttr("tilewidth", 0);
+      level->tile_h = xml.IntAttr("tileheight", 0);
+    } else if (xml.Is("tileset")) {
+      uint32_t first_gid = xml.IntAttr("firstgid", 1);
+      first_gids.insert(
+          upper_bound(first_gids.begin(), first_gids.end(), first_gid),
+          first_gid);
+    } else if (xml.Is("layer")) {
+      TmxLayer new_layer;
+      new_layer.name = xml.StringAttr("name");
+      new_layer.w = xml.IntAttr("width", 0);
+      new_layer.h = xml.IntAttr("height", 0);
+      if (new_layer.w <= 0 || new_layer.h <= 0) {
+        return false;
+      }
+      level->layers.push_back(move(new_layer));
+    } else if (xml.Is("data")) {
+      if (open.empty() || open.back() != "layer" || xml.self_closing()) {
+        return false;
+      }
+      encoding = xml.StringAttr("encoding");
+      string compression = xml.StringAttr("compression");
+      if ((encoding != "" && encoding != "csv" && encoding != "base64") ||
+          (compression != "" && compression != "zlib")) {
+        return false;
+      }
+      zlib = compression == "zlib";
+      layer = &level->layers.back();
+      // Every encoding decodes straight into gids, which FinishLayer()
+      // packs into the layer's tiles.
+      gids.resize((size_t)layer->w * layer->h);
+      num_tiles = 0;
+    } else if (xml.Is("chunk")) {
+      return false;
+    } else if (xml.Is("tile") && layer) {
+      if (!encoding.empty() || num_tiles == gids.size()) {
+        return false;
+      }
+      gids[num_tiles++] = (uint32_t)xml.IntAttr("gid", 0);
+    } else if (xml.Is("object")) {
+      if (xml.Attr("template", &value)) {
+        return false;
+      }
+      TmxObject new_object;
+      new_object.id = xml.IntAttr("id", 0);
+      new_object.name = xml.StringAttr("name");
+      new_object.type = xml.StringAttr("type");
+      new_object.x = xml.DoubleAttr("x", 0);
+      new_object.y = xml.DoubleAttr("y", 0);
+      new_object.w = xml.DoubleAttr("width", 0);
+      new_object.h = xml.DoubleAttr("height", 0);
+      level->objects.push_back(move(new_object));
+      object = xml.self_closing() ? nullptr : &level->objects.back();
+    } else if (xml.Is("property")) {
+      // Properties of the map and of objects are kept; those of tilesets,
+      // layers and so on aren't.
+      const string* owner =
+          open.size() >= 2 ? &open[open.size() - 2] : nullptr;
+      if (!xml.Attr("name", &name)) {
+        return false;
+      }
+      if (!xml.Attr("value", &value)) {
+        // Multi-line values are kept as text instead.
+        return false;
+      }
+      if (owner && *owner == "map") {
+        level->properties[name] = value;
+      } else if (owner && *owner == "object" && object) {
+        object->properties[name] = value;
+      }
+    }
+
+    if (!xml.self_closing()) {
+      open.push_back(xml.name());
+    }
+  }
+  // Layers without <data> would have no tiles.
+  for (const TmxLayer& scanned : level->layers) {
+    if (!scanned.tiles) {
+      return false;
+    }
+  }
+  return !xml.error() && open.empty() && level->w > 0 && level->h > 0 &&
+         level->tile_w > 0 && level->tile_h > 0;
+}
@@ -0,0 +1,53 @@
+// A fast path for loading .tmx levels. One pass over the XML picks out what
+// Map needs and decodes layer data straight into TileMap's chunk layout,
+// instead of building tmxparser's DOM.
+#ifndef TMXSCANNER_H
+#define TMXSCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class PackedChunkSource;
+
+struct TmxObject {
+  int id;
+  std::string name;
+  std::string type;
+  // In pixels, y down from the top of the map, as Tiled has them.
+  double x, y, w, h;
+  std::map<std::string, std::string> properties;
+};
+
+struct TmxLayer {
+  std::string name;
+  int w, h;
+  // Tile ids within their tilesets, packed for TileMap.
+  std::shared_ptr<PackedChunkSource> tiles;
+};
+
+struct TmxLevel {
+  // In tiles.
+  int w = 0, h = 0;
+  // Pixels per tile.
+  int tile_w = 0, tile_h = 0;
+  std::map<std::string, std::string> properties;
+  std::vector<TmxLayer> layers;
+  std::vector<TmxObject> objects;
+};
+
+// Scans the .tmx in @text into @level. Returns false for anything it doesn't
+// handle, e.g. infinite maps, gzip or zstd compressed layers, object
+// templates and malformed XML, so the caller can fall back on tmxparser.
+bool ScanTmx(const std::string& text, TmxLevel* level);
+
+// Decodes the base64 in [@begin, @end) into @out, skipping whitespace.
+// Returns the number of bytes written, or -1 if the input isn't base64 or
+// wouldn't fit in @capacity bytes.
+ptrdiff_t DecodeBase64(const char* begin, const char* end, uint8_t* out,
+                       size_t capacity);
+
+#endif  // TMXSCANNER_H
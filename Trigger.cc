@@ -0,0 +1,190 @@
+#include "Trigger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace {
+bool OverlapLess(EntityId body, int trigger, EntityId other_body,
+                 int other_trigger) {
+  return body < other_body || (body == other_body && trigger < other_trigger);
+}
+
+bool RectsOverlap(const Rect& a, const Rect& b) {
+  return a.lowerLeft.x < b.lowerLeft.x + b.w &&
+         b.lowerLeft.x < a.lowerLeft.x + a.w &&
+         a.lowerLeft.y < b.lowerLeft.y + b.h &&
+         b.lowerLeft.y < a.lowerLeft.y + a.h;
+}
+}  // namespace
+
+TriggerSystem::TriggerSystem(const Map& map, const CollisionLayers& layers) {
+  for (const auto& object : map.GetObjects()) {
+    const MapObject& mo = object.second;
+    if (mo.type.empty() || mo.bounds.w <= 0 || mo.bounds.h <= 0) {
+      continue;
+    }
+    TriggerVolume trigger;
+    trigger.id = object.first;
+    trigger.name = mo.name;
+    trigger.type = mo.type;
+    trigger.bounds = mo.bounds;
+    trigger.properties = mo.properties;
+    const auto collides = mo.properties.find("collides");
+    if (collides != mo.properties.end()) {
+      trigger.mask = 0;
+      std::stringstream names(collides->second);
+      std::string name;
+      while (std::getline(names, name, ',')) {
+        trigger.mask |= layers.Layer(name);
+      }
+    }
+    triggers_.push_back(trigger);
+  }
+  if (triggers_.empty()) {
+    return;
+  }
+
+  double left = INFINITY, bottom = INFINITY, right = -INFINITY,
+         top = -INFINITY;
+  for (const auto& trigger : triggers_) {
+    left = std::min(left, trigger.bounds.lowerLeft.x);
+    bottom = std::min(bottom, trigger.bounds.lowerLeft.y);
+    right = std::max(right, trigger.bounds.lowerLeft.x + trigger.bounds.w);
+    top = std::max(top, trigger.bounds.lowerLeft.y + trigger.bounds.h);
+  }
+  origin_ = {left, bottom};
+  cells_w_ = (int)floor((right - left) / cell_size_) + 1;
+  cells_h_ = (int)floor((top - bottom) / cell_size_) + 1;
+
+  // Count, then fill, so each cell's triggers are contiguous.
+  std::vector<int> counts(cells_w_ * cells_h_ + 1, 0);
+  for (const auto& trigger : triggers_) {
+    CellRange cells = CellsOf(trigger.bounds);
+    for (int y = cells.y0; y <= cells.y1; ++y) {
+      for (int x = cells.x0; x <= cells.x1; ++x) {
+        ++counts[CellIndex(x, y) + 1];
+      }
+    }
+  }
+  for (size_t i = 1; i < counts.size(); ++i) {
+    counts[i] += counts[i - 1];
+  }
+  cell_starts_ = counts;
+  cell_triggers_.resize(counts.back());
+  for (size_t i = 0; i < triggers_.size(); ++i) {
+    CellRange cells = CellsOf(triggers_[i].bounds);
+    for (int y = cells.y0; y <= cells.y1; ++y) {
+      for (int x = cells.x0; x <= cells.x1; ++x) {
+        cell_triggers_[counts[CellIndex(x, y)]++] = i;
+      }
+    }
+  }
+}
+
+TriggerSystem::CellRange TriggerSystem::CellsOf(const Rect& rect) const {
+  CellRange cells;
+  cells.x0 = std::max(
+      0, (int)floor((rect.lowerLeft.x - origin_.x) / cell_size_));
+  cells.x1 = std::min(
+      cells_w_ - 1,
+      (int)floor((rect.lowerLeft.x + rect.w - origin_.x) / cell_size_));
+  cells.y0 = std::max(
+      0, (int)floor((rect.lowerLeft.y - origin_.y) / cell_size_));
+  cells.y1 = std::min(
+      cells_h_ - 1,
+      (int)floor((rect.lowerLeft.y + rect.h - origin_.y) / cell_size_));
+  return cells;
+}
+
+int TriggerSystem::CellIndex(int cell_x, int cell_y) const {
+  return cell_y * cells_w_ + cell_x;
+}
+
+void TriggerSystem::FindOverlaps(EntityId id, const Body& body,
+                                 std::vector<Overlap>* overlaps) const {
+  const Rect& bbox = body.bbox;
+  const size_t first = overlaps->size();
+  CellRange cells = CellsOf(bbox);
+  for (int y = cells.y0; y <= cells.y1; ++y) {
+    for (int x = cells.x0; x <= cells.x1; ++x) {
+      int cell = CellIndex(x, y);
+      for (int i = cell_starts_[cell]; i < cell_starts_[cell + 1]; ++i) {
+        const TriggerVolume& trigger = triggers_[cell_triggers_[i]];
+        if ((body.layer & trigger.mask) &&
+            RectsOverlap(bbox, trigger.bounds)) {
+          overlaps->push_back({id, cell_triggers_[i]});
+        }
+      }
+    }
+  }
+  // A trigger spanning several of the body's cells is found more than once.
+  std::sort(overlaps->begin() + first, overlaps->end(),
+            [](const Overlap& a, const Overlap& b) {
+              return a.trigger < b.trigger;
+            });
+  overlaps->erase(std::unique(overlaps->begin() + first, overlaps->end(),
+                              [](const Overlap& a, const Overlap& b) {
+                                return a.trigger == b.trigger;
+                              }),
+                  overlaps->end());
+}
+
+std::vector<std::unique_ptr<Event>> TriggerSystem::Update(
+    Seconds, const std::vector<Entity>& entities) {
+  std::vector<std::unique_ptr<Event>> events;
+  if (triggers_.empty()) {
+    return events;
+  }
+
+  // Sleeping bodies can't have moved, so their overlaps carry over.
+  std::vector<Overlap> overlaps;
+  auto last_overlap = overlaps_.begin();
+  for (size_t i = 0; i < entities.size(); ++i) {
+    const Body* body = entities[i].GetComponent<Body>();
+    if (body && body->enabled && body->sleeping) {
+      for (; last_overlap != overlaps_.end() && last_overlap->body < (int)i;
+           ++last_overlap) {
+      }
+      for (; last_overlap != overlaps_.end() && last_overlap->body == (int)i;
+           ++last_overlap) {
+        overlaps.push_back(*last_overlap);
+      }
+    } else if (body && body->enabled) {
+      FindOverlaps(i, *body, &overlaps);
+    }
+  }
+
+  auto add_event = [this, &events](const Overlap& overlap,
+                                   TriggerPhase phase) {
+    std::unique_ptr<TriggerEvent> event(new TriggerEvent());
+    event->body = overlap.body;
+    event->trigger = &triggers_[overlap.trigger];
+    event->phase = phase;
+    events.push_back(std::move(event));
+  };
+  auto last = overlaps_.begin();
+  auto current = overlaps.begin();
+  while (last != overlaps_.end() || current != overlaps.end()) {
+    if (current == overlaps.end() ||
+        (last != overlaps_.end() &&
+         OverlapLess(last->body, last->trigger, current->body,
+                     current->trigger))) {
+      if (last->body < (int)entities.size()) {
+        add_event(*last, TriggerPhase::EXIT);
+      }
+      ++last;
+    } else if (last == overlaps_.end() ||
+               OverlapLess(current->body, current->trigger, last->body,
+                           last->trigger)) {
+      add_event(*current, TriggerPhase::ENTER);
+      ++current;
+    } else {
+      ++last;
+      ++current;
+    }
+  }
+  overlaps_.swap(overlaps);
+
+  return events;
+}
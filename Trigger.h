@@ -0,0 +1,88 @@
+// Trigger volumes: static rectangles from the level that report when bodies
+// enter and leave them, e.g. checkpoints, kill zones and camera zones.
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Entity.h"
+#include "Event.h"
+#include "Geometry.h"
+#include "Physics.h"
+#include "System.h"
+#include "TileMap.h"
+
+struct TriggerVolume {
+  // Object id from the map.
+  int id;
+  std::string name;
+  // The object's type, e.g. "checkpoint" or "kill".
+  std::string type;
+  Rect bounds;
+  // Layers of the bodies this trigger reports.
+  uint32_t mask = ~0u;
+  // Custom properties of the map object.
+  std::map<std::string, std::string> properties;
+};
+
+enum class TriggerPhase { ENTER, EXIT };
+
+class TriggerEvent : public Event {
+ public:
+  EventType type() const override { return EventType::TRIGGER; }
+  EntityId body;
+  // Owned by the TriggerSystem that sent this.
+  const TriggerVolume* trigger;
+  TriggerPhase phase;
+};
+
+// Sends TriggerEvents for bodies entering and leaving trigger volumes. Every
+// map object with a type and a non-zero size is a trigger. A "collides"
+// property limits it to bodies on the listed collision layers.
+//
+// Triggers never move, so they are binned once into a grid, and each body is
+// only tested against the triggers sharing its cells.
+class TriggerSystem : public System {
+ public:
+  TriggerSystem(const Map& map, const CollisionLayers& layers);
+  std::vector<std::unique_ptr<Event>> Update(
+      Seconds dt, const std::vector<Entity>& entities) override;
+
+  const std::vector<TriggerVolume>& triggers() const { return triggers_; }
+
+ private:
+  struct Overlap {
+    EntityId body;
+    int trigger;
+  };
+
+  // Inclusive range of grid cells, clamped to the grid.
+  struct CellRange {
+    int x0, y0, x1, y1;
+  };
+
+  CellRange CellsOf(const Rect& rect) const;
+  int CellIndex(int cell_x, int cell_y) const;
+  void FindOverlaps(EntityId id, const Body& body,
+                    std::vector<Overlap>* overlaps) const;
+
+  std::vector<TriggerVolume> triggers_;
+
+  // Grid covering every trigger. Cell i holds
+  // cell_triggers_[cell_starts_[i], cell_starts_[i + 1]).
+  vec2d origin_ = {0, 0};
+  double cell_size_ = 8;
+  int cells_w_ = 0;
+  int cells_h_ = 0;
+  std::vector<int> cell_starts_;
+  std::vector<int> cell_triggers_;
+
+  // Sorted by (body, trigger).
+  std::vector<Overlap> overlaps_;
+};
+
+#endif  // TRIGGER_H
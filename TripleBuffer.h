@@ -0,0 +1,82 @@
+// Hands values from one thread to another without locks.
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Three slots for passing a value, e.g. a frame's RenderSnapshot, from a
+// producer thread to a consumer thread. The producer fills back() while the
+// consumer reads front(), and the third slot holds the latest published
+// value. Handing a slot over is a single atomic exchange, so neither side
+// ever holds a lock the other could wait on.
+//
+// Every published value is acquired exactly once, in order: Publish() waits
+// while the consumer has yet to take the last one, and Acquire() while there
+// is nothing new. So the producer can get at most one value ahead of the one
+// being consumed. Slots are reused, so a new back() holds an older value,
+// whose space the producer can reuse but must overwrite.
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : middle_(2) {}
+
+  // The producer's slot.
+  T& back() { return slots_[back_]; }
+  // The consumer's slot, holding the value it last acquired.
+  T& front() { return slots_[front_]; }
+
+  // Hands back() to the consumer and gives the producer a new back(). Call
+  // from the producer only. Returns false, without publishing, once Stop()
+  // has been called.
+  bool Publish() {
+    while (middle_.load() & FRESH) {
+      if (!Wait()) {
+        return false;
+      }
+    }
+    // Only the consumer takes FRESH away, so the slot coming back is free.
+    back_ = middle_.exchange(back_ | FRESH);
+    return true;
+  }
+  // Moves the next published value to front(). Call from the consumer only.
+  // Returns false once Stop() has been called.
+  bool Acquire() {
+    while (!(middle_.load() & FRESH)) {
+      if (!Wait()) {
+        return false;
+      }
+    }
+    front_ = middle_.exchange(front_) & ~FRESH;
+    return true;
+  }
+
+  // Makes waiting or later calls to Publish() and Acquire() return false,
+  // e.g. to shut the consumer down.
+  void Stop() { stopped_ = true; }
+
+ private:
+  // Set on the index of the middle slot while it holds a value the consumer
+  // hasn't acquired.
+  static const int FRESH = 4;
+
+  // Sleeps a moment, unless stopped. A side only waits when the other is a
+  // whole value behind, for at most a frame, so polling costs less than
+  // waking the other thread up on every handoff.
+  bool Wait() {
+    if (stopped_) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    return true;
+  }
+
+  T slots_[3];
+  int back_ = 0;
+  int front_ = 1;
+  std::atomic<int> middle_;
+  std::atomic<bool> stopped_{false};
+};
+
+#endif  // TRIPLEBUFFER_H
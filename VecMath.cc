@@ -0,0 +1,32 @@
+#include "VecMath.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static_assert(sizeof(vec2f) == 8 && sizeof(vec2d) == 16,
+              "vec2 must stay packed for the batch operations and GL");
+static_assert(alignof(vec2d) == 16, "vec2d must fill an SSE register");
+
+#ifdef __SSE2__
+
+void MultiplyAdd(const vec2d* a, const vec2d* b, double s, vec2d* out,
+                 size_t n) {
+  const __m128d scale = _mm_set1_pd(s);
+  for (size_t i = 0; i < n; ++i) {
+    __m128d va = _mm_load_pd(&a[i].x);
+    __m128d vb = _mm_load_pd(&b[i].x);
+    _mm_store_pd(&out[i].x, _mm_add_pd(va, _mm_mul_pd(vb, scale)));
+  }
+}
+
+#else  // __SSE2__
+
+void MultiplyAdd(const vec2d* a, const vec2d* b, double s, vec2d* out,
+                 size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = a[i] + b[i] * s;
+  }
+}
+
+#endif  // __SSE2__
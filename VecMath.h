@@ -0,0 +1,110 @@
+// Small vectors for the engine. vec2f (float) is the default and what GL
+// wants; vec2d (double) is for world coordinates, which need the precision
+// far from the origin. Both are plain structs, so arrays of them can be handed
+// to the batch functions below or straight to GL.
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <cstddef>
+
+// Aligned to its own size, so a vec2d fills exactly one SSE register.
+template <typename T>
+struct alignas(2 * sizeof(T)) vec2 {
+  typedef T value_type;
+  T x, y;
+};
+
+typedef vec2<float> vec2f;
+typedef vec2<double> vec2d;
+
+// Scalars are taken as value_type so that e.g. vec2d * 2 doesn't fail to
+// deduce T.
+template <typename T>
+constexpr vec2<T> operator+(const vec2<T>& a, const vec2<T>& b) {
+  return {a.x + b.x, a.y + b.y};
+}
+
+template <typename T>
+constexpr vec2<T> operator-(const vec2<T>& a, const vec2<T>& b) {
+  return {a.x - b.x, a.y - b.y};
+}
+
+template <typename T>
+constexpr vec2<T> operator-(const vec2<T>& a) {
+  return {-a.x, -a.y};
+}
+
+template <typename T>
+constexpr vec2<T> operator*(const vec2<T>& a,
+                            typename vec2<T>::value_type b) {
+  return {a.x * b, a.y * b};
+}
+
+template <typename T>
+constexpr vec2<T> operator*(typename vec2<T>::value_type a,
+                            const vec2<T>& b) {
+  return b * a;
+}
+
+template <typename T>
+constexpr vec2<T> operator/(const vec2<T>& a,
+                            typename vec2<T>::value_type b) {
+  return {a.x / b, a.y / b};
+}
+
+template <typename T>
+inline vec2<T>& operator+=(vec2<T>& a, const vec2<T>& b) {
+  a.x += b.x;
+  a.y += b.y;
+  return a;
+}
+
+template <typename T>
+inline vec2<T>& operator-=(vec2<T>& a, const vec2<T>& b) {
+  a.x -= b.x;
+  a.y -= b.y;
+  return a;
+}
+
+template <typename T>
+inline vec2<T>& operator*=(vec2<T>& a, typename vec2<T>::value_type b) {
+  a.x *= b;
+  a.y *= b;
+  return a;
+}
+
+template <typename T>
+constexpr T Dot(const vec2<T>& a, const vec2<T>& b) {
+  return a.x * b.x + a.y * b.y;
+}
+
+// Explicit conversion, e.g. vec2_cast<float>(world_pos) for GL.
+template <typename To, typename From>
+constexpr vec2<To> vec2_cast(const vec2<From>& v) {
+  return {static_cast<To>(v.x), static_cast<To>(v.y)};
+}
+
+struct alignas(16) vec4f {
+  float x, y, z, w;
+};
+
+constexpr vec4f operator+(const vec4f& a, const vec4f& b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w};
+}
+
+constexpr vec4f operator-(const vec4f& a, const vec4f& b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w};
+}
+
+constexpr vec4f operator*(const vec4f& a, float b) {
+  return {a.x * b, a.y * b, a.z * b, a.w * b};
+}
+
+// Batch operations over arrays, using SSE2 where it's available. Arrays may
+// be the same (e.g. out == a) but must not otherwise overlap.
+
+// out[i] = a[i] + b[i] * s, e.g. positions += velocities * dt.
+void MultiplyAdd(const vec2d* a, const vec2d* b, double s, vec2d* out,
+                 size_t n);
+
+#endif  // VECMATH_H
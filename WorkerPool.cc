@@ -0,0 +1,83 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cassert>
+
+WorkerPool::WorkerPool(int num_threads) : next_(0), running_(false) {
+  for (int i = 1; i < num_threads; ++i) {
+    workers_.emplace_back(&WorkerPool::WorkerLoop, this, i);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void WorkerPool::ParallelFor(size_t n, size_t grain, const RangeFn& fn) {
+  grain = std::max<size_t>(grain, 1);
+  if (workers_.empty() || n <= grain || running_.exchange(true)) {
+    for (size_t begin = 0; begin < n; begin += grain) {
+      fn(begin, std::min(begin + grain, n), 0);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fn_ = &fn;
+    n_ = n;
+    grain_ = grain;
+    next_ = 0;
+    pending_ = workers_.size();
+    ++generation_;
+  }
+  work_cv_.notify_all();
+
+  RunChunks(0);
+
+  // Every worker has to check in, not just the ones that found work, so that
+  // nobody is still reading the job when the next one is set up.
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+  fn_ = nullptr;
+  running_ = false;
+}
+
+void WorkerPool::WorkerLoop(int thread) {
+  unsigned long seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+
+    RunChunks(thread);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(pending_ > 0);
+    if (--pending_ == 0) {
+      done_cv_.notify_one();
+    }
+  }
+}
+
+void WorkerPool::RunChunks(int thread) {
+  for (;;) {
+    size_t begin = next_.fetch_add(grain_);
+    if (begin >= n_) {
+      return;
+    }
+    (*fn_)(begin, std::min(begin + grain_, n_), thread);
+  }
+}
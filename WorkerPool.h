@@ -0,0 +1,55 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads for splitting loops across cores. The calling thread
+// takes part in every loop, so a pool of size 1 spawns no threads and runs
+// everything inline.
+class WorkerPool {
+ public:
+  // fn(begin, end, thread) where thread is in [0, size()).
+  typedef std::function<void(size_t, size_t, int)> RangeFn;
+
+  explicit WorkerPool(int num_threads);
+  ~WorkerPool();
+
+  int size() const { return (int)workers_.size() + 1; }
+
+  // Runs @fn over [0, n) in chunks of at most @grain items and blocks until
+  // every chunk is done. Chunks may run in any order on any thread, so @fn
+  // should only write to per-item or per-thread storage. A call made while
+  // another is running, e.g. from inside @fn, runs inline on the calling
+  // thread instead of sharing the workers.
+  void ParallelFor(size_t n, size_t grain, const RangeFn& fn);
+
+ private:
+  void WorkerLoop(int thread);
+  void RunChunks(int thread);
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  bool stop_ = false;
+  // Bumped once per ParallelFor so sleeping workers know there is a new job.
+  unsigned long generation_ = 0;
+  // Workers that have not yet finished the current job.
+  int pending_ = 0;
+
+  // The current job. Only written while every worker is idle.
+  const RangeFn* fn_ = nullptr;
+  size_t n_ = 0;
+  size_t grain_ = 1;
+  std::atomic<size_t> next_;
+  // Set while a job is out on the workers.
+  std::atomic<bool> running_;
+};
+
+#endif  // WORKERPOOL_H
@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #define SDL_MAIN_HANDLED
@@ -9,17 +12,27 @@
 
 #include "Bog.h"
 #include "Camera.h"
+#include "ChunkStreamer.h"
 #include "Display.h"
 #include "EntityManager.h"
 #include "Event.h"
 #include "Font.h"
+#include "GLState.h"
 #include "GeometryManager.h"
 #include "Input.h"
+#include "LevelManager.h"
 #include "Physics.h"
+#include "RenderQueue.h"
+#include "RenderThread.h"
 #include "ShaderManager.h"
+#include "SpriteBatch.h"
+#include "StreamBuffer.h"
 #include "State.h"
 #include "Text.h"
 #include "TextureManager.h"
+#include "TileMapWindow.h"
+#include "Trigger.h"
+#include "WorkerPool.h"
 
 using namespace std;
 
@@ -37,27 +50,34 @@ int main(int, char**) {
   std::unique_ptr<TextProgram> textProgram = TextProgram::Make();
   std::unique_ptr<TextureProgram> textureProgram = TextureProgram::Make();
   std::unique_ptr<ColorProgram> colorProgram = ColorProgram::Make();
+  std::unique_ptr<SpriteProgram> spriteProgram = SpriteProgram::Make();
 
-  GeometryManager geometryManager = GeometryManager();
+  // Per frame vertex data, a few KB unless there are thousands of sprites.
+  StreamBuffer stream_buffer(1 << 20);
+  GeometryManager geometryManager(&stream_buffer);
   TextureManager textureManager = TextureManager();
+  SpriteBatch sprite_batch(&stream_buffer);
+  RenderQueue render_queue(&textureManager);
 
   TextureRef tileSetRef =
       textureManager.LoadTexture("resources/tileset.png", 0);
   TextureRef collisionSetRef =
       textureManager.LoadTexture("resources/collision.png", 0);
+  // The tileset and collision textures are indexed by tile in
+  // tile_fragment.glsl, and bg repeats, so they can't share an atlas.
   TextureRef dogRef =
-      textureManager.LoadTexture("resources/dog_tilesheet.png", 0);
+      textureManager.LoadAtlasTexture("resources/dog_tilesheet.png");
   TextureRef bgRef =
       textureManager.LoadTexture("resources/bg.png", 0);
   TextureRef fontRef =
-      textureManager.LoadTexture("resources/dialogue.png", 0);
+      textureManager.LoadAtlasTexture("resources/dialogue.png");
 
   std::unique_ptr<Font> font;
   {
     std::unique_ptr<PixelData> pd = LoadToPixelData("resources/dialogue.png");
-    font = Font::MakeFont(*pd.get());
+    font = Font::MakeFont(*pd.get(), textureManager.region(fontRef));
   }
-  std::unique_ptr<Text> text = Text::MakeText(font.get());
+  std::unique_ptr<Text> text = Text::MakeText(font.get(), &stream_buffer);
   for (auto c : "And so begins our hero's adventure!") {
     text->AddCharacter(c);
   }
@@ -65,21 +85,52 @@ int main(int, char**) {
   auto jump_state_system = MakeJumpStateSystem();
   auto lr_state_system = MakeLRStateSystem();
   Camera camera({0, 0}, {SCREEN_WIDTH_TILES, SCREEN_HEIGHT_TILES});
-  BoundingBoxGraphicsSystem bb_graphics(&geometryManager, colorProgram.get());
-  SubSpriteGraphicsSystem ss_graphics(&geometryManager, textureProgram.get(),
-                                      &textureManager);
-  Map level;
-  if (level.LoadTmx("resources/test.tmx")) {
-    cout << "Error loading test.tmx" << endl;
+  BoundingBoxGraphicsSystem bb_graphics;
+  SubSpriteGraphicsSystem ss_graphics;
+  // Room for a few levels besides the current one. A 256x256 layer takes
+  // 64KB.
+  LevelManager level_manager(16 << 20);
+  Level* current_level;
+  {
+    auto load_start = std::chrono::steady_clock::now();
+    current_level = level_manager.EnterNow("resources/test.tmx");
+    assert(current_level);
+    cout << "Loaded level in "
+         << std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - load_start)
+                .count()
+         << "ms" << endl;
   }
-  const TileMap* collision_map = level.GetLayer("Collision");
+  Map& level = current_level->map;
+  TileMap* collision_map = level.GetLayer("Collision");
   assert(collision_map);
-  Physics physics(collision_map);
-
-  const TileMap* tilemap = level.GetLayer("Tiles");
+  TileMap* tilemap = level.GetLayer("Tiles");
   assert(tilemap);
-  TextureRef tileMapRef = textureManager.LoadTilemapTexture(*tilemap);
-  TextureRef collisionMapRef = textureManager.LoadTilemapTexture(*collision_map);
+  // Physics and triggers read collision anywhere in the level, not just near
+  // the camera, so it stays resident. Only the tiles, which are just drawn,
+  // stream: a couple of screens around the camera.
+  collision_map->LoadAll();
+  ChunkStreamer chunk_streamer(2, 2);
+  chunk_streamer.AddLayer(tilemap);
+  {
+    const MapObject* mo = level.GetNamedObject("bog-start");
+    assert(mo);
+    chunk_streamer.LoadNow(mo->pos);
+  }
+  WorkerPool workers(std::max(1u, std::thread::hardware_concurrency()));
+  Physics physics(collision_map);
+  physics.worker_pool(&workers);
+  physics.gravity({0, -BOG_GRAVITY});
+  // Only entities near the camera get drawn, found through the broadphase.
+  bb_graphics.physics(&physics);
+  ss_graphics.physics(&physics);
+  const CollisionLayers& collision_layers = current_level->collision_layers;
+  TriggerSystem& triggers = *current_level->triggers;
+
+  TileMapWindow tile_window(&textureManager, tilemap, SCREEN_WIDTH_TILES,
+                            SCREEN_HEIGHT_TILES);
+  TileMapWindow collision_window(&textureManager, collision_map,
+                                 SCREEN_WIDTH_TILES, SCREEN_HEIGHT_TILES);
 
   EntityManager em;
   vector<Entity> bogs;
@@ -90,8 +141,10 @@ int main(int, char**) {
     EntityId id = em.CreateEntity();
     bogs.emplace_back(id);
     bogs.back().AddComponent(std::unique_ptr<Transform>(new Transform()));
-    bogs.back().AddComponent(std::unique_ptr<Body>(
-        new Body(true, {mo->pos, 0.9, 0.75}, {0, 0})));
+    std::unique_ptr<Body> body(
+        new Body(true, {mo->pos, BOG_WIDTH, BOG_HEIGHT}, {0, 0}));
+    collision_layers.Assign("player", body.get());
+    bogs.back().AddComponent(std::move(body));
     bogs.back().AddComponent(std::unique_ptr<JumpStateComponent>(
         new JumpStateComponent(JumpState::STANDING)));
     bogs.back().AddComponent(std::unique_ptr<LRStateComponent>(
@@ -100,6 +153,9 @@ int main(int, char**) {
         new Sprite(dogRef, 0, Orientation::NORMAL, {-1.0/16.0, 0})));
   }
 
+  // Areas of a layer changed by TileMap::Set since the last frame.
+  vector<TileRect> dirty_tiles;
+
   bool running = true;
   bool paused = true;
   bool debug = false;
@@ -111,6 +167,89 @@ int main(int, char**) {
 
   double time_scale = 1;
 
+  // From here on GL belongs to the render thread, and the loop below only
+  // hands it a snapshot of each frame.
+  int frames_drawn = 0;
+  // The last frame's.
+  GLCallStats gl_calls;
+  RenderThread render_thread(&display, [&](RenderSnapshot* snapshot) {
+    const Camera& view = snapshot->camera;
+    tile_window.Upload(snapshot->tiles);
+    collision_window.Upload(snapshot->collision);
+
+    display.Clear();
+
+    GLState::DepthTest(false);
+
+    render_queue.Submit(RenderLayer::BACKGROUND, textureProgram.get(), bgRef,
+                        -1, [&] {
+      textureProgram->Setup();
+      // bg is four times as large as a tile.
+      // Change the src coords based on camera to give a parallax vibe.
+      geometryManager.DrawSubTexture(view.center().x / 16,
+                                     view.center().y / 16,
+                                     view.half_size().x / 2,
+                                     view.half_size().y / 2,
+                                     -1, -1, 2, 2);
+    });
+
+    auto draw_tiles = [&] {
+      tileProgram->map_offset(
+          vec2_cast<float>(view.center() - view.half_size()));
+      tileProgram->Setup();
+      geometryManager.DrawTileMap(view);
+    };
+    render_queue.Submit(RenderLayer::TILES, tileProgram.get(), tileSetRef,
+                        tile_window.texture(), draw_tiles);
+    if (snapshot->debug) {
+      render_queue.Submit(RenderLayer::DEBUG_TILES, tileProgram.get(),
+                          collisionSetRef, collision_window.texture(),
+                          draw_tiles);
+      render_queue.Submit(RenderLayer::DEBUG_SHAPES, colorProgram.get(), -1,
+                          -1, [&] {
+        auto box = snapshot->boxes.begin();
+        geometryManager.DrawRects([&](Rect* rect) {
+          if (box == snapshot->boxes.end()) {
+            return false;
+          }
+          *rect = view.Transform(*box++);
+          return true;
+        });
+      });
+    }
+    for (const SpriteInstance& sprite : snapshot->sprites) {
+      sprite_batch.Add(sprite);
+    }
+    // One draw per texture, however many entities there are.
+    sprite_batch.Submit(&render_queue, RenderLayer::SPRITES, view,
+                        spriteProgram.get(), &textureManager);
+
+    render_queue.Submit(RenderLayer::TEXT, textProgram.get(), fontRef, -1,
+                        [&] {
+      textProgram->offset({-0.5,0.3});
+      textProgram->scale(2.0/15.0);
+      textProgram->Setup();
+      text->Draw();
+    });
+
+    render_queue.Execute();
+
+    GLState::DepthTest(true);
+
+    stream_buffer.EndFrame();
+    gl_calls = GLState::TakeStats();
+
+    if (++frames_drawn % 100 == 0) {
+      const RenderStats& stats = render_queue.stats();
+      cout << stats.commands << " draws, " << stats.program_changes
+           << " program changes (" << stats.unsorted_program_changes
+           << " unsorted), " << stats.texture_binds << " texture binds ("
+           << stats.unsorted_texture_binds << " unsorted)" << endl;
+      cout << gl_calls.made << " GL state changes, " << gl_calls.skipped
+           << " redundant ones skipped" << endl;
+    }
+  });
+
   int last_ticks = SDL_GetTicks();
 
   while (running) {
@@ -126,6 +265,18 @@ int main(int, char**) {
           case Button::DEBUG:
             debug = !debug;
             continue;
+          case Button::ACTION:
+            if (debug) {
+              // Digs out or fills in the collision tile under Bog, which
+              // the debug view shows.
+              const Rect& bbox = bogs.at(0).GetComponent<Body>()->bbox;
+              int x = (int)floor(bbox.lowerLeft.x + bbox.w / 2);
+              int y = (int)floor(bbox.lowerLeft.y - 0.5);
+              collision_map->Set(x, y, collision_map->At(x, y) == TILE_EMPTY
+                                           ? TILE_BLOCK
+                                           : TILE_EMPTY);
+            }
+            continue;
           default:
             break;
         }
@@ -157,74 +308,50 @@ int main(int, char**) {
         jump_state_system->HandleEvent(event.get(), bogs);
         lr_state_system->HandleEvent(event.get(), bogs);
       }
+      for (const auto& event : triggers.Update(dt, bogs)) {
+        jump_state_system->HandleEvent(event.get(), bogs);
+        lr_state_system->HandleEvent(event.get(), bogs);
+      }
       delta += 8*dt;
       // Interpolate camera to Bog.
-      vec2f bog_pos = bogs.at(0).GetComponent<Body>()->bbox.lowerLeft;
+      vec2d bog_pos = bogs.at(0).GetComponent<Body>()->bbox.lowerLeft;
       camera.center(bog_pos*0.2 + camera.center()*0.8);
+      // Send this frame's tile edits on before the streamer can evict them.
+      tilemap->TakeDirty(&dirty_tiles);
+      for (const TileRect& rect : dirty_tiles) {
+        tile_window.Refresh(rect);
+      }
+      collision_map->TakeDirty(&dirty_tiles);
+      for (const TileRect& rect : dirty_tiles) {
+        collision_window.Refresh(rect);
+        physics.TilesChanged(rect);
+      }
+      chunk_streamer.Update(camera);
       /* for (const Collision& c : collisions) {
         cout << "a " << c.first << " b " << c.second << " @ (" << c.fix.x << ","
              << c.fix.y << ")" << endl;
       } */
     }
+    level_manager.Update();
+    tile_window.Update(camera);
+    collision_window.Update(camera);
     t += dt;
     frames++;
     last_ticks = SDL_GetTicks();
 
-    // Begin drawing
-    display.Clear();
-
-    glDisable(GL_DEPTH_TEST);
-
-    textureManager.BindTexture(bgRef, 0);
-    textureManager.BindTexture(-1, 1);
-    textureProgram->Use();
-    textureProgram->Setup();
-    // bg is four times as large as a tile.
-    // Change the src coords based on camera to give a parallax vibe.
-    geometryManager.DrawSubTexture(camera.center().x / 16,
-                                   camera.center().y / 16,
-                                   camera.half_size().x / 2,
-                                   camera.half_size().y / 2,
-                                   -1, -1, 2, 2);
-
-    textureManager.BindTexture(tileSetRef, 0);
-    textureManager.BindTexture(tileMapRef, 1);
-    tileProgram->Use();
-    tileProgram->map_offset(camera.center() - camera.half_size());
-    tileProgram->Setup();
-    geometryManager.DrawTileMap(camera);
-
-    if (debug) {
-      textureManager.BindTexture(collisionSetRef, 0);
-      textureManager.BindTexture(collisionMapRef, 1);
-      tileProgram->Use();
-      tileProgram->map_offset(camera.center() - camera.half_size());
-      tileProgram->Setup();
-      geometryManager.DrawTileMap(camera);
-    }
-
-    textureManager.BindTexture(dogRef, 0);
-    textureManager.BindTexture(-1, 1);
-    textureProgram->Use();
-    textureProgram->Setup();
-
+    // Hand the frame over to be drawn.
+    RenderSnapshot& snapshot = render_thread.snapshot();
+    snapshot.camera = camera;
+    snapshot.debug = debug;
+    ss_graphics.Update(0 /* unused */, camera, bogs);
+    ss_graphics.TakeSprites(&snapshot.sprites);
     if (debug) {
       bb_graphics.Update(0 /* unused */, camera, bogs);
     }
-    ss_graphics.Update(0 /* unused */, camera, bogs);
-
-    textureManager.BindTexture(fontRef, 0);
-    textureManager.BindTexture(-1, 1);
-    textProgram->Use();
-    textProgram->offset({-0.5,0.3});
-    textProgram->scale(2.0/15.0);
-    textProgram->Setup();
-
-    text->Draw();
-
-    glEnable(GL_DEPTH_TEST);
-
-    display.Swap();
+    bb_graphics.TakeBoxes(&snapshot.boxes);
+    tile_window.TakeUploads(&snapshot.tiles);
+    collision_window.TakeUploads(&snapshot.collision);
+    render_thread.Publish();
 
     if (frames % 100 == 0) {
       cout << (float)frames / t << endl;
@@ -0,0 +1,19 @@
+#version 330
+
+// Corner of a unit quad, shared by every sprite.
+layout(location = 0) in vec2 corner;
+// Per sprite: where it goes, in tiles from the camera's center, and the part
+// of the texture it shows. A negative source width or height flips it.
+layout(location = 1) in vec4 dest;
+layout(location = 2) in vec4 source;
+
+// The camera's half size, in tiles.
+uniform vec2 halfSize;
+
+out vec2 TexCoord;
+
+void main()
+{
+   gl_Position = vec4((dest.xy + corner * dest.zw) / halfSize, 0, 1);
+   TexCoord = source.xy + corner * source.zw;
+}
@@ -18,7 +18,10 @@ void main()
     vec2 coordFloor = floor(offsetCoord);
     vec2 coordFrac = vec2(offsetCoord - coordFloor);
 
-    uint tile_index = texelFetch(tilemap, tilePos, 0).r;
+    // The tilemap is a window that wraps around, see TileMapWindow. Its sides
+    // are powers of two, so masking wraps negative positions too.
+    ivec2 texelPos = tilePos & (textureSize(tilemap, 0) - 1);
+    uint tile_index = texelFetch(tilemap, texelPos, 0).r;
     // Invert y because textures have normal y direction.
     vec2 tile = vec2(mod(tile_index, 16), 15-(tile_index/16));
 
@@ -0,0 +1,108 @@
+// Packs random rectangles into atlas pages with SkylinePacker, the way
+// TextureManager::LoadAtlasTexture() places textures.
+//
+//   atlas_bench
+//
+// Rectangles are packed in the order they come, as textures are loaded, and
+// again tallest first. Checks that none overlap or leave their page, and
+// prints the time per rectangle and how full the pages end up.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "TextureAtlas.h"
+
+using namespace std;
+
+namespace {
+const int PAGE_SIZE = 1024;
+const int NUM_RECTS = 20000;
+// Sides run from MIN_SIDE to MAX_SIDE, mostly towards the small end, like
+// sprite sheets and glyphs, plus the 1px border on each side.
+const int MIN_SIDE = 8;
+const int MAX_SIDE = 256;
+const int PADDING = 1;
+
+struct Size {
+  int w, h;
+};
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Packs @sizes into as many pages as it takes, each rectangle going in the
+// first page with room, and checks the placements. Returns false if any
+// overlap or leave their page.
+bool PackAll(const vector<Size>& sizes, const char* order) {
+  vector<SkylinePacker> pages;
+  // A byte per texel of each page, set where something was placed.
+  vector<vector<uint8_t>> used;
+  long area = 0;
+  double time = 0;
+  for (const Size& size : sizes) {
+    int x, y;
+    size_t page = 0;
+    auto start = chrono::steady_clock::now();
+    while (page < pages.size() && !pages[page].Pack(size.w, size.h, &x, &y)) {
+      ++page;
+    }
+    if (page == pages.size()) {
+      pages.emplace_back(PAGE_SIZE, PAGE_SIZE);
+      pages.back().Pack(size.w, size.h, &x, &y);
+    }
+    time += SecondsSince(start);
+
+    if (used.size() < pages.size()) {
+      used.emplace_back(PAGE_SIZE * PAGE_SIZE, 0);
+    }
+    if (x < 0 || y < 0 || x + size.w > PAGE_SIZE || y + size.h > PAGE_SIZE) {
+      cerr << size.w << "x" << size.h << " placed off page " << page
+           << " at (" << x << ", " << y << ")" << endl;
+      return false;
+    }
+    for (int py = y; py < y + size.h; ++py) {
+      for (int px = x; px < x + size.w; ++px) {
+        uint8_t& texel = used[page][py * PAGE_SIZE + px];
+        if (texel) {
+          cerr << size.w << "x" << size.h << " overlaps at (" << px << ", "
+               << py << ") on page " << page << endl;
+          return false;
+        }
+        texel = 1;
+      }
+    }
+    area += (long)size.w * size.h;
+  }
+  cout << order << ": " << time * 1e9 / sizes.size() << "ns per rect, "
+       << pages.size() << " pages, "
+       << 100.0 * area / ((double)pages.size() * PAGE_SIZE * PAGE_SIZE)
+       << "% full" << endl;
+  return true;
+}
+}  // namespace
+
+int main() {
+  mt19937 rng(2);
+  // Squaring a uniform number favours small sides.
+  uniform_real_distribution<double> side(0, 1);
+  vector<Size> sizes(NUM_RECTS);
+  for (Size& size : sizes) {
+    double w = side(rng), h = side(rng);
+    size.w = MIN_SIDE + (int)(w * w * (MAX_SIDE - MIN_SIDE)) + 2 * PADDING;
+    size.h = MIN_SIDE + (int)(h * h * (MAX_SIDE - MIN_SIDE)) + 2 * PADDING;
+  }
+  if (!PackAll(sizes, "As loaded")) {
+    return 1;
+  }
+  stable_sort(sizes.begin(), sizes.end(),
+              [](const Size& a, const Size& b) { return a.h > b.h; });
+  if (!PackAll(sizes, "Tallest first")) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+// Cooks a .tmx level into the binary format Map::LoadLevel maps in.
+//
+//   cook_level [--bench] level.tmx level.cbl
+//
+// The cooked level is read back and checked against the .tmx. --bench then
+// times loading the level both ways.
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "LevelFile.h"
+#include "TileMap.h"
+
+using namespace std;
+
+namespace {
+const int BENCH_LOADS = 20;
+
+// Average seconds per call of @load over BENCH_LOADS calls.
+template <typename Load>
+double TimeLoads(Load load) {
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_LOADS; ++i) {
+    Map map;
+    if (load(&map)) {
+      return -1;
+    }
+  }
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+             .count() /
+         BENCH_LOADS;
+}
+
+bool SameRect(const Rect& a, const Rect& b) {
+  return a.lowerLeft.x == b.lowerLeft.x && a.lowerLeft.y == b.lowerLeft.y &&
+         a.w == b.w && a.h == b.h;
+}
+
+// Whether @cooked holds everything @tmx does.
+bool SameMap(const Map& tmx, const Map& cooked) {
+  if (tmx.GetProperties() != cooked.GetProperties() ||
+      tmx.GetLayers().size() != cooked.GetLayers().size() ||
+      tmx.GetObjects().size() != cooked.GetObjects().size()) {
+    return false;
+  }
+  for (const auto& layer : tmx.GetLayers()) {
+    const TileMap& tiles = layer.second;
+    const TileMap* cooked_tiles = cooked.GetLayer(layer.first);
+    if (!cooked_tiles || cooked_tiles->GetWidth() != tiles.GetWidth() ||
+        cooked_tiles->GetHeight() != tiles.GetHeight()) {
+      return false;
+    }
+    for (int y = 0; y < tiles.GetHeight(); ++y) {
+      for (int x = 0; x < tiles.GetWidth(); ++x) {
+        if (cooked_tiles->At(x, y) != tiles.At(x, y)) {
+          return false;
+        }
+      }
+    }
+  }
+  for (const auto& entry : tmx.GetObjects()) {
+    const MapObject& object = entry.second;
+    auto cooked_object = cooked.GetObjects().find(entry.first);
+    if (cooked_object == cooked.GetObjects().end() ||
+        cooked_object->second.name != object.name ||
+        cooked_object->second.type != object.type ||
+        cooked_object->second.pos.x != object.pos.x ||
+        cooked_object->second.pos.y != object.pos.y ||
+        !SameRect(cooked_object->second.bounds, object.bounds) ||
+        cooked_object->second.properties != object.properties) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  if (argc != 3 + bench) {
+    cerr << "usage: " << argv[0] << " [--bench] level.tmx level.cbl" << endl;
+    return 1;
+  }
+  string tmx = argv[1 + bench];
+  string level = argv[2 + bench];
+
+  Map map;
+  if (map.LoadTmx(tmx)) {
+    cerr << "Couldn't load " << tmx << endl;
+    return 1;
+  }
+  if (WriteLevel(map, level)) {
+    cerr << "Couldn't write " << level << endl;
+    return 1;
+  }
+  Map cooked;
+  if (cooked.LoadLevel(level) || !SameMap(map, cooked)) {
+    cerr << level << " doesn't match " << tmx << endl;
+    return 1;
+  }
+
+  if (bench) {
+    double tmx_time = TimeLoads([&tmx](Map* map) { return map->LoadTmx(tmx); });
+    double level_time =
+        TimeLoads([&level](Map* map) { return map->LoadLevel(level); });
+    cout << "LoadTmx:   " << tmx_time * 1e6 << "us" << endl;
+    cout << "LoadLevel: " << level_time * 1e6 << "us" << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+// Times FlowField on a generated 1024x1024 map with 25% random blocks.
+//
+//   flow_field_bench [--threads N]
+//
+// Builds a field for each of a few goals on a worker pool of N threads
+// (default 4), then moves the goals a few steps at a time, checking the
+// incremental updates against full rebuilds as it goes.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "FlowField.h"
+#include "TileMap.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+namespace {
+const int MAP_SIZE = 1024;
+const double BLOCK_CHANCE = 0.25;
+const int NUM_GOALS = 4;
+// Goal moves per goal, of up to MOVE_STEPS steps each. Every CHECK_EVERY-th
+// move is checked against a rebuild.
+const int NUM_MOVES = 50;
+const int MOVE_STEPS = 3;
+const int CHECK_EVERY = 10;
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+bool Open(const TileMap& map, TilePos tile) {
+  return tile.x >= 0 && tile.y >= 0 && tile.x < MAP_SIZE &&
+         tile.y < MAP_SIZE && map.At(tile.x, tile.y) != TILE_BLOCK;
+}
+
+// A random walk of up to MOVE_STEPS steps from @tile over open tiles.
+TilePos Wander(const TileMap& map, TilePos tile, mt19937* rng) {
+  uniform_int_distribution<int> step(-1, 1);
+  for (int i = 0; i < MOVE_STEPS; ++i) {
+    TilePos next = {tile.x + step(*rng), tile.y + step(*rng)};
+    if (Open(map, next)) {
+      tile = next;
+    }
+  }
+  return tile;
+}
+
+bool SameDistances(const FlowField& a, const FlowField& b) {
+  for (int y = 0; y < MAP_SIZE; ++y) {
+    for (int x = 0; x < MAP_SIZE; ++x) {
+      if (a.Distance({x, y}) != b.Distance({x, y})) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int threads = 4;
+  if (argc == 3 && strcmp(argv[1], "--threads") == 0) {
+    threads = atoi(argv[2]);
+  } else if (argc != 1) {
+    threads = 0;
+  }
+  if (threads < 1) {
+    cerr << "usage: " << argv[0] << " [--threads N]" << endl;
+    return 1;
+  }
+
+  mt19937 rng(7);
+  uniform_real_distribution<double> chance(0, 1);
+  vector<int> tiles(MAP_SIZE * MAP_SIZE);
+  for (int& tile : tiles) {
+    tile = chance(rng) < BLOCK_CHANCE ? TILE_BLOCK : TILE_EMPTY;
+  }
+  TileMap map(MAP_SIZE, MAP_SIZE,
+              make_shared<MemoryChunkSource>(MAP_SIZE, MAP_SIZE, tiles));
+  map.LoadAll();
+
+  WorkerPool pool(threads);
+  uniform_int_distribution<int> coord(0, MAP_SIZE - 1);
+  vector<unique_ptr<FlowField>> fields;
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < NUM_GOALS; ++i) {
+    TilePos goal;
+    do {
+      goal = {coord(rng), coord(rng)};
+    } while (!Open(map, goal));
+    fields.emplace_back(new FlowField(&map, &pool));
+    fields.back()->SetGoal(goal);
+  }
+  double build_time = SecondsSince(start) / NUM_GOALS;
+  cout << "Rebuild: " << build_time * 1e3 << "ms per goal on " << threads
+       << " threads" << endl;
+
+  // Fields rebuilt from scratch at the same goals, to check against.
+  FlowField rebuilt(&map, &pool);
+  rebuilt.max_incremental_move(0);
+  double move_time = 0;
+  long long touched = 0;
+  for (int move = 0; move < NUM_MOVES; ++move) {
+    for (auto& field : fields) {
+      TilePos goal = Wander(map, field->goal(), &rng);
+      start = chrono::steady_clock::now();
+      field->SetGoal(goal);
+      move_time += SecondsSince(start);
+      touched += field->last_update_size();
+      if (move % CHECK_EVERY == CHECK_EVERY - 1) {
+        rebuilt.SetGoal(goal);
+        if (!SameDistances(*field, rebuilt)) {
+          cerr << "Moving the goal to (" << goal.x << ", " << goal.y
+               << ") disagrees with a rebuild" << endl;
+          return 1;
+        }
+      }
+    }
+  }
+  const int num_moves = NUM_MOVES * NUM_GOALS;
+  cout << "Move: " << move_time * 1e3 / num_moves << "ms per goal, "
+       << touched / num_moves << " tiles updated" << endl;
+  return 0;
+}
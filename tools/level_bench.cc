@@ -0,0 +1,156 @@
+// Walks a player through a chain of generated levels with LevelManager
+// loading them in the background.
+//
+//   level_bench
+//
+// Each level links to the ones before and after it. The player spends a
+// while in each level, walks to the end of the chain and back, and enters the
+// next level as soon as it is ready. Prints how long entering a level that
+// wasn't prefetched takes, how many frames the player had to wait at doors,
+// and checks that the cache keeps to its budget.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LevelManager.h"
+
+using namespace std;
+
+namespace {
+const int NUM_LEVELS = 8;
+const int LEVEL_SIZE = 512;
+// One in this many tiles is a block.
+const int BLOCK_ODDS = 13;
+// Frames spent in each level before heading through the door, and the time
+// the rest of a frame takes.
+const int FRAMES_PER_LEVEL = 20;
+const chrono::milliseconds FRAME_TIME(2);
+// The cache holds this many levels besides the current one.
+const double CACHED_LEVELS = 2.5;
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+string LevelName(int i) {
+  return "level_bench_" + to_string(i) + ".tmx";
+}
+
+// Writes level @i: scattered blocks, linking to its neighbours.
+void WriteLevel(int i) {
+  mt19937 rng(i);
+  uniform_int_distribution<int> block(0, BLOCK_ODDS - 1);
+  ofstream out(LevelName(i));
+  out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<map version=\"1.2\" orientation=\"orthogonal\" width=\""
+      << LEVEL_SIZE << "\" height=\"" << LEVEL_SIZE
+      << "\" tilewidth=\"16\" tileheight=\"16\" infinite=\"0\">\n"
+      << " <properties>\n";
+  if (i > 0) {
+    out << "  <property name=\"link.back\" value=\"" << LevelName(i - 1)
+        << "\"/>\n";
+  }
+  if (i + 1 < NUM_LEVELS) {
+    out << "  <property name=\"link.next\" value=\"" << LevelName(i + 1)
+        << "\"/>\n";
+  }
+  out << " </properties>\n"
+      << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" "
+      << "tileheight=\"16\" tilecount=\"8\" columns=\"8\"/>\n"
+      << " <layer name=\"Collision\" width=\"" << LEVEL_SIZE
+      << "\" height=\"" << LEVEL_SIZE << "\">\n"
+      << "  <data encoding=\"csv\">\n";
+  for (int y = 0; y < LEVEL_SIZE; ++y) {
+    for (int x = 0; x < LEVEL_SIZE; ++x) {
+      // Gid 2 is TILE_BLOCK in a tileset starting at 1.
+      out << (block(rng) == 0 ? 2 : 0);
+      if (x + 1 < LEVEL_SIZE || y + 1 < LEVEL_SIZE) {
+        out << ',';
+      }
+    }
+    out << '\n';
+  }
+  out << "  </data>\n </layer>\n</map>\n";
+}
+}  // namespace
+
+int main() {
+  for (int i = 0; i < NUM_LEVELS; ++i) {
+    WriteLevel(i);
+  }
+  auto clean_up = [] {
+    for (int i = 0; i < NUM_LEVELS; ++i) {
+      remove(LevelName(i).c_str());
+    }
+  };
+
+  size_t level_bytes;
+  {
+    LevelManager sizer(0);
+    auto start = chrono::steady_clock::now();
+    Level* level = sizer.EnterNow(LevelName(0));
+    if (!level) {
+      cerr << "Couldn't load " << LevelName(0) << endl;
+      clean_up();
+      return 1;
+    }
+    cout << "Cold EnterNow: " << SecondsSince(start) * 1e3 << "ms, "
+         << level->bytes() / (1 << 10) << " KB per level" << endl;
+    level_bytes = level->bytes();
+  }
+
+  const size_t budget = level_bytes * CACHED_LEVELS;
+  LevelManager levels(budget);
+  levels.EnterNow(LevelName(0));
+  // There and back again.
+  vector<int> route;
+  for (int i = 1; i < NUM_LEVELS; ++i) {
+    route.push_back(i);
+  }
+  for (int i = NUM_LEVELS - 2; i >= 0; --i) {
+    route.push_back(i);
+  }
+
+  int waited = 0;
+  int longest_wait = 0;
+  size_t peak = 0;
+  for (int next : route) {
+    for (int frame = 0; frame < FRAMES_PER_LEVEL; ++frame) {
+      levels.Update();
+      this_thread::sleep_for(FRAME_TIME);
+    }
+    int wait = 0;
+    Level* level;
+    while (!(level = levels.Enter(LevelName(next)))) {
+      levels.Load(LevelName(next));
+      levels.Update();
+      this_thread::sleep_for(FRAME_TIME);
+      ++wait;
+    }
+    waited += wait;
+    longest_wait = max(longest_wait, wait);
+    levels.Update();
+    size_t cached = levels.cached_bytes() - level->bytes();
+    peak = max(peak, cached);
+    if (level->filename != LevelName(next) || cached > budget) {
+      cerr << "Entering " << LevelName(next) << " left " << cached
+           << " bytes cached against a budget of " << budget << endl;
+      clean_up();
+      return 1;
+    }
+  }
+  cout << "Entered " << route.size() << " levels, waited " << waited
+       << " frames at doors, " << longest_wait << " at most" << endl;
+  cout << "Cache peaked at " << peak / (1 << 10) << " KB besides the current "
+       << "level, against a budget of " << budget / (1 << 10) << " KB"
+       << endl;
+  clean_up();
+  return 0;
+}
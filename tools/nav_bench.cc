@@ -0,0 +1,87 @@
+// Times navigation for Bog on a level's collision layer.
+//
+//   nav_bench level.tmx
+//
+// Builds the NavGraph, then queues random path requests between its nodes
+// and answers them PathPlanner::Update() style, a millisecond a frame.
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Bog.h"
+#include "Navigation.h"
+#include "TileMap.h"
+
+using namespace std;
+
+namespace {
+const int NUM_REQUESTS = 20000;
+// Requests queued per frame, like a crowd of characters asking for paths.
+const int REQUESTS_PER_FRAME = 200;
+const Seconds FRAME_BUDGET = 0.001;
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    cerr << "usage: " << argv[0] << " level.tmx" << endl;
+    return 1;
+  }
+  Map map;
+  if (map.LoadTmx(argv[1])) {
+    cerr << "Couldn't load " << argv[1] << endl;
+    return 1;
+  }
+  TileMap* collision_map = map.GetLayer("Collision");
+  if (!collision_map) {
+    cerr << argv[1] << " has no Collision layer" << endl;
+    return 1;
+  }
+  collision_map->LoadAll();
+
+  auto start = chrono::steady_clock::now();
+  NavGraph graph(*collision_map, MakeBogJumpProfile());
+  double build_time = SecondsSince(start);
+  cout << "NavGraph: " << graph.nodes().size() << " nodes, "
+       << graph.links().size() << " links, " << graph.surfaces().size()
+       << " surfaces in " << build_time * 1e3 << "ms" << endl;
+  if (graph.nodes().empty()) {
+    return 0;
+  }
+
+  mt19937 rng(1);
+  uniform_int_distribution<int> node(0, graph.nodes().size() - 1);
+  PathPlanner planner(&graph);
+  vector<PathPlanner::Request> requests;
+  int frames = 0;
+  int found = 0;
+  int answered = 0;
+  start = chrono::steady_clock::now();
+  while (answered < NUM_REQUESTS) {
+    for (int i = 0;
+         i < REQUESTS_PER_FRAME && (int)requests.size() < NUM_REQUESTS; ++i) {
+      requests.push_back(planner.RequestPath(graph.nodes()[node(rng)].feet,
+                                             graph.nodes()[node(rng)].feet));
+    }
+    planner.Update(FRAME_BUDGET);
+    ++frames;
+    NavPath path;
+    while (answered < (int)requests.size() &&
+           planner.TakePath(requests[answered], &path)) {
+      found += path.found;
+      ++answered;
+    }
+  }
+  double plan_time = SecondsSince(start);
+  cout << "PathPlanner: " << NUM_REQUESTS << " requests over " << frames
+       << " frames, " << plan_time * 1e6 / NUM_REQUESTS << "us each, "
+       << found << " found, " << planner.cache_hits() << " cache hits, "
+       << planner.cache_misses() << " misses" << endl;
+  return 0;
+}
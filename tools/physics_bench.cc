@@ -0,0 +1,213 @@
+// Times Physics on a generated level, for checking changes to its hot paths.
+//
+//   physics_bench [--threads N] raycast|sweep|update
+//
+// raycast times Raycast one ray at a time against RaycastBatch, with and
+// without a worker pool of N threads (default 4), and checks that they agree.
+// sweep times Sweep. update times Update with every body falling, running
+// and bumping into things, and prints a checksum of where they end up, which
+// doesn't depend on the number of threads.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Physics.h"
+#include "TileMap.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+namespace {
+const int MAP_W = 512;
+const int MAP_H = 512;
+// Chance of a tile being a block, and of one on top of it being a slope.
+const double BLOCK_CHANCE = 0.1;
+const double SLOPE_CHANCE = 0.3;
+const int NUM_BODIES = 4000;
+const int NUM_RAYS = 200000;
+const int NUM_SWEEPS = 100000;
+const int NUM_UPDATES = 300;
+const Seconds UPDATE_DT = 1.0 / 60;
+// Longest ray or sweep, in tiles along each axis.
+const double MAX_REACH = 16;
+
+// A level of scattered blocks, some topped with slopes, and a body in each
+// of NUM_BODIES random places, so queries see both.
+struct Level {
+  Level() : rng(1) {
+    vector<int> tiles(MAP_W * MAP_H, TILE_EMPTY);
+    uniform_real_distribution<double> chance(0, 1);
+    uniform_int_distribution<int> slope(TILE_SLOPE_01, TILE_SLOPE_50);
+    for (int y = 0; y + 1 < MAP_H; ++y) {
+      for (int x = 0; x < MAP_W; ++x) {
+        if (chance(rng) < BLOCK_CHANCE) {
+          tiles[y * MAP_W + x] = TILE_BLOCK;
+          if (chance(rng) < SLOPE_CHANCE) {
+            tiles[(y + 1) * MAP_W + x] = slope(rng);
+          }
+        }
+      }
+    }
+    map.reset(new TileMap(
+        MAP_W, MAP_H, make_shared<MemoryChunkSource>(MAP_W, MAP_H, tiles)));
+    map->LoadAll();
+
+    uniform_real_distribution<double> x(0, MAP_W), y(0, MAP_H);
+    for (int i = 0; i < NUM_BODIES; ++i) {
+      entities.emplace_back(i);
+      entities.back().AddComponent(unique_ptr<Body>(
+          new Body(true, {{x(rng), y(rng)}, 0.9, 0.75}, {0, 0})));
+    }
+    physics.reset(new Physics(map.get()));
+    physics->Update(0, entities);
+  }
+
+  // A random ray, or sweep, from somewhere on the map.
+  Ray RandomRay() {
+    uniform_real_distribution<double> x(0, MAP_W), y(0, MAP_H);
+    uniform_real_distribution<double> reach(-MAX_REACH, MAX_REACH);
+    return {{x(rng), y(rng)}, {reach(rng), reach(rng)}};
+  }
+
+  mt19937 rng;
+  unique_ptr<TileMap> map;
+  vector<Entity> entities;
+  unique_ptr<Physics> physics;
+};
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+bool SameHit(const RaycastHit& a, const RaycastHit& b) {
+  return a.hit == b.hit &&
+         (!a.hit || (a.body == b.body && a.fraction == b.fraction));
+}
+
+int BenchRaycast(Level* level, int threads) {
+  vector<Ray> rays;
+  for (int i = 0; i < NUM_RAYS; ++i) {
+    rays.push_back(level->RandomRay());
+  }
+  QueryFilter filter;
+
+  vector<RaycastHit> single(rays.size());
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < rays.size(); ++i) {
+    level->physics->Raycast(rays[i], filter, &single[i]);
+  }
+  double single_time = SecondsSince(start);
+  int num_hits = 0;
+  for (const RaycastHit& hit : single) {
+    num_hits += hit.hit;
+  }
+  cout << "Raycast:                 " << rays.size() / single_time / 1e6
+       << " Mrays/s (" << num_hits << " hits)" << endl;
+
+  WorkerPool pool(threads);
+  for (WorkerPool* worker_pool : {(WorkerPool*)nullptr, &pool}) {
+    level->physics->worker_pool(worker_pool);
+    vector<RaycastHit> hits;
+    start = chrono::steady_clock::now();
+    level->physics->RaycastBatch(rays, filter, &hits);
+    double batch_time = SecondsSince(start);
+    cout << "RaycastBatch, " << (worker_pool ? threads : 1) << " threads: "
+         << rays.size() / batch_time / 1e6 << " Mrays/s" << endl;
+    for (size_t i = 0; i < rays.size(); ++i) {
+      if (!SameHit(hits[i], single[i])) {
+        cerr << "RaycastBatch disagrees with Raycast on ray " << i << endl;
+        return 1;
+      }
+    }
+  }
+  level->physics->worker_pool(nullptr);
+  return 0;
+}
+
+int BenchSweep(Level* level) {
+  vector<Ray> sweeps;
+  for (int i = 0; i < NUM_SWEEPS; ++i) {
+    sweeps.push_back(level->RandomRay());
+  }
+  QueryFilter filter;
+  int num_hits = 0;
+  auto start = chrono::steady_clock::now();
+  for (const Ray& sweep : sweeps) {
+    RaycastHit hit;
+    num_hits +=
+        level->physics->Sweep({sweep.origin, 0.9, 0.75}, sweep.delta, filter,
+                              &hit);
+  }
+  double time = SecondsSince(start);
+  cout << "Sweep: " << sweeps.size() / time / 1e6 << " Msweeps/s ("
+       << num_hits << " hits)" << endl;
+  return 0;
+}
+
+int BenchUpdate(Level* level, int threads) {
+  uniform_real_distribution<double> speed(-4, 4);
+  for (Entity& entity : level->entities) {
+    Body* body = entity.GetComponent<Body>();
+    body->accel.x = speed(level->rng);
+    body->drag = {1, 0};
+    body->max_speed = {4, 20};
+  }
+  level->physics->gravity({0, -20});
+  WorkerPool pool(threads);
+  level->physics->worker_pool(&pool);
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < NUM_UPDATES; ++i) {
+    level->physics->Update(UPDATE_DT, level->entities);
+  }
+  double time = SecondsSince(start);
+  level->physics->worker_pool(nullptr);
+
+  vec2d sum = {0, 0};
+  int asleep = 0;
+  for (const Entity& entity : level->entities) {
+    const Body* body = entity.GetComponent<Body>();
+    sum += body->bbox.lowerLeft;
+    asleep += body->sleeping;
+  }
+  cout << "Update, " << threads << " threads: " << time * 1e3 / NUM_UPDATES
+       << "ms, " << asleep << " of " << NUM_BODIES << " bodies asleep"
+       << endl;
+  cout.precision(17);
+  cout << "Positions sum to " << sum.x << ", " << sum.y << endl;
+  return 0;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int threads = 4;
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "--threads") == 0) {
+    threads = atoi(argv[2]);
+    arg = 3;
+  }
+  if (argc != arg + 1 || threads < 1) {
+    cerr << "usage: " << argv[0] << " [--threads N] raycast|sweep|update"
+         << endl;
+    return 1;
+  }
+  string bench = argv[arg];
+
+  Level level;
+  if (bench == "raycast") {
+    return BenchRaycast(&level, threads);
+  }
+  if (bench == "sweep") {
+    return BenchSweep(&level);
+  }
+  if (bench == "update") {
+    return BenchUpdate(&level, threads);
+  }
+  cerr << "Unknown benchmark " << bench << endl;
+  return 1;
+}
@@ -0,0 +1,302 @@
+// Checks the renderer's state handling against a real GL context. Opens a
+// window, so needs a display, and loads the game's shaders from resources/,
+// so run it from the build directory.
+//
+//   render_bench queue|state
+//
+// queue submits random commands to a RenderQueue and checks that they run
+// sorted by layer, program, textures and depth, in submission order where
+// those are equal, with the right program and textures in GL. Prints the
+// program changes and texture binds made against running the commands
+// unsorted. state runs a script of GLState calls and checks the calls it
+// counts as made and skipped after each one, along with what GL has bound
+// where that is the point of the call.
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include "Display.h"
+#include "GLState.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+#include "TextureManager.h"
+
+using namespace std;
+
+namespace {
+const int NUM_COMMANDS = 2000;
+const int NUM_LAYERS = (int)RenderLayer::TEXT + 1;
+const int NUM_TEXTURES = 6;
+const int MAX_DEPTH = 3;
+
+// What a command was submitted with, and what GL had bound when it ran.
+struct Submitted {
+  RenderLayer layer;
+  Program* program;
+  TextureRef textures[2];
+  uint16_t depth;
+  GLint gl_program = 0;
+  GLint gl_textures[2] = {};
+};
+
+// Reads what is bound to units 0 and 1, leaving the active unit as it was,
+// so GLState's cache stays right.
+void BoundTextures(GLint* textures) {
+  GLint active;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+  for (int unit = 0; unit < 2; ++unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &textures[unit]);
+  }
+  glActiveTexture(active);
+}
+
+// Whether each key in @pairs always went with the same GL name, and
+// different keys with different names.
+template <typename Key>
+bool OneToOne(const vector<pair<Key, GLint>>& pairs) {
+  map<Key, GLint> forward;
+  map<GLint, Key> backward;
+  for (const auto& pair : pairs) {
+    auto gl = forward.emplace(pair.first, pair.second).first;
+    auto key = backward.emplace(pair.second, pair.first).first;
+    if (gl->second != pair.second || key->second != pair.first) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int CheckQueue() {
+  TextureManager texture_manager;
+  vector<unique_ptr<Program>> programs;
+  programs.push_back(TextureProgram::Make());
+  programs.push_back(TextProgram::Make());
+  programs.push_back(MapProgram::Make());
+  programs.push_back(SpriteProgram::Make());
+  programs.push_back(ColorProgram::Make());
+  for (const auto& program : programs) {
+    if (!program) {
+      cerr << "Couldn't load the shaders; run from the build directory"
+           << endl;
+      return 1;
+    }
+  }
+  vector<TextureRef> textures;
+  for (int i = 0; i < NUM_TEXTURES; ++i) {
+    textures.push_back(texture_manager.CreateTilemapTexture(4, 4));
+  }
+  // No texture, which binds the default one.
+  textures.push_back(-1);
+
+  mt19937 rng(6);
+  uniform_int_distribution<int> layer(0, NUM_LAYERS - 1);
+  uniform_int_distribution<size_t> program(0, programs.size() - 1);
+  uniform_int_distribution<size_t> texture(0, textures.size() - 1);
+  uniform_int_distribution<int> depth(0, MAX_DEPTH);
+  vector<Submitted> submitted(NUM_COMMANDS);
+  vector<int> ran;
+  RenderQueue queue(&texture_manager);
+  for (int i = 0; i < NUM_COMMANDS; ++i) {
+    Submitted& command = submitted[i];
+    command.layer = (RenderLayer)layer(rng);
+    command.program = programs[program(rng)].get();
+    command.textures[0] = textures[texture(rng)];
+    command.textures[1] = textures[texture(rng)];
+    command.depth = depth(rng);
+    queue.Submit(command.layer, command.program, command.textures[0],
+                 command.textures[1], [i, &command, &ran] {
+                   glGetIntegerv(GL_CURRENT_PROGRAM, &command.gl_program);
+                   BoundTextures(command.gl_textures);
+                   ran.push_back(i);
+                 },
+                 command.depth);
+  }
+  queue.Execute();
+
+  // Programs are keyed by when they were first submitted.
+  map<Program*, int> program_index;
+  for (const Submitted& command : submitted) {
+    program_index.emplace(command.program, (int)program_index.size());
+  }
+  vector<int> expected(NUM_COMMANDS);
+  for (int i = 0; i < NUM_COMMANDS; ++i) {
+    expected[i] = i;
+  }
+  auto key = [&](int i) {
+    const Submitted& command = submitted[i];
+    return make_tuple(command.layer, program_index[command.program],
+                      command.textures[0] & 0xffff,
+                      command.textures[1] & 0xffff, command.depth);
+  };
+  stable_sort(expected.begin(), expected.end(),
+              [&key](int a, int b) { return key(a) < key(b); });
+  if (ran != expected) {
+    cerr << "Commands ran out of order" << endl;
+    return 1;
+  }
+
+  vector<pair<Program*, GLint>> program_pairs;
+  vector<pair<TextureRef, GLint>> texture_pairs[2];
+  for (const Submitted& command : submitted) {
+    program_pairs.push_back({command.program, command.gl_program});
+    for (int unit = 0; unit < 2; ++unit) {
+      texture_pairs[unit].push_back(
+          {command.textures[unit], command.gl_textures[unit]});
+    }
+  }
+  if (!OneToOne(program_pairs) || !OneToOne(texture_pairs[0]) ||
+      !OneToOne(texture_pairs[1])) {
+    cerr << "A command ran with the wrong program or textures" << endl;
+    return 1;
+  }
+
+  const RenderStats& stats = queue.stats();
+  cout << stats.commands << " commands: " << stats.program_changes
+       << " program changes against " << stats.unsorted_program_changes
+       << " unsorted, " << stats.texture_binds << " texture binds against "
+       << stats.unsorted_texture_binds << endl;
+  return 0;
+}
+
+GLint Get(GLenum name) {
+  GLint value;
+  glGetIntegerv(name, &value);
+  return value;
+}
+
+// Whether @texture is bound on @unit, leaving the active unit as it was.
+bool BoundOn(int unit, GLuint texture) {
+  GLint textures[2];
+  BoundTextures(textures);
+  return textures[unit] == (GLint)texture;
+}
+
+int CheckState() {
+  GLuint textures[3], vertex_arrays[2], buffers[2];
+  glGenTextures(2, textures);
+  glGenVertexArrays(2, vertex_arrays);
+  glGenBuffers(2, buffers);
+  const GLuint t1 = textures[0], t2 = textures[1];
+  GLuint& t3 = textures[2];
+  const GLuint v1 = vertex_arrays[0], v2 = vertex_arrays[1];
+  const GLuint b1 = buffers[0], b2 = buffers[1];
+
+  struct Step {
+    const char* what;
+    function<void()> call;
+    // Calls GLState should count as made and as skipped.
+    size_t made, skipped;
+    function<bool()> check;
+  };
+  const vector<Step> steps = {
+      {"bind t1 on unit 0", [&] { GLState::BindTexture(0, t1); }, 2, 0,
+       [&] { return BoundOn(0, t1); }},
+      {"bind t1 on unit 0 again", [&] { GLState::BindTexture(0, t1); }, 0,
+       1, nullptr},
+      {"bind t2 on unit 1", [&] { GLState::BindTexture(1, t2); }, 2, 0,
+       [&] { return BoundOn(1, t2); }},
+      {"update t1, bound on unit 0",
+       [&] { GLState::BindTextureForUpdate(0, t1); }, 1, 0,
+       [] { return Get(GL_ACTIVE_TEXTURE) == GL_TEXTURE0; }},
+      {"update t1 again", [&] { GLState::BindTextureForUpdate(0, t1); }, 0,
+       1, [] { return Get(GL_ACTIVE_TEXTURE) == GL_TEXTURE0; }},
+      {"update t1 on unit 1", [&] { GLState::BindTextureForUpdate(1, t1); },
+       2, 0,
+       [&] {
+         return Get(GL_ACTIVE_TEXTURE) == GL_TEXTURE1 && BoundOn(1, t1);
+       }},
+      {"bind v1", [&] { GLState::BindVertexArray(v1); }, 1, 0, nullptr},
+      {"bind b1 as v1's elements",
+       [&] { GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, b1); }, 1, 0,
+       nullptr},
+      {"bind b1 as v1's elements again",
+       [&] { GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, b1); }, 0, 1,
+       nullptr},
+      {"bind v2", [&] { GLState::BindVertexArray(v2); }, 1, 0, nullptr},
+      {"bind b1 as v2's elements",
+       [&] { GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, b1); }, 1, 0,
+       [&] { return Get(GL_ELEMENT_ARRAY_BUFFER_BINDING) == (GLint)b1; }},
+      {"bind b2", [&] { GLState::BindBuffer(GL_ARRAY_BUFFER, b2); }, 1, 0,
+       nullptr},
+      {"bind b2 again", [&] { GLState::BindBuffer(GL_ARRAY_BUFFER, b2); },
+       0, 1, nullptr},
+      {"enable blending", [] { GLState::Blend(true); }, 1, 0, nullptr},
+      {"enable blending again", [] { GLState::Blend(true); }, 0, 1,
+       nullptr},
+      {"set the blend function",
+       [] { GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); }, 1,
+       0, nullptr},
+      {"set the same blend function",
+       [] { GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); }, 0,
+       1, nullptr},
+      {"use no program", [] { GLState::UseProgram(0); }, 1, 0, nullptr},
+      {"use no program again", [] { GLState::UseProgram(0); }, 0, 1,
+       nullptr},
+      // GL may hand out t1's name again, which must still be bound.
+      {"delete t1, then bind a new t3 on unit 1",
+       [&] {
+         GLState::DeleteTexture(t1);
+         glGenTextures(1, &t3);
+         GLState::BindTexture(1, t3);
+       },
+       1, 1, [&] { return BoundOn(1, t3); }},
+  };
+
+  GLState::Reset();
+  GLState::TakeStats();
+  GLCallStats total;
+  for (const Step& step : steps) {
+    step.call();
+    GLCallStats stats = GLState::TakeStats();
+    if (stats.made != step.made || stats.skipped != step.skipped) {
+      cerr << "\"" << step.what << "\" counted " << stats.made
+           << " calls made and " << stats.skipped << " skipped, not "
+           << step.made << " and " << step.skipped << endl;
+      return 1;
+    }
+    if (step.check && !step.check()) {
+      cerr << "\"" << step.what << "\" left GL in the wrong state" << endl;
+      return 1;
+    }
+    total.made += stats.made;
+    total.skipped += stats.skipped;
+  }
+  cout << steps.size() << " steps: " << total.made << " calls made, "
+       << total.skipped << " skipped, as expected" << endl;
+
+  GLState::DeleteTexture(t2);
+  GLState::DeleteTexture(t3);
+  GLState::DeleteVertexArray(v1);
+  GLState::DeleteVertexArray(v2);
+  GLState::DeleteBuffer(b1);
+  GLState::DeleteBuffer(b2);
+  return 0;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    cerr << "usage: " << argv[0] << " queue|state" << endl;
+    return 1;
+  }
+  string bench = argv[1];
+  Display display(320, 240, 32);
+  if (bench == "queue") {
+    return CheckQueue();
+  }
+  if (bench == "state") {
+    return CheckState();
+  }
+  cerr << "Unknown benchmark " << bench << endl;
+  return 1;
+}
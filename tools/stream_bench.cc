@@ -0,0 +1,89 @@
+// Flies a camera across a huge generated level with ChunkStreamer keeping the
+// chunks around it resident.
+//
+//   stream_bench
+//
+// Chunks come from a source that takes a while to load each one, like a
+// disk would. Prints the slowest Update(), the chunks left resident, and how
+// often a tile on screen wasn't loaded yet.
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Camera.h"
+#include "ChunkStreamer.h"
+#include "TileMap.h"
+
+using namespace std;
+
+namespace {
+// 2^18 tiles on a side, far more than would fit in memory.
+const int MAP_SIZE = 1 << 18;
+const int NUM_FRAMES = 20000;
+// Time the rest of a frame takes, and each chunk load.
+const chrono::microseconds FRAME_TIME(500);
+const chrono::microseconds LOAD_TIME(200);
+// Camera movement per frame, in tiles. It turns around vertically every
+// TURN_FRAMES.
+const double SPEED_X = 1.5;
+const double SPEED_Y = 0.7;
+const int TURN_FRAMES = 2000;
+// Spacing of the tiles checked on screen each frame.
+const int SAMPLE_STEP = 5;
+
+// Scattered blocks, made up on the fly.
+class SlowChunkSource : public ChunkSource {
+ public:
+  void LoadChunk(int chunk_x, int chunk_y,
+                 vector<uint16_t>* tiles) const override {
+    const int size = TileMap::CHUNK_SIZE;
+    tiles->resize(size * size);
+    for (int i = 0; i < size * size; ++i) {
+      (*tiles)[i] = (chunk_x * 31 + chunk_y * 17 + i) % 7 == 0;
+    }
+    this_thread::sleep_for(LOAD_TIME);
+  }
+  int max_tile() const override { return TILE_BLOCK; }
+  size_t bytes() const override { return 0; }
+};
+}  // namespace
+
+int main() {
+  TileMap map(MAP_SIZE, MAP_SIZE, make_shared<SlowChunkSource>());
+  ChunkStreamer streamer(2, 2);
+  streamer.AddLayer(&map);
+  Camera camera({1000, 1000}, {20, 15});
+  streamer.LoadNow(camera.center());
+
+  double worst_update = 0;
+  int misses = 0;
+  const int half_w = camera.half_size().x;
+  const int half_h = camera.half_size().y;
+  for (int frame = 0; frame < NUM_FRAMES; ++frame) {
+    bool up = frame / TURN_FRAMES % 2 == 0;
+    camera.center(camera.center() + vec2d{SPEED_X, up ? SPEED_Y : -SPEED_Y});
+    auto start = chrono::steady_clock::now();
+    streamer.Update(camera);
+    worst_update = max(
+        worst_update,
+        chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    const vec2d center = camera.center();
+    for (int dy = -half_h; dy <= half_h; dy += SAMPLE_STEP) {
+      for (int dx = -half_w; dx <= half_w; dx += SAMPLE_STEP) {
+        if (!map.IsResident(((int)center.x + dx) / TileMap::CHUNK_SIZE,
+                            ((int)center.y + dy) / TileMap::CHUNK_SIZE)) {
+          ++misses;
+        }
+      }
+    }
+    this_thread::sleep_for(FRAME_TIME);
+  }
+  cout << "Slowest Update: " << worst_update * 1e6 << "us" << endl;
+  cout << map.resident_chunks() << " chunks resident, " << streamer.pending()
+       << " loading" << endl;
+  cout << misses << " tiles on screen weren't loaded yet" << endl;
+  return 0;
+}
@@ -0,0 +1,214 @@
+// Times TileMap on a generated 8192x8192 layer: solid terrain below a wavy
+// ground line, with sparse platforms and slopes above it.
+//
+//   tile_map_bench reads|edits
+//
+// reads prints the memory the resident tiles take, then times reading the
+// 5x5 tiles around random points and around points along a walk. edits digs
+// a crater into the ground each frame, times Set() and TakeDirty(), checks
+// that the dirty rects cover every change, then reloads every chunk and
+// checks that the edits survived.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TileMap.h"
+
+using namespace std;
+
+namespace {
+const int MAP_SIZE = 8192;
+// Ground height is MAP_SIZE / 4, give or take GROUND_WAVE.
+const double GROUND_WAVE = 200;
+const double GROUND_WAVELENGTH = 300;
+// One in this many tiles above the ground isn't empty.
+const int PLATFORM_ODDS = 97;
+const int NUM_READS = 1 << 22;
+// Reads are of the tiles within this many of a point, like a body's.
+const int READ_RADIUS = 2;
+const int NUM_CRATERS = 5000;
+const int MAX_CRATER_RADIUS = 6;
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Height of the ground at @x.
+int Ground(int x) {
+  return MAP_SIZE / 4 + (int)(GROUND_WAVE * sin(x / GROUND_WAVELENGTH));
+}
+
+unique_ptr<TileMap> MakeTerrain(mt19937* rng) {
+  vector<int> tiles((size_t)MAP_SIZE * MAP_SIZE);
+  uniform_int_distribution<int> platform(0, PLATFORM_ODDS - 1);
+  uniform_int_distribution<int> tile(TILE_BLOCK, TILE_SLOPE_50);
+  for (int x = 0; x < MAP_SIZE; ++x) {
+    int ground = Ground(x);
+    for (int y = 0; y < MAP_SIZE; ++y) {
+      int id = TILE_EMPTY;
+      if (y < ground) {
+        id = TILE_BLOCK;
+      } else if (platform(*rng) == 0) {
+        id = tile(*rng);
+      }
+      tiles[(size_t)y * MAP_SIZE + x] = id;
+    }
+  }
+  unique_ptr<TileMap> map(new TileMap(
+      MAP_SIZE, MAP_SIZE,
+      make_shared<MemoryChunkSource>(MAP_SIZE, MAP_SIZE, tiles)));
+  map->LoadAll();
+  return map;
+}
+
+// Sums the tiles around each of @points, which keeps the reads from being
+// optimized out, and returns the average time per point.
+double TimeReads(const TileMap& map, const vector<TilePos>& points,
+                 long* sum) {
+  auto start = chrono::steady_clock::now();
+  for (const TilePos& point : points) {
+    for (int dy = -READ_RADIUS; dy <= READ_RADIUS; ++dy) {
+      for (int dx = -READ_RADIUS; dx <= READ_RADIUS; ++dx) {
+        *sum += map.At(point.x + dx, point.y + dy);
+      }
+    }
+  }
+  return SecondsSince(start) / points.size();
+}
+
+int BenchReads() {
+  mt19937 rng(3);
+  unique_ptr<TileMap> map = MakeTerrain(&rng);
+  cout << "Resident tiles: " << map->resident_bytes() / (1 << 20)
+       << " MB, against "
+       << (size_t)MAP_SIZE * MAP_SIZE * sizeof(int) / (1 << 20)
+       << " MB as ints" << endl;
+
+  uniform_int_distribution<int> coord(0, MAP_SIZE - 1);
+  vector<TilePos> random(NUM_READS);
+  for (TilePos& point : random) {
+    point = {coord(rng), coord(rng)};
+  }
+  // Mostly right, now and then up, like something running over the level.
+  vector<TilePos> walk(NUM_READS);
+  TilePos point = {100, 100};
+  for (int i = 0; i < NUM_READS; ++i) {
+    point.x = (point.x + 1 + (i & 3)) % MAP_SIZE;
+    point.y = (point.y + ((i >> 3) & 1)) % MAP_SIZE;
+    walk[i] = point;
+  }
+  long sum = 0;
+  double random_time = TimeReads(*map, random, &sum);
+  double walk_time = TimeReads(*map, walk, &sum);
+  cout << "Random 5x5 reads: " << random_time * 1e9 << "ns" << endl;
+  cout << "Walk 5x5 reads:   " << walk_time * 1e9 << "ns" << endl;
+  // Printed so the reads can't be skipped.
+  cout << "Tile sum: " << sum << endl;
+  return 0;
+}
+
+long SumTiles(const TileMap& map) {
+  long sum = 0;
+  for (int y = 0; y < MAP_SIZE; ++y) {
+    for (int x = 0; x < MAP_SIZE; ++x) {
+      sum += map.At(x, y);
+    }
+  }
+  return sum;
+}
+
+int BenchEdits() {
+  mt19937 rng(4);
+  unique_ptr<TileMap> map = MakeTerrain(&rng);
+  const long sum_before = SumTiles(*map);
+  const size_t bytes_before = map->resident_bytes();
+
+  uniform_int_distribution<int> coord(MAX_CRATER_RADIUS,
+                                      MAP_SIZE - 1 - MAX_CRATER_RADIUS);
+  uniform_int_distribution<int> radius(1, MAX_CRATER_RADIUS);
+  vector<TilePos> changed;
+  vector<TileRect> rects;
+  double set_time = 0;
+  double take_time = 0;
+  long removed = 0;
+  long set_calls = 0;
+  long dirty_tiles = 0;
+  long changed_tiles = 0;
+  for (int i = 0; i < NUM_CRATERS; ++i) {
+    int cx = coord(rng);
+    int cy = Ground(cx);
+    int r = radius(rng);
+    changed.clear();
+    auto start = chrono::steady_clock::now();
+    for (int y = cy - r; y <= cy + r; ++y) {
+      for (int x = cx - r; x <= cx + r; ++x) {
+        if ((x - cx) * (x - cx) + (y - cy) * (y - cy) > r * r) {
+          continue;
+        }
+        TileType tile = map->At(x, y);
+        map->Set(x, y, TILE_EMPTY);
+        ++set_calls;
+        if (tile != TILE_EMPTY) {
+          removed += tile;
+          changed.push_back({x, y});
+        }
+      }
+    }
+    set_time += SecondsSince(start);
+    start = chrono::steady_clock::now();
+    map->TakeDirty(&rects);
+    take_time += SecondsSince(start);
+
+    for (const TilePos& tile : changed) {
+      if (none_of(rects.begin(), rects.end(), [&tile](const TileRect& rect) {
+            return tile.x >= rect.x && tile.x < rect.x + rect.w &&
+                   tile.y >= rect.y && tile.y < rect.y + rect.h;
+          })) {
+        cerr << "Tile (" << tile.x << ", " << tile.y
+             << ") changed but isn't in a dirty rect" << endl;
+        return 1;
+      }
+    }
+    for (const TileRect& rect : rects) {
+      dirty_tiles += rect.w * rect.h;
+    }
+    changed_tiles += changed.size();
+  }
+  cout << "Set: " << set_time * 1e9 / set_calls << "ns per tile" << endl;
+  cout << "TakeDirty: " << take_time * 1e6 / NUM_CRATERS << "us per frame, "
+       << dirty_tiles << " tiles dirty for " << changed_tiles << " changed"
+       << endl;
+  cout << "Edits grew the resident tiles by "
+       << (map->resident_bytes() - bytes_before) / (1 << 10) << " KB"
+       << endl;
+
+  map->LoadAll();
+  if (SumTiles(*map) != sum_before - removed) {
+    cerr << "Edits were lost reloading the map" << endl;
+    return 1;
+  }
+  return 0;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    cerr << "usage: " << argv[0] << " reads|edits" << endl;
+    return 1;
+  }
+  string bench = argv[1];
+  if (bench == "reads") {
+    return BenchReads();
+  }
+  if (bench == "edits") {
+    return BenchEdits();
+  }
+  cerr << "Unknown benchmark " << bench << endl;
+  return 1;
+}
@@ -0,0 +1,192 @@
+// Times Map::LoadTmx on a generated 2048x2048 level, saved with each of the
+// layer encodings Tiled offers.
+//
+//   tmx_bench
+//
+// The level is written to a temporary file, loaded back and checked tile by
+// tile against what was generated. Prints the load time for each encoding
+// and the memory the loaded layer takes.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef USE_MINIZ
+#define MINIZ_HEADER_FILE_ONLY
+#include "miniz.c"
+#else
+#include <zlib.h>
+#endif
+
+#include "TileMap.h"
+
+using namespace std;
+
+namespace {
+const int MAP_SIZE = 2048;
+const int NUM_LOADS = 5;
+// Ground height is MAP_SIZE / 4, give or take GROUND_WAVE.
+const double GROUND_WAVE = 100;
+const double GROUND_WAVELENGTH = 150;
+// One in this many tiles above the ground isn't empty.
+const int PLATFORM_ODDS = 97;
+// Tiled sets gids' top bits when tiles are flipped; they must be ignored.
+const uint32_t FLIPPED_HORIZONTALLY = 0x80000000;
+const char BASE64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Tile ids row by row from the lower left, like a TileMap has them.
+vector<int> MakeTerrain() {
+  mt19937 rng(5);
+  uniform_int_distribution<int> platform(0, PLATFORM_ODDS - 1);
+  uniform_int_distribution<int> tile(TILE_BLOCK, TILE_SLOPE_50);
+  vector<int> tiles((size_t)MAP_SIZE * MAP_SIZE);
+  for (int x = 0; x < MAP_SIZE; ++x) {
+    int ground =
+        MAP_SIZE / 4 + (int)(GROUND_WAVE * sin(x / GROUND_WAVELENGTH));
+    for (int y = 0; y < MAP_SIZE; ++y) {
+      int id = TILE_EMPTY;
+      if (y < ground) {
+        id = TILE_BLOCK;
+      } else if (platform(rng) == 0) {
+        id = tile(rng);
+      }
+      tiles[(size_t)y * MAP_SIZE + x] = id;
+    }
+  }
+  return tiles;
+}
+
+// @tiles as the gids Tiled would save, top row first, with a tileset
+// starting at gid 1 and every other slope flipped.
+vector<uint32_t> Gids(const vector<int>& tiles) {
+  vector<uint32_t> gids(tiles.size());
+  for (int y = 0; y < MAP_SIZE; ++y) {
+    for (int x = 0; x < MAP_SIZE; ++x) {
+      int tile = tiles[(size_t)(MAP_SIZE - 1 - y) * MAP_SIZE + x];
+      uint32_t gid = tile + 1;
+      if (IsSlope((TileType)tile) && x % 2) {
+        gid |= FLIPPED_HORIZONTALLY;
+      }
+      gids[(size_t)y * MAP_SIZE + x] = gid;
+    }
+  }
+  return gids;
+}
+
+string EncodeBase64(const uint8_t* bytes, size_t size) {
+  string out;
+  out.reserve((size + 2) / 3 * 4);
+  for (size_t i = 0; i < size; i += 3) {
+    uint32_t bits = bytes[i] << 16;
+    if (i + 1 < size) {
+      bits |= bytes[i + 1] << 8;
+    }
+    if (i + 2 < size) {
+      bits |= bytes[i + 2];
+    }
+    out += BASE64[bits >> 18];
+    out += BASE64[bits >> 12 & 63];
+    out += i + 1 < size ? BASE64[bits >> 6 & 63] : '=';
+    out += i + 2 < size ? BASE64[bits & 63] : '=';
+  }
+  return out;
+}
+
+// The <data> element for @gids in @encoding: csv, base64 or zlib.
+string LayerData(const vector<uint32_t>& gids, const string& encoding) {
+  if (encoding == "csv") {
+    string data = "<data encoding=\"csv\">\n";
+    for (size_t i = 0; i < gids.size(); ++i) {
+      data += to_string(gids[i]);
+      data += i + 1 == gids.size() ? "\n" : (i + 1) % MAP_SIZE ? "," : ",\n";
+    }
+    return data + "</data>";
+  }
+  vector<uint8_t> bytes;
+  bytes.reserve(gids.size() * 4);
+  for (uint32_t gid : gids) {
+    for (int shift = 0; shift < 32; shift += 8) {
+      bytes.push_back(gid >> shift);
+    }
+  }
+  if (encoding == "zlib") {
+    uLongf size = compressBound(bytes.size());
+    vector<uint8_t> compressed(size);
+    compress(compressed.data(), &size, bytes.data(), bytes.size());
+    return "<data encoding=\"base64\" compression=\"zlib\">" +
+           EncodeBase64(compressed.data(), size) + "</data>";
+  }
+  return "<data encoding=\"base64\">" +
+         EncodeBase64(bytes.data(), bytes.size()) + "</data>";
+}
+
+string Level(const vector<uint32_t>& gids, const string& encoding) {
+  string size = "width=\"" + to_string(MAP_SIZE) + "\" height=\"" +
+                to_string(MAP_SIZE) + "\"";
+  return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+         "<map version=\"1.2\" orientation=\"orthogonal\" " +
+         size +
+         " tilewidth=\"16\" tileheight=\"16\" infinite=\"0\">\n"
+         " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" "
+         "tileheight=\"16\" tilecount=\"8\" columns=\"8\"/>\n"
+         " <layer name=\"Collision\" " +
+         size + ">\n" + LayerData(gids, encoding) +
+         "\n </layer>\n</map>\n";
+}
+
+bool SameTiles(const TileMap& map, const vector<int>& tiles) {
+  for (int y = 0; y < MAP_SIZE; ++y) {
+    for (int x = 0; x < MAP_SIZE; ++x) {
+      if (map.At(x, y) != tiles[(size_t)y * MAP_SIZE + x]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace
+
+int main() {
+  const vector<int> tiles = MakeTerrain();
+  const vector<uint32_t> gids = Gids(tiles);
+  const string filename = "tmx_bench.tmx";
+  for (const char* encoding : {"csv", "base64", "zlib"}) {
+    string level = Level(gids, encoding);
+    ofstream(filename, ios::binary) << level;
+
+    double time = 0;
+    for (int i = 0; i < NUM_LOADS; ++i) {
+      Map map;
+      auto start = chrono::steady_clock::now();
+      int error = map.LoadTmx(filename);
+      time += SecondsSince(start);
+      const TileMap* layer = map.GetLayer("Collision");
+      if (error || !layer || !SameTiles(*layer, tiles)) {
+        cerr << "Loading the " << encoding
+             << " level doesn't give back its tiles" << endl;
+        remove(filename.c_str());
+        return 1;
+      }
+      if (i == 0) {
+        cout << encoding << ": " << level.size() / (1 << 10) << " KB, layer "
+             << (layer->source()->bytes() + layer->resident_bytes()) /
+                    (1 << 10)
+             << " KB once loaded" << endl;
+      }
+    }
+    cout << encoding << ": " << time * 1e3 / NUM_LOADS << "ms per load"
+         << endl;
+  }
+  remove(filename.c_str());
+  return 0;
+}